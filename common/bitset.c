@@ -0,0 +1,188 @@
+/*
+ * This file implements the "bitset" module for my rogue-like
+ * The "bitset" module is defined in bitset.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "bitset.h"
+#include "mem.h"
+
+/**************** file-local constants *******************/
+static const int WORDBITS = 64;        // bits in a word
+
+/**************** global types ****************/
+typedef struct bitset {
+  uint64_t* words;                     // the bits, 64 to a word
+  int numWords;                        // number of words
+  int numBits;                         // number of bits the set can hold
+} bitset_t;
+
+/**************** bitset_new ***************/
+/* see bitset.h for details */
+bitset_t* bitset_new(int numBits)
+{
+  bitset_t* set = NULL;                // set to create
+
+  // check param
+  if (numBits < 1) {
+    return NULL;
+  }
+
+  if ((set = mem_malloc(sizeof(bitset_t))) == NULL) {
+    return NULL;
+  }
+
+  // round up to whole words, calloc leaves the set empty
+  set->numWords = (numBits + WORDBITS - 1) / WORDBITS;
+  set->numBits = numBits;
+  if ((set->words = mem_calloc(set->numWords, sizeof(uint64_t))) == NULL) {
+    mem_free(set);
+    return NULL;
+  }
+
+  return set;
+}
+
+/**************** getters ***************/
+int bitset_getSize(const bitset_t* set)
+{
+  return set ? set->numBits : 0;
+}
+
+const uint64_t* bitset_getWords(const bitset_t* set, int* numWords)
+{
+  if (set == NULL) {
+    return NULL;
+  }
+  if (numWords != NULL) {
+    *numWords = set->numWords;
+  }
+  return set->words;
+}
+
+/**************** bitset_set ***************/
+/* see bitset.h for details */
+void bitset_set(bitset_t* set, int index)
+{
+  if (set == NULL || index < 0 || index >= set->numBits) {
+    return;
+  }
+  set->words[index / WORDBITS] |= (uint64_t)1 << (index % WORDBITS);
+}
+
+/**************** bitset_unset ***************/
+/* see bitset.h for details */
+void bitset_unset(bitset_t* set, int index)
+{
+  if (set == NULL || index < 0 || index >= set->numBits) {
+    return;
+  }
+  set->words[index / WORDBITS] &= ~((uint64_t)1 << (index % WORDBITS));
+}
+
+/**************** bitset_test ***************/
+/* see bitset.h for details */
+bool bitset_test(const bitset_t* set, int index)
+{
+  if (set == NULL || index < 0 || index >= set->numBits) {
+    return false;
+  }
+  return (set->words[index / WORDBITS] >> (index % WORDBITS)) & 1;
+}
+
+/**************** bitset_clear ***************/
+/* see bitset.h for details */
+void bitset_clear(bitset_t* set)
+{
+  if (set != NULL) {
+    memset(set->words, 0, set->numWords * sizeof(uint64_t));
+  }
+}
+
+/**************** bitset_union ***************/
+/* see bitset.h for details */
+bool bitset_union(bitset_t* dest, const bitset_t* src)
+{
+  // check params
+  if (dest == NULL || src == NULL || dest->numBits != src->numBits) {
+    return false;
+  }
+
+  // merge a word at a time
+  for (int i = 0; i < dest->numWords; i++) {
+    dest->words[i] |= src->words[i];
+  }
+  return true;
+}
+
+/**************** bitset_count ***************/
+/* see bitset.h for details */
+int bitset_count(const bitset_t* set)
+{
+  int count = 0;                       // number of bits set so far
+
+  if (set == NULL) {
+    return 0;
+  }
+
+  for (int i = 0; i < set->numWords; i++) {
+    count += __builtin_popcountll(set->words[i]);
+  }
+  return count;
+}
+
+/**************** bitset_next ***************/
+/* see bitset.h for details */
+int bitset_next(const bitset_t* set, int from)
+{
+  // check params
+  if (set == NULL || from >= set->numBits) {
+    return -1;
+  }
+  if (from < 0) {
+    from = 0;
+  }
+
+  // ignore the bits below from in its word
+  int wordIndex = from / WORDBITS;
+  uint64_t word = set->words[wordIndex] & (~(uint64_t)0 << (from % WORDBITS));
+
+  // skip over empty words, then find the lowest bit in the first non-empty one
+  while (word == 0) {
+    if (++wordIndex >= set->numWords) {
+      return -1;
+    }
+    word = set->words[wordIndex];
+  }
+  return wordIndex * WORDBITS + __builtin_ctzll(word);
+}
+
+/**************** bitset_iterate ***************/
+/* see bitset.h for details */
+void bitset_iterate(const bitset_t* set, void* arg,
+                    void (*itemfunc)(void* arg, const int index))
+{
+  if (set == NULL || itemfunc == NULL) {
+    return;
+  }
+
+  for (int i = bitset_next(set, 0); i >= 0; i = bitset_next(set, i + 1)) {
+    (*itemfunc)(arg, i);
+  }
+}
+
+/**************** bitset_delete ***************/
+/* see bitset.h for details */
+void bitset_delete(bitset_t* set)
+{
+  if (set != NULL) {
+    mem_free(set->words);
+    mem_free(set);
+  }
+}
@@ -0,0 +1,90 @@
+/*
+ * This file defines the "bitset" module for my rogue-like
+ * A "bitset" is a fixed-size set of small non-negative integers,
+ * stored as one bit per integer packed into 64-bit words
+ *
+ * It is used to hold sets of map positions, such as the tiles visible
+ * to a player. Positions are indices into the map string, so the bits are
+ * laid out row by row in the same order as the map itself,
+ * which takes 1/32 of the memory of an int per tile
+ * and lets two sets be merged a whole word (64 tiles) at a time
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __BITSET_H
+#define __BITSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**************** global types ****************/
+typedef struct bitset bitset_t;  // opaque to users of the module
+
+/**************** functions **************/
+
+/**************** bitset_new ***************/
+/* creates an empty set that can hold the integers [0, numBits)
+ * allocates memory that must be free'd with bitset_delete
+ * returns NULL if numBits < 1 or failure to allocate memory
+ */
+bitset_t* bitset_new(int numBits);
+
+/**************** bitset_getSize ***************/
+/* returns the number of bits the set can hold, 0 if set is NULL */
+int bitset_getSize(const bitset_t* set);
+
+/**************** bitset_getWords ***************/
+/* returns the set's words, bit i of the set is bit (i % 64) of word (i / 64)
+ * and stores the number of words in numWords. Bits past the size of the set are 0
+ * the returned array belongs to the set, returns NULL if set is NULL
+ */
+const uint64_t* bitset_getWords(const bitset_t* set, int* numWords);
+
+/**************** bitset_set ***************/
+/* adds index to the set, does nothing if set is NULL or index out of range */
+void bitset_set(bitset_t* set, int index);
+
+/**************** bitset_unset ***************/
+/* removes index from the set, does nothing if set is NULL or index out of range */
+void bitset_unset(bitset_t* set, int index);
+
+/**************** bitset_test ***************/
+/* returns true if index is in the set,
+ * false if it is not, set is NULL, or index is out of range
+ */
+bool bitset_test(const bitset_t* set, int index);
+
+/**************** bitset_clear ***************/
+/* removes every index from the set */
+void bitset_clear(bitset_t* set);
+
+/**************** bitset_union ***************/
+/* adds every index in src to dest
+ * returns false if either set is NULL or they differ in size, true otherwise
+ */
+bool bitset_union(bitset_t* dest, const bitset_t* src);
+
+/**************** bitset_count ***************/
+/* returns the number of indices in the set, 0 if set is NULL */
+int bitset_count(const bitset_t* set);
+
+/**************** bitset_next ***************/
+/* returns the smallest index in the set that is >= from,
+ * or -1 if there is none. Iterate over a set with:
+ *   for (int i = bitset_next(set, 0); i >= 0; i = bitset_next(set, i + 1))
+ */
+int bitset_next(const bitset_t* set, int from);
+
+/**************** bitset_iterate ***************/
+/* calls itemfunc(arg, index) on every index in the set, in increasing order
+ * does nothing if set or itemfunc is NULL
+ */
+void bitset_iterate(const bitset_t* set, void* arg,
+                    void (*itemfunc)(void* arg, const int index));
+
+/**************** bitset_delete ***************/
+/* free's all memory held by the set */
+void bitset_delete(bitset_t* set);
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * This file implements the "chunkmap" module for my rogue-like
+ * The "chunkmap" module is defined in chunkmap.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "chunkmap.h"
+#include "mem.h"
+
+/**************** file-local constants *******************/
+static const int CHUNKMASK = CHUNKMAP_SIZE - 1;        // tile within a chunk along one side
+static const int CHUNKTILES = CHUNKMAP_SIZE * CHUNKMAP_SIZE;  // tiles in a chunk
+
+/**************** global types ****************/
+typedef struct chunkmap {
+  char** directory;                    // every chunk, row by row, NULL until written
+  int chunksWide;                      // chunks along a row of the directory
+  int chunksHigh;                      // rows of chunks in the directory
+  int width;                           // tiles along a row of the map
+  int height;                          // rows of the map
+  int numChunks;                       // chunks allocated so far
+} chunkmap_t;
+
+/**************** local functions ****************/
+static bool onMap(chunkmap_t* chunks, int x, int y);
+static char** chunkFor(chunkmap_t* chunks, int x, int y);
+
+/**************** chunkmap_new ***************/
+/* see chunkmap.h for details */
+chunkmap_t* chunkmap_new(int width, int height)
+{
+  chunkmap_t* chunks = NULL;           // chunkmap to return
+
+  // check params
+  if (width < 1 || height < 1) {
+    return NULL;
+  }
+  if ((chunks = mem_malloc(sizeof(chunkmap_t))) == NULL) {
+    return NULL;
+  }
+  chunks->chunksWide = (width + CHUNKMASK) >> CHUNKMAP_SHIFT;
+  chunks->chunksHigh = (height + CHUNKMASK) >> CHUNKMAP_SHIFT;
+  chunks->width = width;
+  chunks->height = height;
+  chunks->numChunks = 0;
+  // an empty directory, every chunk unallocated
+  chunks->directory = mem_calloc((size_t)chunks->chunksWide * chunks->chunksHigh,
+                                 sizeof(char*));
+  if (chunks->directory == NULL) {
+    mem_free(chunks);
+    return NULL;
+  }
+  return chunks;
+}
+
+/**************** chunkmap_get ***************/
+/* see chunkmap.h for details */
+char chunkmap_get(chunkmap_t* chunks, int x, int y)
+{
+  if (! onMap(chunks, x, y)) {
+    return '\0';
+  }
+  const char* chunk = *chunkFor(chunks, x, y);
+  if (chunk == NULL) {
+    return '\0';
+  }
+  return chunk[((y & CHUNKMASK) << CHUNKMAP_SHIFT) + (x & CHUNKMASK)];
+}
+
+/**************** chunkmap_set ***************/
+/* see chunkmap.h for details */
+bool chunkmap_set(chunkmap_t* chunks, int x, int y, char tile)
+{
+  if (! onMap(chunks, x, y)) {
+    return false;
+  }
+  char** chunk = chunkFor(chunks, x, y);
+  if (*chunk == NULL) {
+    // nothing to write over in a chunk that was never allocated
+    if (tile == '\0') {
+      return true;
+    }
+    // plain calloc, as this runs on the vision workers (see workpool.h)
+    if ((*chunk = calloc(CHUNKTILES, 1)) == NULL) {
+      return false;
+    }
+    chunks->numChunks++;
+  }
+  (*chunk)[((y & CHUNKMASK) << CHUNKMAP_SHIFT) + (x & CHUNKMASK)] = tile;
+  return true;
+}
+
+/**************** chunkmap_getRow ***************/
+/* see chunkmap.h for details */
+const char* chunkmap_getRow(chunkmap_t* chunks, int x, int y, int* length)
+{
+  if (length == NULL) {
+    return NULL;
+  }
+  if (! onMap(chunks, x, y)) {
+    *length = 0;
+    return NULL;
+  }
+
+  // to the end of the chunk, unless the map ends first
+  const int chunkEnd = (x | CHUNKMASK) + 1;
+  *length = (chunkEnd < chunks->width ? chunkEnd : chunks->width) - x;
+
+  const char* chunk = *chunkFor(chunks, x, y);
+  if (chunk == NULL) {
+    return NULL;
+  }
+  return chunk + ((y & CHUNKMASK) << CHUNKMAP_SHIFT) + (x & CHUNKMASK);
+}
+
+/**************** chunkmap_getNumChunks ***************/
+/* see chunkmap.h for details */
+int chunkmap_getNumChunks(chunkmap_t* chunks)
+{
+  return chunks ? chunks->numChunks : 0;
+}
+
+/**************** chunkmap_getBytes ***************/
+/* see chunkmap.h for details */
+size_t chunkmap_getBytes(chunkmap_t* chunks)
+{
+  if (chunks == NULL) {
+    return 0;
+  }
+  return sizeof(chunkmap_t)
+    + (size_t)chunks->chunksWide * chunks->chunksHigh * sizeof(char*)
+    + (size_t)chunks->numChunks * CHUNKTILES;
+}
+
+/**************** chunkmap_delete ***************/
+/* see chunkmap.h for details */
+void chunkmap_delete(chunkmap_t* chunks)
+{
+  if (chunks == NULL) {
+    return;
+  }
+  const int numEntries = chunks->chunksWide * chunks->chunksHigh;
+  for (int i = 0; i < numEntries; i++) {
+    if (chunks->directory[i] != NULL) {
+      free(chunks->directory[i]);
+    }
+  }
+  mem_free(chunks->directory);
+  mem_free(chunks);
+}
+
+/**************** onMap ***************/
+/* returns true if chunks exists and (x, y) lies on it */
+static bool onMap(chunkmap_t* chunks, int x, int y)
+{
+  return chunks != NULL && x >= 0 && y >= 0 && x < chunks->width && y < chunks->height;
+}
+
+/**************** chunkFor ***************/
+/* returns the directory entry of the chunk holding (x, y), which must be on the map */
+static char** chunkFor(chunkmap_t* chunks, int x, int y)
+{
+  return &chunks->directory[(y >> CHUNKMAP_SHIFT) * chunks->chunksWide
+                            + (x >> CHUNKMAP_SHIFT)];
+}
+
+#ifdef CHUNKMAPTEST
+#include "unittest.h"
+
+// writes tiles at random, checking each against a plain array of the whole map
+// usage: chunkmaptest
+int
+main(int argc, char* argv[])
+{
+  const int width = 300;               // not a multiple of CHUNKMAP_SIZE,
+  const int height = 130;              // so the last chunks are cut short
+  char* expected = calloc((size_t)width * height, 1);   // every tile of the map
+  chunkmap_t* chunks = chunkmap_new(width, height);
+  check(chunks != NULL && expected != NULL, "chunkmap created");
+  check(chunkmap_new(0, 5) == NULL && chunkmap_new(5, 0) == NULL, "empty map");
+  check(chunkmap_getNumChunks(chunks) == 0, "no chunks until written");
+
+  // writes off the map, and '\0' to an unallocated chunk, allocate nothing
+  check( ! chunkmap_set(chunks, -1, 0, 'a') && ! chunkmap_set(chunks, width, 0, 'a')
+         && ! chunkmap_set(chunks, 0, height, 'a') && ! chunkmap_set(NULL, 0, 0, 'a'),
+         "writes off the map refused");
+  check(chunkmap_set(chunks, 10, 10, '\0') && chunkmap_getNumChunks(chunks) == 0,
+        "writing nothing allocates nothing");
+  check(chunkmap_get(chunks, 10, 10) == '\0' && chunkmap_get(chunks, -1, 0) == '\0',
+        "unwritten tiles read as nothing");
+
+  // one tile in the last corner allocates only the chunk it lies in
+  chunkmap_set(chunks, width - 1, height - 1, 'z');
+  expected[(height - 1) * width + width - 1] = 'z';
+  check(chunkmap_getNumChunks(chunks) == 1 && chunkmap_get(chunks, width - 1, height - 1) == 'z',
+        "one chunk for one tile");
+
+  // then tiles at random all over the map
+  srand(1);
+  for (int i = 0; i < 20000; i++) {
+    int x = rand() % width;
+    int y = rand() % height;
+    char tile = (rand() % 4 == 0) ? '\0' : 'a' + rand() % 26;
+    chunkmap_set(chunks, x, y, tile);
+    expected[y * width + x] = tile;
+  }
+  bool same = true;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      same = same && chunkmap_get(chunks, x, y) == expected[y * width + x];
+    }
+  }
+  check(same, "every tile where it was put");
+  const int chunksWide = (width + CHUNKMAP_SIZE - 1) / CHUNKMAP_SIZE;
+  const int chunksHigh = (height + CHUNKMAP_SIZE - 1) / CHUNKMAP_SIZE;
+  check(chunkmap_getNumChunks(chunks) == chunksWide * chunksHigh, "every chunk allocated");
+
+  // rows read a chunk at a time put the whole map back together
+  same = true;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; ) {
+      int length = 0;
+      const char* row = chunkmap_getRow(chunks, x, y, &length);
+      same = same && length > 0 && row != NULL
+        && memcmp(row, &expected[y * width + x], length) == 0;
+      x += length > 0 ? length : width;
+    }
+  }
+  check(same, "rows read back chunk by chunk");
+  int length = -1;
+  check(chunkmap_getRow(chunks, width, 0, &length) == NULL && length == 0,
+        "no row off the map");
+
+  chunkmap_delete(chunks);
+  free(expected);
+  exit(unittest_finish("chunkmap"));
+}
+#endif
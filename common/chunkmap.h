@@ -0,0 +1,84 @@
+/*
+ * This file defines the "chunkmap" module for my rogue-like
+ * A "chunkmap" is a map of width x height tiles, one character each, that
+ * only holds memory for the parts of it that have been written
+ *
+ * The map is cut into chunks of CHUNKMAP_SIZE x CHUNKMAP_SIZE tiles, and a
+ * directory holds a pointer to each chunk, NULL until a tile of that chunk
+ * is first written. Every tile of a chunk that was never allocated reads
+ * as '\0', as does every tile of a new chunk until it is written, so a map
+ * that is mostly unwritten costs little more than its directory
+ * Tiles are found by their (x, y) coordinates, x along a row and y down
+ * the rows, both starting from 0
+ * chunkmap_set may be called from several threads at once, each on a
+ * chunkmap of its own, as chunks are allocated without the libcs50 mem_*
+ * counters (see workpool.h)
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __CHUNKMAP_H
+#define __CHUNKMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* log2 of the number of tiles along each side of a chunk */
+#define CHUNKMAP_SHIFT 6
+/* the number of tiles along each side of a chunk */
+#define CHUNKMAP_SIZE (1 << CHUNKMAP_SHIFT)
+
+/**************** global types ****************/
+typedef struct chunkmap chunkmap_t;  // opaque to users of the module
+
+/**************** functions **************/
+
+/**************** chunkmap_new ***************/
+/* returns a new chunkmap of width x height tiles, all of them '\0'
+ * and none of its chunks allocated
+ * the chunkmap must later be free'd with chunkmap_delete
+ * returns NULL if width or height < 1, or failure to allocate memory
+ */
+chunkmap_t* chunkmap_new(int width, int height);
+
+/**************** chunkmap_get ***************/
+/* returns the tile at (x, y), '\0' if it was never written,
+ * if (x, y) is off the map, or on bad params
+ */
+char chunkmap_get(chunkmap_t* chunks, int x, int y);
+
+/**************** chunkmap_set ***************/
+/* sets the tile at (x, y), allocating its chunk if this is the first
+ * tile of the chunk written. Writing '\0' to a chunk that was never
+ * allocated leaves it that way
+ * returns true on success, false if (x, y) is off the map, on bad params,
+ * or failure to allocate memory
+ */
+bool chunkmap_set(chunkmap_t* chunks, int x, int y, char tile);
+
+/**************** chunkmap_getRow ***************/
+/* returns the tiles of row y that lie in the same chunk as (x, y), from x
+ * to the end of the chunk's row or of the map, whichever comes first, and
+ * stores how many there are in length. The tiles belong to the chunkmap,
+ * and are only good until its next chunkmap_set
+ * returns NULL if the chunk was never allocated, in which case every one of
+ * those tiles is '\0', and still stores length
+ * returns NULL and stores 0 if (x, y) is off the map or on bad params
+ */
+const char* chunkmap_getRow(chunkmap_t* chunks, int x, int y, int* length);
+
+/**************** chunkmap_getNumChunks ***************/
+/* returns the number of chunks allocated so far, 0 on bad params */
+int chunkmap_getNumChunks(chunkmap_t* chunks);
+
+/**************** chunkmap_getBytes ***************/
+/* returns the bytes the chunkmap holds: the struct, its directory and
+ * every chunk allocated, 0 on bad params
+ */
+size_t chunkmap_getBytes(chunkmap_t* chunks);
+
+/**************** chunkmap_delete ***************/
+/* free's the chunkmap and all of its chunks, does nothing if chunks is NULL */
+void chunkmap_delete(chunkmap_t* chunks);
+
+#endif
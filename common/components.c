@@ -0,0 +1,347 @@
+/*
+ * This file implements the "components" module for my rogue-like
+ * The "components" module is defined in components.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "components.h"
+#include "tiles.h"
+#include "mem.h"
+
+/**************** global types ****************/
+typedef struct components {
+  int* ids;                            // component of every tile, -1 if not walkable
+  int* sizes;                          // tiles in each component
+  int numComponents;                   // number of components
+  int largest;                         // component with the most tiles, -1 if none
+  int mapLen;                          // length of the map string
+} components_t;
+
+/**************** local functions ****************/
+static int findRoot(int* parent, int pos);
+static void join(int* parent, int* sizes, int a, int b);
+
+/**************** components_new ***************/
+/* see components.h for details */
+components_t* components_new(const uint8_t* flags, const uint8_t* moves,
+                             int mapLen, int numColumns)
+{
+  components_t* components = NULL;     // components to return
+
+  // check params
+  if (flags == NULL || moves == NULL || mapLen < 1 || numColumns < 0) {
+    return NULL;
+  }
+  if ((components = mem_malloc(sizeof(components_t))) == NULL) {
+    return NULL;
+  }
+  components->ids = mem_malloc(mapLen * sizeof(int));
+  components->sizes = NULL;
+  components->numComponents = 0;
+  components->largest = -1;
+  components->mapLen = mapLen;
+  int* parent = mem_malloc(mapLen * sizeof(int));   // union-find forest
+  int* treeSizes = mem_malloc(mapLen * sizeof(int));  // tiles under each root
+  if (components->ids == NULL || parent == NULL || treeSizes == NULL) {
+    if (parent != NULL) {
+      mem_free(parent);
+    }
+    if (treeSizes != NULL) {
+      mem_free(treeSizes);
+    }
+    components_delete(components);
+    return NULL;
+  }
+
+  // every tile starts in a tree of its own
+  for (int pos = 0; pos < mapLen; pos++) {
+    parent[pos] = pos;
+    treeSizes[pos] = 1;
+  }
+
+  // steps are open both ways, so joining each tile to the tiles after it
+  // joins every pair a step apart
+  int offsets[NUM_DIRECTIONS];
+  for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+    offsets[dir] = tiles_stepOffset(dir, numColumns);
+  }
+  for (int pos = 0; pos < mapLen; pos++) {
+    for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+      const int next = pos + offsets[dir];
+      if (offsets[dir] > 0 && (moves[pos] & MOVE_BIT(dir)) && next < mapLen) {
+        join(parent, treeSizes, pos, next);
+      }
+    }
+  }
+
+  // number the trees in the order of their first tile
+  // a root after pos gets its number early, and keeps it when reached
+  for (int pos = 0; pos < mapLen; pos++) {
+    components->ids[pos] = -1;
+  }
+  for (int pos = 0; pos < mapLen; pos++) {
+    if ((flags[pos] & TILE_WALKABLE) == 0) {
+      continue;
+    }
+    const int root = findRoot(parent, pos);
+    if (components->ids[root] < 0) {
+      components->ids[root] = components->numComponents++;
+    }
+    components->ids[pos] = components->ids[root];
+  }
+  mem_free(parent);
+
+  // then how large each one is, reusing the tree sizes of their roots
+  if (components->numComponents > 0) {
+    components->sizes = mem_calloc(components->numComponents, sizeof(int));
+    if (components->sizes == NULL) {
+      mem_free(treeSizes);
+      components_delete(components);
+      return NULL;
+    }
+  }
+  for (int pos = 0; pos < mapLen; pos++) {
+    if (components->ids[pos] >= 0) {
+      components->sizes[components->ids[pos]]++;
+    }
+  }
+  mem_free(treeSizes);
+  for (int id = 0; id < components->numComponents; id++) {
+    if (components->largest < 0 || components->sizes[id] > components->sizes[components->largest]) {
+      components->largest = id;
+    }
+  }
+  return components;
+}
+
+/**************** components_getComponent ***************/
+/* see components.h for details */
+int components_getComponent(components_t* components, int pos)
+{
+  if (components == NULL || pos < 0 || pos >= components->mapLen) {
+    return -1;
+  }
+  return components->ids[pos];
+}
+
+/**************** components_getNumComponents ***************/
+/* see components.h for details */
+int components_getNumComponents(components_t* components)
+{
+  return components ? components->numComponents : 0;
+}
+
+/**************** components_getSize ***************/
+/* see components.h for details */
+int components_getSize(components_t* components, int component)
+{
+  if (components == NULL || component < 0 || component >= components->numComponents) {
+    return 0;
+  }
+  return components->sizes[component];
+}
+
+/**************** components_getLargest ***************/
+/* see components.h for details */
+int components_getLargest(components_t* components)
+{
+  return components ? components->largest : -1;
+}
+
+/**************** components_getBytes ***************/
+/* see components.h for details */
+size_t components_getBytes(components_t* components)
+{
+  if (components == NULL) {
+    return 0;
+  }
+  return sizeof(components_t)
+    + ((size_t)components->mapLen + components->numComponents) * sizeof(int);
+}
+
+/**************** components_delete ***************/
+/* see components.h for details */
+void components_delete(components_t* components)
+{
+  if (components == NULL) {
+    return;
+  }
+  if (components->ids != NULL) {
+    mem_free(components->ids);
+  }
+  if (components->sizes != NULL) {
+    mem_free(components->sizes);
+  }
+  mem_free(components);
+}
+
+/**************** findRoot ***************/
+/* returns the root of the tree holding pos, pointing every other tile on
+ * the way up at its grandparent, which keeps later searches short
+ */
+static int findRoot(int* parent, int pos)
+{
+  while (parent[pos] != pos) {
+    parent[pos] = parent[parent[pos]];
+    pos = parent[pos];
+  }
+  return pos;
+}
+
+/**************** join ***************/
+/* joins the trees holding a and b, hanging the smaller under the larger */
+static void join(int* parent, int* sizes, int a, int b)
+{
+  int rootA = findRoot(parent, a);
+  int rootB = findRoot(parent, b);
+  if (rootA == rootB) {
+    return;
+  }
+  if (sizes[rootA] < sizes[rootB]) {
+    const int swap = rootA;
+    rootA = rootB;
+    rootB = swap;
+  }
+  parent[rootB] = rootA;
+  sizes[rootA] += sizes[rootB];
+}
+
+#ifdef COMPONENTSTEST
+#include "unittest.h"
+
+static void buildLayouts(const char* map, int mapLen, int numColumns,
+                         uint8_t* flags, uint8_t* moves);
+static void floodLabels(const uint8_t* moves, const uint8_t* flags, int mapLen,
+                        int numColumns, int* labels);
+
+// labels a small map worked out by hand, then random maps against a flood fill
+// usage: componentstest
+int
+main(int argc, char* argv[])
+{
+  // a room, an area joined to a passage only diagonally, and a lone passage
+  // tile that lies next to the end of the row above only in the string
+  const char* map =
+    "..| .#.\n"
+    "..|# ..\n"
+    "--+-- .\n"
+    "#  |   \n";
+  const int numColumns = 7;
+  const int mapLen = strlen(map);
+  uint8_t flags[64];
+  uint8_t moves[64];
+  buildLayouts(map, mapLen, numColumns, flags, moves);
+
+  components_t* components = components_new(flags, moves, mapLen, numColumns);
+  check(components != NULL, "components created");
+  check(components_new(NULL, moves, mapLen, numColumns) == NULL
+        && components_new(flags, moves, 0, numColumns) == NULL, "bad params refused");
+  check(components_getNumComponents(components) == 3, "three components");
+  check(components_getComponent(components, 0) == 0 && components_getComponent(components, 9) == 0
+        && components_getSize(components, 0) == 4, "room is component 0");
+  check(components_getComponent(components, 4) == 1 && components_getComponent(components, 11) == 1
+        && components_getComponent(components, 22) == 1 && components_getSize(components, 1) == 7,
+        "diagonal step joins component 1");
+  check(components_getComponent(components, 24) == 2 && components_getSize(components, 2) == 1,
+        "no step across the end of a row");
+  check(components_getComponent(components, 2) == -1 && components_getComponent(components, 7) == -1
+        && components_getComponent(components, mapLen) == -1
+        && components_getComponent(NULL, 0) == -1, "walls, newlines and off the map in none");
+  check(components_getLargest(components) == 1 && components_getSize(components, 3) == 0,
+        "largest component");
+  components_delete(components);
+
+  // random maps, numbered the same as a flood fill numbers them
+  const int cols = 61;
+  const int rows = 37;
+  const int len = rows * (cols + 1);
+  char* random = malloc(len + 1);
+  uint8_t* randomFlags = malloc(len + 1);
+  uint8_t* randomMoves = malloc(len + 1);
+  int* labels = malloc(len * sizeof(int));
+  srand(1);
+  bool same = true;
+  for (int round = 0; round < 20; round++) {
+    for (int pos = 0; pos < len; pos++) {
+      random[pos] = pos % (cols + 1) == cols ? '\n' : " .#-"[rand() % 4];
+    }
+    random[len] = '\0';
+    buildLayouts(random, len, cols, randomFlags, randomMoves);
+    floodLabels(randomMoves, randomFlags, len, cols, labels);
+    components = components_new(randomFlags, randomMoves, len, cols);
+    int total = 0;
+    for (int pos = 0; pos < len; pos++) {
+      same = same && components_getComponent(components, pos) == labels[pos];
+    }
+    for (int id = 0; id < components_getNumComponents(components); id++) {
+      total += components_getSize(components, id);
+    }
+    for (int pos = 0; pos < len; pos++) {
+      total -= labels[pos] >= 0;
+    }
+    same = same && components != NULL && total == 0;
+    components_delete(components);
+  }
+  check(same, "random maps match a flood fill");
+
+  free(random);
+  free(randomFlags);
+  free(randomMoves);
+  free(labels);
+  exit(unittest_finish("components"));
+}
+
+// fills in flags and move masks the way mapcache does
+static void
+buildLayouts(const char* map, int mapLen, int numColumns, uint8_t* flags, uint8_t* moves)
+{
+  for (int pos = 0; pos < mapLen; pos++) {
+    flags[pos] = tiles_class[(unsigned char)map[pos]];
+  }
+  for (int pos = 0; pos < mapLen; pos++) {
+    moves[pos] = 0;
+    for (int dir = 0; dir < NUM_DIRECTIONS && (flags[pos] & TILE_WALKABLE); dir++) {
+      const int next = pos + tiles_stepOffset(dir, numColumns);
+      if (next >= 0 && next < mapLen && (flags[next] & TILE_WALKABLE)) {
+        moves[pos] |= MOVE_BIT(dir);
+      }
+    }
+  }
+}
+
+// numbers the walkable areas by flooding out from the first tile of each
+static void
+floodLabels(const uint8_t* moves, const uint8_t* flags, int mapLen, int numColumns, int* labels)
+{
+  int* stack = malloc(mapLen * sizeof(int));
+  int numLabels = 0;
+  for (int pos = 0; pos < mapLen; pos++) {
+    labels[pos] = -1;
+  }
+  for (int start = 0; start < mapLen; start++) {
+    if ((flags[start] & TILE_WALKABLE) == 0 || labels[start] >= 0) {
+      continue;
+    }
+    int top = 0;
+    stack[top++] = start;
+    labels[start] = numLabels;
+    while (top > 0) {
+      const int pos = stack[--top];
+      for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+        const int next = pos + tiles_stepOffset(dir, numColumns);
+        if ((moves[pos] & MOVE_BIT(dir)) && labels[next] < 0) {
+          labels[next] = numLabels;
+          stack[top++] = next;
+        }
+      }
+    }
+    numLabels++;
+  }
+  free(stack);
+}
+#endif
@@ -0,0 +1,72 @@
+/*
+ * This file defines the "components" module for my rogue-like
+ * A "components" structure splits the walkable tiles of a map into
+ * connected components: areas a player can walk between, one step at a time
+ * in any of the eight directions, following the move masks of mapcache.h
+ * Every component gets an ID from 0 up, in the order of its first tile,
+ * along with its number of tiles
+ *
+ * Components are found with union-find, joining each walkable tile to the
+ * tiles it can step onto, so labelling a map takes time in proportion to
+ * its length. Once labelled, whether one tile can be reached from another
+ * is a comparison of their IDs, with no search of the map
+ *
+ * Positions are indices into the map string, laid out as in grid.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __COMPONENTS_H
+#define __COMPONENTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**************** global types ****************/
+typedef struct components components_t;  // opaque to users of the module
+
+/**************** functions **************/
+
+/**************** components_new ***************/
+/* labels the components of a map string of mapLen characters, with rows of
+ * numColumns characters each followed by a newline, given the class of every
+ * tile in flags (see tiles.h) and the move mask of every tile in moves
+ * (see mapcache_getMoves), mapLen of each
+ * allocates memory that must be free'd with components_delete
+ * returns NULL on bad params or failure to allocate memory
+ */
+components_t* components_new(const uint8_t* flags, const uint8_t* moves,
+                             int mapLen, int numColumns);
+
+/**************** components_getComponent ***************/
+/* returns the ID of the component holding pos,
+ * -1 if pos is not walkable, is out of range, or on bad params
+ */
+int components_getComponent(components_t* components, int pos);
+
+/**************** components_getNumComponents ***************/
+/* returns the number of components, 0 if there are none or on bad params */
+int components_getNumComponents(components_t* components);
+
+/**************** components_getSize ***************/
+/* returns the number of tiles in the given component,
+ * 0 if there is no such component or on bad params
+ */
+int components_getSize(components_t* components, int component);
+
+/**************** components_getLargest ***************/
+/* returns the ID of the component with the most tiles, the first of them
+ * if several are as large, -1 if there are none or on bad params
+ */
+int components_getLargest(components_t* components);
+
+/**************** components_getBytes ***************/
+/* returns the bytes the components hold, 0 if components is NULL */
+size_t components_getBytes(components_t* components);
+
+/**************** components_delete ***************/
+/* free's the components, does nothing if components is NULL */
+void components_delete(components_t* components);
+
+#endif
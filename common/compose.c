@@ -0,0 +1,354 @@
+/*
+ * This file implements the "compose" module for my rogue-like
+ * The "compose" module is defined in compose.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "compose.h"
+
+// the vector paths need GCC's target attributes and CPU checks, and x86
+#if !defined(COMPOSE_SCALAR) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COMPOSE_X86
+#include <immintrin.h>
+#endif
+
+/**************** file-local constants *******************/
+static const char BLANK = ' ';         // tiles never seen
+
+/**************** local functions ****************/
+static void composePlain(char* frame, const char* reference, const char* active,
+                         const uint64_t* visible, int from, int mapLen);
+#ifdef COMPOSE_X86
+static void composeSSE2(char* frame, const char* reference, const char* active,
+                        const uint64_t* visible, int mapLen);
+static void composeAVX2(char* frame, const char* reference, const char* active,
+                        const uint64_t* visible, int mapLen);
+#endif
+
+/**************** compose_frame ***************/
+/* see compose.h for details */
+void compose_frame(char* frame, const char* reference, const char* active,
+                   const uint64_t* visible, int mapLen)
+{
+  compose_frameWith(COMPOSE_BEST, frame, reference, active, visible, mapLen);
+}
+
+/**************** compose_frameWith ***************/
+/* see compose.h for details */
+bool compose_frameWith(composepath_t path, char* frame, const char* reference,
+                       const char* active, const uint64_t* visible, int mapLen)
+{
+  // check params
+  if (frame == NULL || reference == NULL || active == NULL || visible == NULL
+      || mapLen < 0 || ! compose_hasPath(path)) {
+    return false;
+  }
+  if (path == COMPOSE_BEST) {
+    path = compose_bestPath();
+  }
+
+  switch (path) {
+#ifdef COMPOSE_X86
+  case COMPOSE_AVX2:
+    composeAVX2(frame, reference, active, visible, mapLen);
+    break;
+  case COMPOSE_SSE2:
+    composeSSE2(frame, reference, active, visible, mapLen);
+    break;
+#endif
+  default:
+    composePlain(frame, reference, active, visible, 0, mapLen);
+    break;
+  }
+  return true;
+}
+
+/**************** compose_hasPath ***************/
+/* see compose.h for details */
+bool compose_hasPath(composepath_t path)
+{
+  switch (path) {
+  case COMPOSE_BEST:
+  case COMPOSE_PLAIN:
+    return true;
+#ifdef COMPOSE_X86
+  case COMPOSE_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case COMPOSE_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+/**************** compose_bestPath ***************/
+/* see compose.h for details */
+composepath_t compose_bestPath(void)
+{
+  if (compose_hasPath(COMPOSE_AVX2)) {
+    return COMPOSE_AVX2;
+  }
+  if (compose_hasPath(COMPOSE_SSE2)) {
+    return COMPOSE_SSE2;
+  }
+  return COMPOSE_PLAIN;
+}
+
+/**************** compose_pathName ***************/
+/* see compose.h for details */
+const char* compose_pathName(composepath_t path)
+{
+  switch (path) {
+  case COMPOSE_BEST:   return "best";
+  case COMPOSE_PLAIN:  return "plain";
+  case COMPOSE_SSE2:   return "sse2";
+  case COMPOSE_AVX2:   return "avx2";
+  default:             return "unknown";
+  }
+}
+
+/**************** composePlain ***************/
+/* composes positions [from, mapLen) one at a time, as a select per tile
+ * the vector paths finish off their last few positions with it
+ */
+static void composePlain(char* frame, const char* reference, const char* active,
+                         const uint64_t* visible, int from, int mapLen)
+{
+  char* restrict out = frame;
+  const char* restrict ref = reference;
+  const char* restrict act = active;
+
+  for (int i = from; i < mapLen; i++) {
+    const bool seen = (visible[i / 64] >> (i % 64)) & 1;
+    const char remembered = (out[i] != BLANK) ? ref[i] : BLANK;
+    out[i] = seen ? act[i] : remembered;
+  }
+}
+
+#ifdef COMPOSE_X86
+/**************** composeSSE2 ***************/
+/* composes 16 positions at a time, each taking 16 bits of the visible set
+ * the bits are spread to one byte each, 0xFF if visible and 0 if not,
+ * and used to pick between the active map and the remembered tile
+ */
+__attribute__((target("sse2")))
+static void composeSSE2(char* frame, const char* reference, const char* active,
+                        const uint64_t* visible, int mapLen)
+{
+  const __m128i blank = _mm_set1_epi8(BLANK);
+  // byte j tests bit j % 8 of its byte of the mask
+  const __m128i select = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                       1, 2, 4, 8, 16, 32, 64, -128);
+  int i = 0;
+
+  for (; i + 16 <= mapLen; i += 16) {
+    const unsigned bits = (visible[i / 64] >> (i % 64)) & 0xFFFF;
+    // bytes 0-7 hold the low 8 bits, bytes 8-15 the high 8 bits
+    const __m128i spread = _mm_unpacklo_epi64(_mm_set1_epi8((char)(bits & 0xFF)),
+                                              _mm_set1_epi8((char)(bits >> 8)));
+    const __m128i seen = _mm_cmpeq_epi8(_mm_and_si128(spread, select), select);
+
+    const __m128i prev = _mm_loadu_si128((const __m128i*)(frame + i));
+    const __m128i ref = _mm_loadu_si128((const __m128i*)(reference + i));
+    const __m128i act = _mm_loadu_si128((const __m128i*)(active + i));
+
+    // blank stays blank, anything else reverts to the reference map
+    const __m128i wasBlank = _mm_cmpeq_epi8(prev, blank);
+    const __m128i remembered = _mm_or_si128(_mm_and_si128(wasBlank, blank),
+                                            _mm_andnot_si128(wasBlank, ref));
+    const __m128i next = _mm_or_si128(_mm_and_si128(seen, act),
+                                      _mm_andnot_si128(seen, remembered));
+    _mm_storeu_si128((__m128i*)(frame + i), next);
+  }
+
+  composePlain(frame, reference, active, visible, i, mapLen);
+}
+
+/**************** composeAVX2 ***************/
+/* composes 32 positions at a time, each taking 32 bits of the visible set
+ * the same as composeSSE2, but the bits are spread with a byte shuffle
+ */
+__attribute__((target("avx2")))
+static void composeAVX2(char* frame, const char* reference, const char* active,
+                        const uint64_t* visible, int mapLen)
+{
+  const __m256i blank = _mm256_set1_epi8(BLANK);
+  // the shuffle works within each 16-byte half, and every half holds the
+  // 4 mask bytes, so bytes 0-7 take mask byte 0, ... bytes 24-31 mask byte 3
+  const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0,
+                                          1, 1, 1, 1, 1, 1, 1, 1,
+                                          2, 2, 2, 2, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i select = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128);
+  int i = 0;
+
+  for (; i + 32 <= mapLen; i += 32) {
+    const uint32_t bits = (uint32_t)(visible[i / 64] >> (i % 64));
+    const __m256i mask = _mm256_shuffle_epi8(_mm256_set1_epi32((int)bits), spread);
+    const __m256i seen = _mm256_cmpeq_epi8(_mm256_and_si256(mask, select), select);
+
+    const __m256i prev = _mm256_loadu_si256((const __m256i*)(frame + i));
+    const __m256i ref = _mm256_loadu_si256((const __m256i*)(reference + i));
+    const __m256i act = _mm256_loadu_si256((const __m256i*)(active + i));
+
+    const __m256i wasBlank = _mm256_cmpeq_epi8(prev, blank);
+    const __m256i remembered = _mm256_blendv_epi8(ref, blank, wasBlank);
+    const __m256i next = _mm256_blendv_epi8(remembered, act, seen);
+    _mm256_storeu_si256((__m256i*)(frame + i), next);
+  }
+
+  composePlain(frame, reference, active, visible, i, mapLen);
+}
+#endif
+
+#ifdef COMPOSETEST
+#include <string.h>
+#include <time.h>
+
+static int checkPath(composepath_t path, int mapLen);
+static void randomMap(char* map, int mapLen, const char* tiles);
+
+// composes random frames with every path this CPU has, and compares
+// each against a tile-by-tile copy of the rule in compose.h
+// usage: composetest
+int
+main(void)
+{
+  // lengths around every vector width, and a map-sized one
+  const int lengths[] = { 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 2000, 4096 + 29 };
+  const int numLengths = sizeof(lengths) / sizeof(lengths[0]);
+  const composepath_t paths[] = { COMPOSE_PLAIN, COMPOSE_SSE2, COMPOSE_AVX2, COMPOSE_BEST };
+  int failures = 0;
+
+  srand(1);
+  fprintf(stdout, "best path here: %s\n", compose_pathName(compose_bestPath()));
+  for (int p = 0; p < 4; p++) {
+    if (! compose_hasPath(paths[p])) {
+      fprintf(stdout, "%s: not available, skipped\n", compose_pathName(paths[p]));
+      continue;
+    }
+    int mismatches = 0;
+    for (int l = 0; l < numLengths; l++) {
+      mismatches += checkPath(paths[p], lengths[l]);
+    }
+    fprintf(stdout, "%s: %d mismatches\n", compose_pathName(paths[p]), mismatches);
+    failures += mismatches;
+  }
+
+  // bad params are refused
+  char tile = 'x';
+  uint64_t word = 0;
+  if (compose_frameWith(COMPOSE_PLAIN, NULL, &tile, &tile, &word, 1)
+      || compose_frameWith(COMPOSE_PLAIN, &tile, &tile, &tile, NULL, 1)
+      || compose_frameWith(COMPOSE_PLAIN, &tile, &tile, &tile, &word, -1)) {
+    fprintf(stdout, "bad params accepted\n");
+    failures++;
+  }
+
+  // time each path on a big frame
+  const int bigLen = 1 << 20;
+  const int reps = 50;
+  char* reference = malloc(bigLen);
+  char* active = malloc(bigLen);
+  char* frame = malloc(bigLen);
+  uint64_t* visible = calloc((bigLen + 63) / 64, sizeof(uint64_t));
+  if (reference == NULL || active == NULL || frame == NULL || visible == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  randomMap(reference, bigLen, " .#-|+");
+  randomMap(active, bigLen, " .#-|+*@A");
+  for (int w = 0; w < (bigLen + 63) / 64; w++) {
+    visible[w] = ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+  }
+  for (int p = 0; p < 3; p++) {
+    if (! compose_hasPath(paths[p])) {
+      continue;
+    }
+    randomMap(frame, bigLen, " .");
+    struct timespec start, end;
+    timespec_get(&start, TIME_UTC);
+    for (int r = 0; r < reps; r++) {
+      compose_frameWith(paths[p], frame, reference, active, visible, bigLen);
+    }
+    timespec_get(&end, TIME_UTC);
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    fprintf(stdout, "%s: %.3f ns per tile\n", compose_pathName(paths[p]),
+            ns / ((double)bigLen * reps));
+  }
+  free(reference);
+  free(active);
+  free(frame);
+  free(visible);
+
+  fprintf(stdout, failures == 0 ? "compose test passed\n" : "compose test FAILED\n");
+  exit(failures == 0 ? 0 : 1);
+}
+
+// composes one random frame of the given length with path, and returns
+// the number of positions that differ from the rule
+static int
+checkPath(composepath_t path, int mapLen)
+{
+  char* reference = malloc(mapLen);
+  char* active = malloc(mapLen);
+  char* frame = malloc(mapLen + 1);
+  char* expected = malloc(mapLen);
+  uint64_t* visible = calloc((mapLen + 63) / 64, sizeof(uint64_t));
+  if (reference == NULL || active == NULL || frame == NULL || expected == NULL
+      || visible == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+
+  randomMap(reference, mapLen, " .#-|+");
+  randomMap(active, mapLen, " .#-|+*@A");
+  randomMap(frame, mapLen, " .#*");
+  frame[mapLen] = '!';                 // must not be touched
+  for (int i = 0; i < mapLen; i++) {
+    if (rand() % 2) {
+      visible[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+  }
+
+  for (int i = 0; i < mapLen; i++) {
+    if ((visible[i / 64] >> (i % 64)) & 1) {
+      expected[i] = active[i];
+    } else {
+      expected[i] = frame[i] == ' ' ? ' ' : reference[i];
+    }
+  }
+
+  compose_frameWith(path, frame, reference, active, visible, mapLen);
+  int mismatches = frame[mapLen] != '!';
+  for (int i = 0; i < mapLen; i++) {
+    mismatches += frame[i] != expected[i];
+  }
+
+  free(reference);
+  free(active);
+  free(frame);
+  free(expected);
+  free(visible);
+  return mismatches;
+}
+
+// fills map with random characters from tiles
+static void
+randomMap(char* map, int mapLen, const char* tiles)
+{
+  int numTiles = strlen(tiles);
+  for (int i = 0; i < mapLen; i++) {
+    map[i] = tiles[rand() % numTiles];
+  }
+}
+#endif
@@ -0,0 +1,70 @@
+/*
+ * This file defines the "compose" module for my rogue-like
+ * It writes a player's frame, the map as that player sees it, in one pass
+ * over the map string:
+ *   - tiles in the visible set show the server's active map
+ *   - tiles seen before, i.e. not blank in the previous frame, show the reference map
+ *   - every other tile stays blank
+ * This is the rule player_updateVision applies, without a call per tile
+ *
+ * On x86 the pass is done 32 tiles at a time with AVX2, or 16 at a time with
+ * SSE2, when the CPU running the program has them. The CPU is checked at
+ * run time, so one build runs anywhere. Elsewhere, or if built with
+ * -DCOMPOSE_SCALAR, only the plain C loop is compiled in
+ * Every path writes exactly the same frame
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __COMPOSE_H
+#define __COMPOSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**************** global types ****************/
+/* the ways compose_frameWith can write a frame */
+typedef enum composepath {
+  COMPOSE_BEST,              // the fastest path this CPU supports
+  COMPOSE_PLAIN,             // plain C, one tile at a time
+  COMPOSE_SSE2,              // 16 tiles at a time, on x86 CPUs with SSE2
+  COMPOSE_AVX2               // 32 tiles at a time, on x86 CPUs with AVX2
+} composepath_t;
+
+/**************** functions **************/
+
+/**************** compose_frame ***************/
+/* rewrites frame, the previous frame of a player, as the new one
+ * using the fastest path this CPU supports. All strings hold mapLen chars,
+ * and visible is a set laid out like bitset_getWords, one bit per position
+ * Parameters:  frame - the player's previous frame, overwritten with the new one
+ *              reference - the reference map
+ *              active - the server's active map
+ *              visible - bit i is set if position i is visible
+ *              mapLen - number of positions
+ * Returns:     void, does nothing on bad params
+ */
+void compose_frame(char* frame, const char* reference, const char* active,
+                   const uint64_t* visible, int mapLen);
+
+/**************** compose_frameWith ***************/
+/* the same as compose_frame, but using the given path
+ * returns false (and leaves frame alone) if this CPU or build doesn't have
+ * the path, or on bad params. Mostly useful to test and time the paths
+ */
+bool compose_frameWith(composepath_t path, char* frame, const char* reference,
+                       const char* active, const uint64_t* visible, int mapLen);
+
+/**************** compose_hasPath ***************/
+/* returns true if compose_frameWith can use the given path here */
+bool compose_hasPath(composepath_t path);
+
+/**************** compose_bestPath ***************/
+/* returns the path compose_frame uses here, never COMPOSE_BEST */
+composepath_t compose_bestPath(void);
+
+/**************** compose_pathName ***************/
+/* returns a printable name for the given path, e.g. "avx2" */
+const char* compose_pathName(composepath_t path);
+
+#endif
@@ -13,6 +13,7 @@
 #include "grid.h"
 #include "hashtable.h"
 #include "player.h"
+#include "goldstore.h"
 #include "log.h"
 
 // file-local constants (consistent with those in server)
@@ -31,10 +32,9 @@ static void game_summaryHelper(void *arg, const char *key, void *item);
 
 typedef struct game
 {
-  int *piles;           // ptr to array of piles
+  goldstore_t *gold;    // gold piles, by position
   hashtable_t *players; // hashtable of player IDs
   int remainingGold;    // gold left in the game
-  int numPiles;         // number of gold piles in game
   grid_t *grid;         // current game grid
   int lastCharID;       // most recent 'player.charID'
   int numPlayers;       // number of players in a game
@@ -52,14 +52,9 @@ char *game_getMapfile(game_t *game)
   return game ? game->mapfile : NULL;
 }
 
-int *game_getPiles(game_t *game)
+goldstore_t *game_getGold(game_t *game)
 {
-  return game ? game->piles : NULL;
-}
-
-int game_getNumPiles(game_t *game)
-{
-  return game ? game->numPiles : -1;
+  return game ? game->gold : NULL;
 }
 
 hashtable_t *game_getPlayers(game_t *game)
@@ -110,18 +105,6 @@ bool game_setRemainingGold(game_t *game, int gold)
   }
 }
 
-/**************** game_setNumPiles ******************/
-/* see header file for details */
-int game_setNumPiles(game_t *game, int numPiles)
-{
-  if (game == NULL)
-  {
-    return -1;
-  }
-  game->numPiles = numPiles;
-  return game->numPiles;
-}
-
 /******************* game_setGrid *******************/
 /* see game.h for details */
 bool game_setGrid(game_t *game, grid_t *grid)
@@ -169,7 +152,7 @@ int game_setNumPlayers(game_t *game, int numPlayers)
 /**************** game_new ***************/
 /* see game.h or details */
 game_t *
-game_new(int *piles, grid_t *grid)
+game_new(goldstore_t *gold, grid_t *grid)
 {
   hashtable_t *players;         // stores players
   const int defaultCharID = 64; // ASCII for '@', 1st player gets default + 1
@@ -193,8 +176,7 @@ game_new(int *piles, grid_t *grid)
   game->players = players;
   game->numPlayers = 0;
   game->lastCharID = defaultCharID;
-  game->piles = piles;
-  game->numPiles = -1;
+  game->gold = gold;
   game->remainingGold = MAXGOLD;
   game->grid = grid;
   game->mapfile = grid_getMapfile(grid);
@@ -376,8 +358,8 @@ void game_delete(game_t *game)
 {
   if (game != NULL)
   {
-    // piles is a malloc'd int array
-    free(game->piles);
+    // the gold store ignores NULL
+    goldstore_delete(game->gold);
     // delete all players in game
     if (game->players != NULL)
     {
@@ -11,6 +11,7 @@
 #include "grid.h"
 #include "hashtable.h"
 #include "player.h"
+#include "goldstore.h"
 
 /**************** global types ****************/
 typedef struct game game_t; // opaque to users of the module
@@ -19,13 +20,12 @@ typedef struct game game_t; // opaque to users of the module
 
 /**************** getters **************/
 grid_t *game_getGrid(game_t *game);
-int *game_getPiles(game_t *game);
+goldstore_t *game_getGold(game_t *game);
 hashtable_t *game_getPlayers(game_t *game);
 int game_getRemainingGold(game_t *game);
 int game_getLastCharID(game_t *game);
 int game_getNumPlayers(game_t *game);
 char *game_getMapfile(game_t *game);
-int game_getNumPiles(game_t *game);
 
 /* finds the player in the game with the given address
  * returns NULL if player not found or bad parameters
@@ -53,20 +53,16 @@ int game_setLastCharID(game_t *game, int charID);
  * */
 int game_setNumPlayers(game_t *game, int numPlayers);
 
-/* sets the number of gold piles in a game
- * returns the new number
- */
-int game_setNumPiles(game_t *game, int numPiles);
-
 /**************** game_new *****************/
 /* The game_new function allocates space for a new 'struct game'
  * it only malloc's space for itself. All other memory must be allocated before
  * for example, a `game` takes non-null `grids` as parameters
  * so grid_new must be called on a grid before passing it to `game`
- * All memory allocated by the game, its grid, and its int array
+ * gold is the store of the gold piles on the grid, see goldstore.h
+ * All memory allocated by the game, its grid, and its gold store
  * are freed in game_delete
  */
-game_t *game_new(int *piles, grid_t *grid);
+game_t *game_new(goldstore_t *gold, grid_t *grid);
 
 /*************** game_addPlayer **************/
 /* adds a struct player to the hashtable of players within a given game struct
@@ -100,7 +96,7 @@ int game_subtractGold(game_t *game, int gold);
 
 /************** game_delete ****************/
 /* free's all memory assosciated with a `game`
- * sets the int array of gold piles to NULL
+ * calls goldstore_delete on the store of gold piles
  * calls hashtable_delete on the table of players
  * calls grid_delete on the grid
  * then free's the game itself
@@ -0,0 +1,235 @@
+/*
+ * This file implements the "goldstore" module for my rogue-like
+ * The "goldstore" module is defined in goldstore.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "goldstore.h"
+#include "mem.h"
+
+/**************** file-local constants *******************/
+static const int FIRSTPILES = 32;      // room for piles before growing
+
+/**************** local types ****************/
+/* one pile of gold */
+typedef struct goldpile {
+  int pos;                             // tile the pile lies on
+  int value;                           // gold in the pile
+} goldpile_t;
+
+/**************** global types ****************/
+typedef struct goldstore {
+  goldpile_t* piles;                   // every pile, in no particular order
+  int numPiles;                        // number of piles in piles
+  int maxPiles;                        // room in piles before it grows
+  int* slots;                          // slot in piles of each tile's pile, -1 if none
+  int mapLen;                          // number of tiles, and of slots
+  int total;                           // gold in all the piles
+} goldstore_t;
+
+/**************** goldstore_new ***************/
+/* see goldstore.h for details */
+goldstore_t* goldstore_new(int mapLen)
+{
+  goldstore_t* store = NULL;           // store to return
+
+  // check params
+  if (mapLen < 1) {
+    return NULL;
+  }
+  if ((store = mem_malloc(sizeof(goldstore_t))) == NULL) {
+    return NULL;
+  }
+  store->piles = mem_malloc(FIRSTPILES * sizeof(goldpile_t));
+  store->slots = mem_malloc(mapLen * sizeof(int));
+  if (store->piles == NULL || store->slots == NULL) {
+    goldstore_delete(store);
+    return NULL;
+  }
+  for (int pos = 0; pos < mapLen; pos++) {
+    store->slots[pos] = -1;
+  }
+  store->numPiles = 0;
+  store->maxPiles = FIRSTPILES;
+  store->mapLen = mapLen;
+  store->total = 0;
+  return store;
+}
+
+/**************** goldstore_add ***************/
+/* see goldstore.h for details */
+bool goldstore_add(goldstore_t* store, int pos, int value)
+{
+  // check params
+  if (store == NULL || pos < 0 || pos >= store->mapLen || value < 1) {
+    return false;
+  }
+
+  // gold dropped on a pile joins it
+  if (store->slots[pos] >= 0) {
+    store->piles[store->slots[pos]].value += value;
+    store->total += value;
+    return true;
+  }
+
+  // otherwise start a new pile, with room for twice as many if full
+  if (store->numPiles == store->maxPiles) {
+    goldpile_t* grown = mem_malloc(2 * store->maxPiles * sizeof(goldpile_t));
+    if (grown == NULL) {
+      return false;
+    }
+    memcpy(grown, store->piles, store->numPiles * sizeof(goldpile_t));
+    mem_free(store->piles);
+    store->piles = grown;
+    store->maxPiles *= 2;
+  }
+  store->piles[store->numPiles].pos = pos;
+  store->piles[store->numPiles].value = value;
+  store->slots[pos] = store->numPiles++;
+  store->total += value;
+  return true;
+}
+
+/**************** goldstore_get ***************/
+/* see goldstore.h for details */
+int goldstore_get(goldstore_t* store, int pos)
+{
+  if (store == NULL || pos < 0 || pos >= store->mapLen || store->slots[pos] < 0) {
+    return 0;
+  }
+  return store->piles[store->slots[pos]].value;
+}
+
+/**************** goldstore_take ***************/
+/* see goldstore.h for details */
+int goldstore_take(goldstore_t* store, int pos)
+{
+  if (store == NULL || pos < 0 || pos >= store->mapLen || store->slots[pos] < 0) {
+    return 0;
+  }
+  const int slot = store->slots[pos];
+  const int value = store->piles[slot].value;
+
+  // the last pile fills the slot, so the piles stay dense
+  const goldpile_t last = store->piles[--store->numPiles];
+  store->piles[slot] = last;
+  store->slots[last.pos] = slot;
+  store->slots[pos] = -1;
+  store->total -= value;
+  return value;
+}
+
+/**************** goldstore_getNumPiles ***************/
+/* see goldstore.h for details */
+int goldstore_getNumPiles(goldstore_t* store)
+{
+  return store ? store->numPiles : 0;
+}
+
+/**************** goldstore_getTotal ***************/
+/* see goldstore.h for details */
+int goldstore_getTotal(goldstore_t* store)
+{
+  return store ? store->total : 0;
+}
+
+/**************** goldstore_iterate ***************/
+/* see goldstore.h for details */
+void goldstore_iterate(goldstore_t* store, void* arg,
+                       void (*itemfunc)(void* arg, int pos, int value))
+{
+  if (store == NULL || itemfunc == NULL) {
+    return;
+  }
+  for (int i = 0; i < store->numPiles; i++) {
+    (*itemfunc)(arg, store->piles[i].pos, store->piles[i].value);
+  }
+}
+
+/**************** goldstore_delete ***************/
+/* see goldstore.h for details */
+void goldstore_delete(goldstore_t* store)
+{
+  if (store == NULL) {
+    return;
+  }
+  if (store->piles != NULL) {
+    mem_free(store->piles);
+  }
+  if (store->slots != NULL) {
+    mem_free(store->slots);
+  }
+  mem_free(store);
+}
+
+#ifdef GOLDSTORETEST
+#include "unittest.h"
+
+static void sumPiles(void* arg, int pos, int value);
+
+// adds and takes piles, checking each against a plain array of every tile
+// usage: goldstoretest
+int
+main(int argc, char* argv[])
+{
+  const int mapLen = 5000;
+  int* expected = calloc(mapLen, sizeof(int));   // gold on each tile
+  goldstore_t* store = goldstore_new(mapLen);
+  check(store != NULL && expected != NULL, "store created");
+  check(goldstore_new(0) == NULL, "empty map");
+  check( ! goldstore_add(store, -1, 5) && ! goldstore_add(store, mapLen, 5)
+         && ! goldstore_add(store, 0, 0), "bad piles refused");
+
+  // far more piles than a game ever had, added to and taken at random
+  srand(1);
+  int total = 0;
+  int numPiles = 0;
+  for (int i = 0; i < 100000; i++) {
+    int pos = rand() % mapLen;
+    if (rand() % 3 != 0) {
+      int value = 1 + rand() % 50;
+      numPiles += expected[pos] == 0;
+      expected[pos] += value;
+      total += value;
+      goldstore_add(store, pos, value);
+    } else {
+      numPiles -= expected[pos] != 0;
+      total -= expected[pos];
+      if (goldstore_take(store, pos) != expected[pos]) {
+        check(false, "take returns the pile");
+      }
+      expected[pos] = 0;
+    }
+  }
+  bool same = true;
+  for (int pos = 0; pos < mapLen; pos++) {
+    same = same && goldstore_get(store, pos) == expected[pos];
+  }
+  check(same, "every pile where it was put");
+  check(goldstore_getNumPiles(store) == numPiles, "number of piles");
+  check(goldstore_getTotal(store) == total, "total gold");
+
+  int sums[2] = { 0, 0 };              // gold, and piles, seen by iterate
+  goldstore_iterate(store, sums, sumPiles);
+  check(sums[0] == total && sums[1] == numPiles, "iterate visits every pile once");
+
+  goldstore_delete(store);
+  free(expected);
+  exit(unittest_finish("goldstore"));
+}
+
+
+// adds the pile to the gold and piles counted in arg
+static void
+sumPiles(void* arg, int pos, int value)
+{
+  int* sums = arg;
+  sums[0] += value;
+  sums[1]++;
+}
+#endif
@@ -0,0 +1,70 @@
+/*
+ * This file defines the "goldstore" module for my rogue-like
+ * A "goldstore" holds the piles of gold on a map, each keyed by the
+ * position of the tile it lies on, so the gold a player picks up is the
+ * pile on the tile they stepped onto
+ *
+ * The piles are kept in a dense array, and every tile knows the slot of
+ * its pile in that array, or that it has none. Finding or taking the pile
+ * on a tile is then a lookup, taking one moves the last pile into its slot,
+ * and going over every pile only visits the piles themselves
+ * There is no limit on the number of piles other than the number of tiles
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __GOLDSTORE_H
+#define __GOLDSTORE_H
+
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct goldstore goldstore_t;  // opaque to users of the module
+
+/**************** functions **************/
+
+/**************** goldstore_new ***************/
+/* returns a new, empty goldstore for a map of mapLen tiles
+ * which must later be free'd with goldstore_delete
+ * returns NULL if mapLen < 1, or failure to allocate memory
+ */
+goldstore_t* goldstore_new(int mapLen);
+
+/**************** goldstore_add ***************/
+/* adds value gold to the pile at pos, starting a new pile if there is none
+ * returns true on success, false on bad params (value must be positive)
+ * or failure to allocate memory
+ */
+bool goldstore_add(goldstore_t* store, int pos, int value);
+
+/**************** goldstore_get ***************/
+/* returns the gold in the pile at pos, 0 if there is none or on bad params */
+int goldstore_get(goldstore_t* store, int pos);
+
+/**************** goldstore_take ***************/
+/* removes the pile at pos from the store
+ * returns the gold it held, 0 if there is none or on bad params
+ */
+int goldstore_take(goldstore_t* store, int pos);
+
+/**************** goldstore_getNumPiles ***************/
+/* returns the number of piles in the store, 0 on bad params */
+int goldstore_getNumPiles(goldstore_t* store);
+
+/**************** goldstore_getTotal ***************/
+/* returns the gold in all the piles of the store, 0 on bad params */
+int goldstore_getTotal(goldstore_t* store);
+
+/**************** goldstore_iterate ***************/
+/* calls itemfunc(arg, pos, value) on every pile in the store,
+ * in no particular order. itemfunc must not add or take piles
+ * does nothing if store or itemfunc is NULL
+ */
+void goldstore_iterate(goldstore_t* store, void* arg,
+                       void (*itemfunc)(void* arg, int pos, int value));
+
+/**************** goldstore_delete ***************/
+/* free's the store and all its piles, does nothing if store is NULL */
+void goldstore_delete(goldstore_t* store);
+
+#endif
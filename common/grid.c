@@ -12,26 +12,120 @@
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "grid.h"
 #include "mem.h"
 #include "file.h"
+#include "vistable.h"
+#include "viscache.h"
+#include "bitset.h"
+#include "rooms.h"
+#include "components.h"
+#include "mapcache.h"
+#include "tiles.h"
+#include "chunkmap.h"
+#include "visdeps.h"
 
 /**************** file-local constants *******************/
 const char ROOMTILE = '.';
+static const int FIRSTSTALE = 16;      // room for stale tiles before growing
+static const int RUNMAX = UINT8_MAX;   // longest run a table entry holds, see grid_getRunLength
+static const int FIRSTDROPPED = 16;    // room for dropped viewpoints before growing
 /**************** file-local global variables ****************/
-/* none */
+/* where grid_getActive puts a chunked grid's active map together, one per
+ * thread, and grown to the longest map asked for; see buildFrame
+ */
+static _Thread_local char* frame = NULL;
+static _Thread_local size_t frameSize = 0;
+/* tiles calculateVisionRaycast found hidden behind a wall, a bit per tile,
+ * one set per thread, grown to the longest map asked for and left empty
+ */
+static _Thread_local uint64_t* rayBlocked = NULL;
+static _Thread_local size_t rayBlockedWords = 0;
+#define BLOCKED(words, i) (((words)[(i) / 64] >> ((i) % 64)) & 1)
+#define SET_BLOCKED(words, i) ((words)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+/* the benchmark counts every tile the vision engine looks at, see grid.h */
+#ifdef VISIONBENCH
+static unsigned long tilesVisited = 0;
+#define VISIT() (tilesVisited++)
+#else
+#define VISIT()
+#endif
 
 /**************** local types ****************/
-/* none */
+/* one quadrant of a shadowcasting pass, see calculateVisionShadowcast */
+typedef struct shadowscan {
+  const char* padded;                  // the grid's padded map, see mapcache.h
+  int paddedShift;                     // log2 of the padded map's stride
+  int stride;                          // distance between rows of the map string
+  bitset_t* visible;                   // set of visible tiles being filled in
+  int origin;                          // padded index of the viewer
+  int depthStep;                       // padded offset of one row further out
+  int colStep;                         // padded offset of one column along a row
+  int maxDepth;                        // last row to scan, 0 to scan them all
+} shadowscan_t;
+
+/* cache entries being recorded in an index, see trackVision */
+typedef struct trackstate {
+  visdeps_t* deps;                     // index to record them in
+  bool tracked;                        // false once one fails to be recorded
+} trackstate_t;
 
 /**************** global types ****************/
 typedef struct grid {
-  char* reference;                     // original map file read into a string
-  char* active;                        // map string that changes during game
+  mapdata_t* map;                      // shared map read from the map file
+  char* reference;                     // the map's string, shared until the terrain changes
+  char* active;                        // map string that changes during game, NULL if chunked
+  chunkmap_t* chunks;                  // active map of a chunked grid, NULL if not
+  char blank;                          // tile a chunked grid shows where nothing is written
+  char* items;                         // item on each tile, '\0' if none, NULL until one is placed
+  char* entities;                      // entity on each tile, '\0' if none, NULL until one is placed
+  int* stale;                          // tiles placed on since active was composed
+  int numStale;                        // number of positions in stale
+  int maxStale;                        // room in stale before it grows
   size_t mapLen;                       // length of map string
   int numColumns;                      // number of rows in the map
   int numRows;                         // number of columns in the map
-  char* mapfile;                       // filepath of in-game grid
+  const uint8_t* flags;                // class of every reference tile, see tiles.h
+  const uint8_t* moves;                // move mask of every tile, shared like flags
+  int stepOffsets[NUM_DIRECTIONS];     // how far a step in each direction goes
+  int* emptyTiles;                     // every empty room tile, NULL if not indexed
+  int* emptyIndex;                     // where each tile is in emptyTiles, -1 if not there
+  int numEmpty;                        // number of tiles in emptyTiles
+  int numEmptyMain;                    // how many of them, at the front, lie in
+                                       // the largest component (the main area)
+  uint8_t* runs;                       // run length from every tile in each direction,
+                                       // direction by direction, NULL if unused
+  const char* padded;                  // the map with a border, shared like reference
+  int paddedStride;                    // distance between rows of padded, a power of 2
+  int paddedShift;                     // log2 of paddedStride
+  vistable_t* visTable;                // precomputed vision, NULL if unused
+  const int* mapVisIndex;              // vision compiled with the map, see
+  const int* mapVisData;               // mapcache_getVision, both NULL if none
+  int mapVisionMode;                   // mode it was compiled with, -1 if none
+  bool visTableLazy;                   // true if visTable fills on first use
+  viscache_t* visCache;                // recently used vision, NULL if unused
+  visionmode_t visionMode;             // algorithm used to calculate vision
+  int lightRadius;                     // how far light reaches, 0 if unlimited
+  int* changes;                        // active positions changed, NULL if untracked
+  int numChanges;                      // number of positions in changes
+  int maxChanges;                      // room in changes before it overflows
+  bool changesOverflow;                // true if more changes than room to log them
+  rooms_t* rooms;                      // rooms of the reference map, NULL if unknown
+  bool ownRooms;                       // true if rooms is this grid's own copy
+  components_t* components;            // walkable components of the reference map,
+                                       // NULL if unknown
+  bool ownComponents;                  // true if components are this grid's own
+  bool ownTerrain;                     // true if reference, flags, moves and padded
+                                       // are this grid's own copies, see grid_setTerrain
+  visdeps_t* visDeps;                  // what stored vision each tile affects, NULL
+                                       // until the terrain first changes
+  bitset_t* mapVisStale;               // viewpoints whose compiled vision no longer
+                                       // holds, NULL if none or not compiled
+  int* dropped;                        // viewpoints dropped by a terrain change,
+  int numDropped;                      // to fill again in an eager table
+  int maxDropped;                      // room in dropped before it grows
+  pthread_mutex_t visionLock;          // lets threads share grid_calculateVision
 } grid_t;
 
 /**************** global functions ****************/
@@ -40,9 +134,54 @@ typedef struct grid {
 
 /**************** local functions ****************/
 /* not visible outside this file */
-static int longestRowLength(char* map);
 static void posToCoordinates(grid_t* grid, int pos, int* tuple);
 static int coordinatesToPos(grid_t* grid, int x, int y);
+static grid_t* newGrid(char* mapFile, bool chunked, char blank);
+static char activeTile(grid_t* grid, int pos);
+static char blankTile(grid_t* grid, int pos);
+static bool setActiveTile(grid_t* grid, int pos, char tile);
+static char* buildFrame(grid_t* grid);
+static void recordChange(grid_t* grid, int pos, char newChar);
+static char composeTile(grid_t* grid, int pos);
+static void composeStale(grid_t* grid);
+static bool markStale(grid_t* grid, int pos);
+static char* ensurePlane(grid_t* grid, char** plane);
+static bool isOpen(grid_t* grid, int pos);
+static int runFrom(grid_t* grid, int dir, int pos);
+static void updateRuns(grid_t* grid, int pos);
+static void updateEmpty(grid_t* grid, int pos);
+static bool inMainArea(grid_t* grid, int pos);
+static void swapEmpty(grid_t* grid, int i, int j);
+static void partitionEmpty(grid_t* grid);
+static bool usesMapVision(grid_t* grid);
+static bool fillVisionEntry(grid_t* grid, int pos, bitset_t* visible);
+static void copyVisionEntry(const int* tiles, int count, bitset_t* visible);
+static bool resetStoredVision(grid_t* grid);
+static bool mapVisionHolds(grid_t* grid, int pos);
+static uint8_t moveMask(grid_t* grid, int pos);
+static void writeTerrain(grid_t* grid, int pos, char tile);
+static bool takeTerrain(grid_t* grid);
+static bool trackVision(grid_t* grid);
+static void abandonMapVision(grid_t* grid);
+static void trackCached(void* arg, int pos, const int* tiles, int count);
+static void dropVision(void* arg, int pos);
+static void dropRoomVision(grid_t* grid, int pos);
+static void refillVision(grid_t* grid);
+static bool rebuildRooms(grid_t* grid);
+static void calculateVisionEngine(grid_t* grid, int pos, bitset_t* visible);
+static bool calculateVisionRoom(grid_t* grid, int pos, bitset_t* visible);
+static int litRoomReach(grid_t* grid, int pos, int room);
+static void clipToLight(grid_t* grid, int pos, int room, bitset_t* visible);
+static bool inRoomOrRing(grid_t* grid, int room, int pos);
+static void calculateVisionRaycast(grid_t* grid, int pos, bitset_t* visible, int reach);
+static bool raycastStraight(const uint8_t* flags, int pos, bool wallFound,
+                            bitset_t* visible, uint64_t* blocked);
+static void calculateVisionRaycastLegacy(grid_t* grid, int pos, bitset_t* visible);
+static void calculateVisionShadowcast(grid_t* grid, int pos, bitset_t* visible, int reach);
+static void shadowcastRow(shadowscan_t* scan, int depth, int startNum, 
+                          int startDen, int endNum, int endDen);
+static int paddedToPos(shadowscan_t* scan, int index);
+static int floorDiv(int num, int den);
 
 /**************** getters *****************/
 /* returns NULL or 0 if values don't exist as appropriate */
@@ -53,12 +192,16 @@ char* grid_getReference(grid_t* grid)
 
 char* grid_getMapfile(grid_t* grid)
 {
-  return grid ? grid->mapfile : NULL;
+  return grid ? (char*)mapcache_getMapfile(grid->map) : NULL;
 }
 
 char* grid_getActive(grid_t* grid)
 {
-  return grid ? grid->active : NULL;
+  if (grid == NULL) {
+    return NULL;
+  }
+  composeStale(grid);
+  return grid->chunks ? buildFrame(grid) : grid->active;
 }
 
 int grid_getNumRows(grid_t* grid)
@@ -76,60 +219,180 @@ size_t grid_getMapLen(grid_t* grid)
   return grid ? grid->mapLen : 0;
 }
 
+visionmode_t grid_getVisionMode(grid_t* grid)
+{
+  return grid ? grid->visionMode : VISION_DEFAULT;
+}
+
+rooms_t* grid_getRooms(grid_t* grid)
+{
+  return grid ? grid->rooms : NULL;
+}
+
+char grid_getTerrain(grid_t* grid, int pos)
+{
+  return (grid && pos >= 0 && pos < grid->mapLen) ? grid->reference[pos] : '\0';
+}
+
+char grid_getItem(grid_t* grid, int pos)
+{
+  return (grid && grid->items && pos >= 0 && pos < grid->mapLen) ? grid->items[pos] : '\0';
+}
+
+char grid_getEntity(grid_t* grid, int pos)
+{
+  return (grid && grid->entities && pos >= 0 && pos < grid->mapLen) ? grid->entities[pos] : '\0';
+}
+
+uint8_t grid_getMoves(grid_t* grid, int pos)
+{
+  return (grid && pos >= 0 && pos < grid->mapLen) ? grid->moves[pos] : 0;
+}
+
+components_t* grid_getComponents(grid_t* grid)
+{
+  return grid ? grid->components : NULL;
+}
+
+char grid_getTile(grid_t* grid, int pos)
+{
+  if (grid == NULL || pos < 0 || pos >= grid->mapLen) {
+    return '\0';
+  }
+  composeStale(grid);
+  return activeTile(grid, pos);
+}
+
+/**************** grid_isReachable *****************/
+/* see header file for details */
+bool grid_isReachable(grid_t* grid, int from, int to)
+{
+  if (grid == NULL || from < 0 || to < 0 || from >= grid->mapLen || to >= grid->mapLen
+      || (grid->flags[from] & TILE_WALKABLE) == 0 || (grid->flags[to] & TILE_WALKABLE) == 0) {
+    return false;
+  }
+  return grid->components == NULL
+    || components_getComponent(grid->components, from) == components_getComponent(grid->components, to);
+}
+
 /**************** grid_new *****************/
 /* see header file for details */
 grid_t* grid_new(char* mapFile)
 {
-  FILE* fp = NULL;                     // file to read from
+  return newGrid(mapFile, false, '\0');
+}
+
+/**************** grid_newChunked *****************/
+/* see header file for details */
+grid_t* grid_newChunked(char* mapFile, char blank)
+{
+  if (blank == '\0' || blank == '\n') {
+    return NULL;
+  }
+  return newGrid(mapFile, true, blank);
+}
+
+/**************** newGrid *****************/
+/* does the work of grid_new and grid_newChunked, with the active map
+ * kept in chunks showing the given blank if chunked is true
+ */
+static grid_t* newGrid(char* mapFile, bool chunked, char blank)
+{
   grid_t* grid = NULL;                 // grid struct to create
   
   // allocate space for grid, return NULL if failure
   if ((grid = mem_malloc(sizeof(grid_t))) == NULL) {
     return NULL;
   }
-
-  // open file and read into struct
-  if ((fp = fopen(mapFile, "r")) != NULL) {
-    // number of rows in the grid == number of lines in source file
-    grid->numRows = file_numLines(fp);
-    // allocate reference by reading from file
-    grid->reference = file_readFile(fp);
-    fclose(fp);
-    // clean up and return NULL if failure to allocate reference map
-    if (grid->reference == NULL) {
-      grid_delete(grid);
-      return NULL;
-    }
-    // store length of map string
-    grid->mapLen = strlen(grid->reference);
-
-    // create a copy of the reference map to use as active map
-    grid->active = mem_malloc(strlen(grid->reference) + 1);
-    // clean up and return NULL if failure to allocate active map
-    if (grid->active == NULL) {
+  // start with nothing allocated, so grid_delete is safe at any point below
+  grid->map = NULL;
+  grid->reference = NULL;
+  grid->active = NULL;
+  grid->chunks = NULL;
+  grid->blank = blank;
+  grid->items = NULL;
+  grid->entities = NULL;
+  grid->stale = NULL;
+  grid->numStale = 0;
+  grid->maxStale = 0;
+  grid->emptyTiles = NULL;
+  grid->emptyIndex = NULL;
+  grid->numEmpty = 0;
+  grid->numEmptyMain = 0;
+  grid->runs = NULL;
+  grid->visTable = NULL;
+  grid->visTableLazy = false;
+  grid->mapVisIndex = NULL;
+  grid->mapVisData = NULL;
+  grid->mapVisionMode = -1;
+  grid->visCache = NULL;
+  grid->visionMode = VISION_DEFAULT;
+  grid->lightRadius = 0;
+  grid->changes = NULL;
+  grid->numChanges = 0;
+  grid->maxChanges = 0;
+  grid->changesOverflow = false;
+  grid->rooms = NULL;
+  grid->ownRooms = false;
+  grid->components = NULL;
+  grid->ownComponents = false;
+  grid->ownTerrain = false;
+  grid->visDeps = NULL;
+  grid->mapVisStale = NULL;
+  grid->dropped = NULL;
+  grid->numDropped = 0;
+  grid->maxDropped = 0;
+  pthread_mutex_init(&grid->visionLock, NULL);
+
+  // share the reference map, reading the file only if no grid holds it yet
+  if ((grid->map = mapcache_acquire(mapFile)) == NULL) {
+    // clean up and return NULL if file unreadable
+    grid_delete(grid);
+    return NULL;
+  }
+  grid->reference = (char*)mapcache_getReference(grid->map);
+  grid->flags = mapcache_getFlags(grid->map);
+  grid->moves = mapcache_getMoves(grid->map);
+  grid->padded = mapcache_getPadded(grid->map, &grid->paddedStride);
+  for (grid->paddedShift = 0; (1 << grid->paddedShift) < grid->paddedStride; grid->paddedShift++) {
+  }
+  grid->mapLen = mapcache_getMapLen(grid->map);
+  grid->numRows = mapcache_getNumRows(grid->map);
+  grid->numColumns = mapcache_getNumColumns(grid->map);
+  for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+    grid->stepOffsets[dir] = tiles_stepOffset(dir, grid->numColumns);
+  }
+  // the rooms are shared too, until this grid lights or darkens one
+  grid->rooms = mapcache_getRooms(grid->map);
+  // and the components, until its terrain changes
+  grid->components = mapcache_getComponents(grid->map);
+  // and so is any vision compiled with the map
+  grid->mapVisionMode = mapcache_getVision(grid->map, &grid->mapVisIndex, &grid->mapVisData);
+
+  // a chunked active map holds nothing until it is written
+  if (chunked) {
+    const int stride = grid->numColumns + 1;
+    grid->chunks = chunkmap_new(stride, (grid->mapLen + stride - 1) / stride);
+    if (grid->chunks == NULL) {
       grid_delete(grid);
       return NULL;
     }
-
-    // copy map into new memory
-    strcpy(grid->active, grid->reference);
-
-    // number of colums == length of longest row
-    grid->numColumns = longestRowLength(grid->reference);
-    
-    // copy mapfile into memory
-    grid->mapfile = mem_malloc_assert(strlen(mapFile) + 1, 
-                                      "failed to alloc mapfile in grid\n");
-    strcpy(grid->mapfile, mapFile);
-
-    // return the "complete" grid only if all operations successful
     return grid;
+  }
 
-  } else {
-    // clean up and return NULL if file unreadable
-    mem_free(grid);
+  // create a copy of the reference map to use as active map
+  grid->active = mem_malloc(grid->mapLen + 1);
+  // clean up and return NULL if failure to allocate active map
+  if (grid->active == NULL) {
+    grid_delete(grid);
     return NULL;
   }
+
+  // copy map into new memory
+  strcpy(grid->active, grid->reference);
+
+  // return the "complete" grid only if all operations successful
+  return grid;
 }
 
 /*********** grid_containsEmptyTile **********/
@@ -137,13 +400,16 @@ grid_t* grid_new(char* mapFile)
 bool grid_containsEmptyTile(grid_t* grid)
 {
   // check params and active map
-  if (grid == NULL || grid->active == NULL) {
+  if (grid == NULL || (grid->active == NULL && grid->chunks == NULL)) {
     return false;
   }
+  if (grid->emptyTiles != NULL) {
+    return grid->numEmpty > 0;
+  }
 
   // loop over all tiles
   for (int i = 0; i < grid->mapLen; i++) {
-    if (grid->active[i] == ROOMTILE) {
+    if (grid_isEmptyTile(grid, i)) {
       return true;
     }
   }
@@ -157,7 +423,7 @@ bool grid_containsEmptyTile(grid_t* grid)
 bool grid_replace(grid_t* grid, int pos, char newChar)
 {
   // check param existence
-  if (grid->active == NULL || grid->reference == NULL) {
+  if ((grid->active == NULL && grid->chunks == NULL) || grid->reference == NULL) {
     return false;
   }
   // check if pos is out of bounds
@@ -166,147 +432,1842 @@ bool grid_replace(grid_t* grid, int pos, char newChar)
   }
 
   // set character at given pos to given character and return success
-  grid->active[pos] = newChar;
+  recordChange(grid, pos, newChar);
+  return setActiveTile(grid, pos, newChar);
+}
+
+/**************** grid_revertTile **************/
+/* see header file for details */
+bool grid_revertTile(grid_t* grid, int pos)
+{
+  // check param existence
+  if ((grid->active == NULL && grid->chunks == NULL) || grid->reference == NULL) {
+    return false;
+  }
+  // check if pos is out of bounds
+  if (pos < 0 || pos > grid->mapLen - 1) {
+    return false;
+  }
+
+  // set 'active' character at given pos to what the planes hold and return
+  char tile = composeTile(grid, pos);
+  recordChange(grid, pos, tile);
+  return setActiveTile(grid, pos, tile);
+}
+
+/**************** grid_placeItem **************/
+/* see header file for details */
+bool grid_placeItem(grid_t* grid, int pos, char item)
+{
+  // check params
+  if (grid == NULL || pos < 0 || pos > grid->mapLen - 1) {
+    return false;
+  }
+  if (ensurePlane(grid, &grid->items) == NULL || ! markStale(grid, pos)) {
+    return false;
+  }
+  grid->items[pos] = item;
+  updateRuns(grid, pos);
+  updateEmpty(grid, pos);
+  return true;
+}
+
+/**************** grid_placeEntity **************/
+/* see header file for details */
+bool grid_placeEntity(grid_t* grid, int pos, char entity)
+{
+  // check params
+  if (grid == NULL || pos < 0 || pos > grid->mapLen - 1) {
+    return false;
+  }
+  if (ensurePlane(grid, &grid->entities) == NULL || ! markStale(grid, pos)) {
+    return false;
+  }
+  grid->entities[pos] = entity;
+  updateRuns(grid, pos);
+  updateEmpty(grid, pos);
+  return true;
+}
+
+/**************** grid_moveEntity **************/
+/* see header file for details */
+bool grid_moveEntity(grid_t* grid, int from, int to)
+{
+  // check params, there must be something to move
+  if (grid_getEntity(grid, from) == '\0' || to < 0 || to > grid->mapLen - 1) {
+    return false;
+  }
+  if ( ! markStale(grid, from) || ! markStale(grid, to)) {
+    return false;
+  }
+  // one tile at a time, so the run table follows each change in turn
+  char moved = grid->entities[from];
+  grid->entities[from] = grid->entities[to];
+  updateRuns(grid, from);
+  updateEmpty(grid, from);
+  grid->entities[to] = moved;
+  updateRuns(grid, to);
+  updateEmpty(grid, to);
+  return true;
+}
+
+/**************** grid_setTerrain **************/
+/* see header file for details */
+bool grid_setTerrain(grid_t* grid, int pos, char tile)
+{
+  // check params, rows keep their newlines
+  if (grid == NULL || pos < 0 || pos > grid->mapLen - 1 || tile == '\0' || tile == '\n'
+      || grid->reference[pos] == '\n') {
+    return false;
+  }
+  const char old = grid->reference[pos];
+  if (old == tile) {
+    return true;
+  }
+  if ( ! markStale(grid, pos) || ! takeTerrain(grid) || ! trackVision(grid)) {
+    return false;
+  }
+
+  // rooms are made of room floor, and whether one is rectangular depends on
+  // its ring, so any change in or next to a room can reshape it
+  bool reshapes = ((grid->flags[pos] | tiles_class[(unsigned char)tile]) & TILE_ROOM) != 0;
+  for (int dir = 0; dir < NUM_DIRECTIONS && ! reshapes; dir++) {
+    const int next = pos + grid->stepOffsets[dir];
+    reshapes = next >= 0 && next < grid->mapLen && (grid->flags[next] & TILE_ROOM) != 0;
+  }
+  reshapes = reshapes && grid->rooms != NULL;
+  // and only a tile that turns walkable, or stops being so, can join or
+  // split the areas a player can walk between
+  const bool relabels = ((grid->flags[pos] ^ tiles_class[(unsigned char)tile]) & TILE_WALKABLE) != 0;
+
+  // vision from a room depends on the room as a whole, before and after
+  if (reshapes) {
+    dropRoomVision(grid, pos);
+  }
+  writeTerrain(grid, pos, tile);
+  components_t* relabelled = NULL;     // components after the change, if it moves them
+  if ((relabels && (relabelled = components_new(grid->flags, grid->moves,
+                                                grid->mapLen, grid->numColumns)) == NULL)
+      || (reshapes && ! rebuildRooms(grid))) {
+    components_delete(relabelled);
+    writeTerrain(grid, pos, old);
+    refillVision(grid);
+    return false;
+  }
+  if (relabelled != NULL) {
+    if (grid->ownComponents) {
+      components_delete(grid->components);
+    }
+    grid->components = relabelled;
+    grid->ownComponents = true;
+    partitionEmpty(grid);
+  }
+  if (reshapes) {
+    dropRoomVision(grid, pos);
+  }
+
+  updateEmpty(grid, pos);
+  if (grid->runs != NULL) {
+    for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+      grid->runs[(size_t)dir * grid->mapLen + pos] = runFrom(grid, dir, pos);
+    }
+    updateRuns(grid, pos);
+  }
+
+  // then only the vision that could have seen the change
+  dropVision(grid, pos);
+  visdeps_invalidate(grid->visDeps, pos, grid, dropVision);
+  refillVision(grid);
   return true;
 }
 
-/**************** grid_revertTile **************/
-/* see header file for details */
-bool grid_revertTile(grid_t* grid, int pos)
+/**************** grid_buildRunTable **************/
+/* see header file for details */
+bool grid_buildRunTable(grid_t* grid)
+{
+  // check params, and don't replace an existing table
+  if (grid == NULL) {
+    return false;
+  }
+  if (grid->runs != NULL) {
+    return true;
+  }
+  if ((grid->runs = mem_malloc((size_t)NUM_DIRECTIONS * grid->mapLen)) == NULL) {
+    return false;
+  }
+
+  // a run from a tile is one more than the run from the tile it steps onto,
+  // so fill each direction starting from the far end of its lines
+  for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+    uint8_t* runs = grid->runs + (size_t)dir * grid->mapLen;
+    if (grid->stepOffsets[dir] > 0) {
+      for (int pos = grid->mapLen - 1; pos >= 0; pos--) {
+        runs[pos] = runFrom(grid, dir, pos);
+      }
+    } else {
+      for (int pos = 0; pos < grid->mapLen; pos++) {
+        runs[pos] = runFrom(grid, dir, pos);
+      }
+    }
+  }
+  return true;
+}
+
+/**************** grid_getRunLength **************/
+/* see header file for details */
+int grid_getRunLength(grid_t* grid, int pos, direction_t dir)
+{
+  int length = 0;                      // steps found so far
+
+  // check params, runs only start from where a player can stand
+  if (grid == NULL || pos < 0 || pos >= grid->mapLen || dir < 0 || dir >= NUM_DIRECTIONS
+      || (grid->flags[pos] & TILE_WALKABLE) == 0) {
+    return 0;
+  }
+  const int step = grid->stepOffsets[dir];
+
+  if (grid->runs == NULL) {
+    while (isOpen(grid, pos + step)) {
+      pos += step;
+      length++;
+    }
+    return length;
+  }
+
+  // a full entry only says the run is at least that long, so carry on from there
+  const uint8_t* runs = grid->runs + (size_t)dir * grid->mapLen;
+  int run;
+  do {
+    run = runs[pos];
+    length += run;
+    pos += run * step;
+  } while (run == RUNMAX);
+  return length;
+}
+
+/**************** grid_isEmptyTile **************/
+/* see header file for details */
+bool grid_isEmptyTile(grid_t* grid, int pos)
+{
+  if (grid != NULL && grid->emptyIndex != NULL && pos >= 0 && pos < grid->mapLen) {
+    return grid->emptyIndex[pos] >= 0;
+  }
+  return grid_getTerrain(grid, pos) == ROOMTILE
+    && grid_getItem(grid, pos) == '\0' && grid_getEntity(grid, pos) == '\0';
+}
+
+/*********** grid_indexEmptyTiles **********/
+/* see header file for details */
+bool grid_indexEmptyTiles(grid_t* grid)
+{
+  // check params, and don't replace an existing index
+  if (grid == NULL) {
+    return false;
+  }
+  if (grid->emptyTiles != NULL) {
+    return true;
+  }
+
+  // room for every room tile, the most there can ever be empty,
+  // or for every tile once the terrain can change
+  int numRoom = 0;
+  const int* roomTiles = mapcache_getFreeTiles(grid->map, &numRoom);
+  const int maxEmpty = grid->ownTerrain ? grid->mapLen : numRoom;
+  grid->emptyIndex = mem_malloc(grid->mapLen * sizeof(int));
+  grid->emptyTiles = mem_malloc((maxEmpty > 0 ? maxEmpty : 1) * sizeof(int));
+  if (grid->emptyIndex == NULL || grid->emptyTiles == NULL) {
+    if (grid->emptyIndex != NULL) {
+      mem_free(grid->emptyIndex);
+    }
+    if (grid->emptyTiles != NULL) {
+      mem_free(grid->emptyTiles);
+    }
+    grid->emptyIndex = NULL;
+    grid->emptyTiles = NULL;
+    return false;
+  }
+
+  grid->numEmpty = 0;
+  grid->numEmptyMain = 0;
+  for (int pos = 0; pos < grid->mapLen; pos++) {
+    grid->emptyIndex[pos] = -1;
+  }
+  // on a grid nothing stands on yet, every room tile of the map is empty
+  if (grid->items == NULL && grid->entities == NULL && ! grid->ownTerrain) {
+    for (int i = 0; i < numRoom; i++) {
+      grid->emptyIndex[roomTiles[i]] = i;
+      grid->emptyTiles[i] = roomTiles[i];
+    }
+    grid->numEmpty = numRoom;
+    partitionEmpty(grid);
+    return true;
+  }
+  for (int pos = 0; pos < grid->mapLen; pos++) {
+    updateEmpty(grid, pos);
+  }
+  return true;
+}
+
+/*********** grid_countEmptyTiles **********/
+/* see header file for details */
+int grid_countEmptyTiles(grid_t* grid)
+{
+  if (grid == NULL) {
+    return 0;
+  }
+  if (grid->emptyTiles != NULL) {
+    return grid->numEmpty;
+  }
+  int count = 0;
+  for (int pos = 0; pos < grid->mapLen; pos++) {
+    count += grid_isEmptyTile(grid, pos);
+  }
+  return count;
+}
+
+/*********** grid_randomEmptyTile **********/
+/* see header file for details */
+int grid_randomEmptyTile(grid_t* grid)
+{
+  int count = grid_countEmptyTiles(grid);
+  if (count == 0) {
+    return -1;
+  }
+  int chosen = rand() % count;
+  if (grid->emptyTiles != NULL) {
+    return grid->emptyTiles[chosen];
+  }
+
+  // without an index, find the chosen one by counting them again
+  for (int pos = 0; pos < grid->mapLen; pos++) {
+    if (grid_isEmptyTile(grid, pos) && chosen-- == 0) {
+      return pos;
+    }
+  }
+  return -1;
+}
+
+/*********** grid_randomMainEmptyTile **********/
+/* see header file for details */
+int grid_randomMainEmptyTile(grid_t* grid)
+{
+  if (grid == NULL) {
+    return -1;
+  }
+  if (grid->emptyTiles != NULL) {
+    return grid->numEmptyMain > 0 ? grid->emptyTiles[rand() % grid->numEmptyMain] : -1;
+  }
+
+  // without an index, count them, then find the chosen one by counting again
+  int count = 0;
+  for (int pos = 0; pos < grid->mapLen; pos++) {
+    count += grid_isEmptyTile(grid, pos) && inMainArea(grid, pos);
+  }
+  if (count == 0) {
+    return -1;
+  }
+  int chosen = rand() % count;
+  for (int pos = 0; pos < grid->mapLen; pos++) {
+    if (grid_isEmptyTile(grid, pos) && inMainArea(grid, pos) && chosen-- == 0) {
+      return pos;
+    }
+  }
+  return -1;
+}
+
+/**************** grid_trackChanges **************/
+/* see header file for details */
+bool grid_trackChanges(grid_t* grid, int maxChanges)
+{
+  // check params, and don't replace an existing log
+  if (grid == NULL || maxChanges < 1) {
+    return false;
+  }
+  if (grid->changes != NULL) {
+    return true;
+  }
+
+  if ((grid->changes = mem_malloc(maxChanges * sizeof(int))) == NULL) {
+    return false;
+  }
+  grid->maxChanges = maxChanges;
+  grid_clearChanges(grid);
+  return true;
+}
+
+/**************** grid_getChanges **************/
+/* see header file for details */
+const int* grid_getChanges(grid_t* grid, int* count)
+{
+  if (grid == NULL || count == NULL) {
+    return NULL;
+  }
+  // an untracked or overflowed log can't say what changed
+  composeStale(grid);
+  if (grid->changes == NULL || grid->changesOverflow) {
+    return NULL;
+  }
+  *count = grid->numChanges;
+  return grid->changes;
+}
+
+/**************** grid_clearChanges **************/
+/* see header file for details */
+void grid_clearChanges(grid_t* grid)
+{
+  if (grid != NULL) {
+    grid->numChanges = 0;
+    grid->changesOverflow = false;
+  }
+}
+
+/**************** grid_getBytes ***************/
+/* see header file for details */
+size_t grid_getBytes(grid_t* grid)
+{
+  if (grid == NULL) {
+    return 0;
+  }
+  const size_t mapLen = grid->mapLen;
+  size_t bytes = sizeof(grid_t);
+
+  // the active map and the planes
+  bytes += grid->chunks != NULL ? chunkmap_getBytes(grid->chunks) : mapLen + 1;
+  bytes += (grid->items != NULL ? mapLen : 0) + (grid->entities != NULL ? mapLen : 0);
+  bytes += (size_t)grid->maxStale * sizeof(int) + (size_t)grid->maxChanges * sizeof(int);
+
+  // indexes kept up to date as things move
+  if (grid->emptyIndex != NULL) {
+    int numRoom = 0;
+    mapcache_getFreeTiles(grid->map, &numRoom);
+    bytes += (mapLen + (grid->ownTerrain ? mapLen : numRoom)) * sizeof(int);
+  }
+  if (grid->runs != NULL) {
+    bytes += (size_t)NUM_DIRECTIONS * mapLen;
+  }
+
+  // stored vision, and what it depends on
+  if (grid->visCache != NULL) {
+    viscachestats_t stats;
+    viscache_getStats(grid->visCache, &stats);
+    bytes += stats.bytes;
+  }
+  bytes += vistable_getBytes(grid->visTable) + visdeps_getBytes(grid->visDeps);
+  bytes += grid->mapVisStale != NULL ? mapLen / 8 : 0;
+  bytes += (size_t)grid->maxDropped * sizeof(int);
+
+  // anything taken from the shared map to change
+  if (grid->ownRooms) {
+    bytes += mapLen * sizeof(int);
+  }
+  if (grid->ownComponents) {
+    bytes += components_getBytes(grid->components);
+  }
+  if (grid->ownTerrain) {
+    const int stride = grid->numColumns + 1;
+    bytes += 3 * (mapLen + 1)
+      + (size_t)grid->paddedStride * ((mapLen + stride - 1) / stride + 2);
+  }
+  return bytes;
+}
+
+/**************** grid_delete ***************/
+/* see header file for details */
+void grid_delete(grid_t* grid)
+{
+  // free strings if they exist
+  if (grid->active != NULL) {
+    mem_free(grid->active);
+  }
+  // chunkmap_delete ignores NULL
+  chunkmap_delete(grid->chunks);
+  if (grid->items != NULL) {
+    mem_free(grid->items);
+  }
+  if (grid->entities != NULL) {
+    mem_free(grid->entities);
+  }
+  if (grid->stale != NULL) {
+    mem_free(grid->stale);
+  }
+  if (grid->runs != NULL) {
+    mem_free(grid->runs);
+  }
+  if (grid->emptyTiles != NULL) {
+    mem_free(grid->emptyTiles);
+  }
+  if (grid->emptyIndex != NULL) {
+    mem_free(grid->emptyIndex);
+  }
+
+  // vistable_delete, viscache_delete, visdeps_delete and bitset_delete ignore NULL
+  vistable_delete(grid->visTable);
+  viscache_delete(grid->visCache);
+  visdeps_delete(grid->visDeps);
+  bitset_delete(grid->mapVisStale);
+  if (grid->dropped != NULL) {
+    mem_free(grid->dropped);
+  }
+
+  if (grid->changes != NULL) {
+    mem_free(grid->changes);
+  }
+
+  // the shared map is free'd by the last grid to release it
+  if (grid->ownRooms) {
+    rooms_delete(grid->rooms);
+  }
+  if (grid->ownComponents) {
+    components_delete(grid->components);
+  }
+  if (grid->ownTerrain) {
+    mem_free(grid->reference);
+    mem_free((void*)grid->flags);
+    mem_free((void*)grid->moves);
+    mem_free((void*)grid->padded);
+  }
+  mapcache_release(grid->map);
+  pthread_mutex_destroy(&grid->visionLock);
+
+  // then free the struct itself
+  mem_free(grid);
+}
+
+/************* activeTile **************/
+/* returns the character the active map holds at pos, which must be in bounds,
+ * from the chunks of a chunked grid, where a tile never written is blank
+ */
+static char activeTile(grid_t* grid, int pos)
+{
+  if (grid->chunks == NULL) {
+    return grid->active[pos];
+  }
+  const int stride = grid->numColumns + 1;
+  char tile = chunkmap_get(grid->chunks, pos % stride, pos / stride);
+  if (tile != '\0') {
+    return tile;
+  }
+  return blankTile(grid, pos);
+}
+
+/************* blankTile **************/
+/* returns what a chunked grid shows at pos where nothing is written:
+ * its blank, or the newline that ends a row
+ */
+static char blankTile(grid_t* grid, int pos)
+{
+  return grid->reference[pos] == '\n' ? '\n' : grid->blank;
+}
+
+/************* setActiveTile **************/
+/* sets the character the active map holds at pos, which must be in bounds
+ * a chunked grid stores a blank as nothing, so that writing blanks over
+ * a part of the map never written allocates nothing
+ * returns false on failure to allocate a chunk
+ */
+static bool setActiveTile(grid_t* grid, int pos, char tile)
+{
+  if (grid->chunks == NULL) {
+    grid->active[pos] = tile;
+    return true;
+  }
+  const int stride = grid->numColumns + 1;
+  return chunkmap_set(grid->chunks, pos % stride, pos / stride,
+                      tile == blankTile(grid, pos) ? '\0' : tile);
+}
+
+/************* buildFrame **************/
+/* puts the whole active map of a chunked grid together in this thread's
+ * frame, a chunk's row at a time, growing the frame if the map is longer
+ * than any it held before
+ * returns the frame, or NULL on failure to allocate memory
+ */
+static char* buildFrame(grid_t* grid)
+{
+  const int mapLen = grid->mapLen;
+  const int stride = grid->numColumns + 1;
+
+  // plain malloc, as any thread may build its frame (see workpool.h)
+  if (frameSize < mapLen + 1) {
+    char* grown = malloc(mapLen + 1);
+    if (grown == NULL) {
+      return NULL;
+    }
+    if (frame != NULL) {
+      free(frame);
+    }
+    frame = grown;
+    frameSize = mapLen + 1;
+  }
+
+  for (int start = 0, y = 0; start < mapLen; start += stride, y++) {
+    const int rowLen = (mapLen - start < stride) ? mapLen - start : stride;
+    int length = 0;                    // tiles of the row in the chunk at x
+    for (int x = 0; x < rowLen; x += length) {
+      const char* tiles = chunkmap_getRow(grid->chunks, x, y, &length);
+      if (length > rowLen - x) {
+        length = rowLen - x;
+      }
+      for (int i = 0; i < length; i++) {
+        const int pos = start + x + i;
+        frame[pos] = (tiles != NULL && tiles[i] != '\0') ? tiles[i] : blankTile(grid, pos);
+      }
+    }
+  }
+  frame[mapLen] = '\0';
+  return frame;
+}
+
+/************* recordChange **************/
+/* adds pos to the grid's change log, if it keeps one,
+ * when the active character there is about to become newChar
+ * writes that leave the character the same are not changes
+ */
+static void recordChange(grid_t* grid, int pos, char newChar)
+{
+  if (grid->changes == NULL || grid->changesOverflow || activeTile(grid, pos) == newChar) {
+    return;
+  }
+  if (grid->numChanges == grid->maxChanges) {
+    grid->changesOverflow = true;
+    return;
+  }
+  grid->changes[grid->numChanges++] = pos;
+}
+
+/************* composeTile **************/
+/* returns the character the active map shows at pos:
+ * the entity there, else the item there, else the terrain
+ */
+static char composeTile(grid_t* grid, int pos)
+{
+  if (grid->entities != NULL && grid->entities[pos] != '\0') {
+    return grid->entities[pos];
+  }
+  if (grid->items != NULL && grid->items[pos] != '\0') {
+    return grid->items[pos];
+  }
+  return grid->reference[pos];
+}
+
+/************* composeStale **************/
+/* brings every stale tile of the active map up to date with the planes,
+ * logging the ones whose character changes
+ */
+static void composeStale(grid_t* grid)
+{
+  for (int i = 0; i < grid->numStale; i++) {
+    int pos = grid->stale[i];
+    char tile = composeTile(grid, pos);
+    recordChange(grid, pos, tile);
+    setActiveTile(grid, pos, tile);
+  }
+  grid->numStale = 0;
+}
+
+/************* markStale **************/
+/* notes that pos was placed on, so the active map composes it again,
+ * growing the list of stale tiles if it is full
+ * returns false on failure to allocate memory
+ */
+static bool markStale(grid_t* grid, int pos)
+{
+  if (grid->numStale == grid->maxStale) {
+    int maxStale = grid->maxStale > 0 ? 2 * grid->maxStale : FIRSTSTALE;
+    int* grown = mem_malloc(maxStale * sizeof(int));
+    if (grown == NULL) {
+      return false;
+    }
+    if (grid->stale != NULL) {
+      memcpy(grown, grid->stale, grid->numStale * sizeof(int));
+      mem_free(grid->stale);
+    }
+    grid->stale = grown;
+    grid->maxStale = maxStale;
+  }
+  grid->stale[grid->numStale++] = pos;
+  return true;
+}
+
+/************* isOpen **************/
+/* returns true if a run can pass over pos: it is on the map,
+ * walkable, and has no item or entity on it
+ */
+static bool isOpen(grid_t* grid, int pos)
+{
+  return pos >= 0 && pos < grid->mapLen && (grid->flags[pos] & TILE_WALKABLE) != 0
+    && (grid->items == NULL || grid->items[pos] == '\0')
+    && (grid->entities == NULL || grid->entities[pos] == '\0');
+}
+
+/************* runFrom **************/
+/* returns the run table entry for pos in direction dir, from the entry of
+ * the tile one step on, which must be up to date. Entries stop at RUNMAX
+ */
+static int runFrom(grid_t* grid, int dir, int pos)
+{
+  const int next = pos + grid->stepOffsets[dir];
+  if ((grid->moves[pos] & MOVE_BIT(dir)) == 0 || ! isOpen(grid, next)) {
+    return 0;
+  }
+  const int run = 1 + grid->runs[(size_t)dir * grid->mapLen + next];
+  return run < RUNMAX ? run : RUNMAX;
+}
+
+/************* updateRuns **************/
+/* brings the run table up to date after something was placed on, or taken
+ * off, the tile at pos. Only runs that pass over pos change: in each
+ * direction, walk back from pos until a tile's run is as it was, or a run
+ * can't pass over the tile, since the runs behind it don't change either
+ */
+static void updateRuns(grid_t* grid, int pos)
+{
+  if (grid->runs == NULL) {
+    return;
+  }
+  for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+    uint8_t* runs = grid->runs + (size_t)dir * grid->mapLen;
+    const int step = grid->stepOffsets[dir];
+    for (int back = pos - step; back >= 0 && back < grid->mapLen; back -= step) {
+      const int run = runFrom(grid, dir, back);
+      if (run == runs[back]) {
+        break;
+      }
+      runs[back] = run;
+      if ( ! isOpen(grid, back)) {
+        break;
+      }
+    }
+  }
+}
+
+/************* updateEmpty **************/
+/* brings the set of empty tiles up to date after something was placed on,
+ * or taken off, the tile at pos. A tile leaving the set is swapped with
+ * the last one, so the array stays dense. Tiles of the main area are kept
+ * ahead of the rest by one more swap, across the boundary between them
+ */
+static void updateEmpty(grid_t* grid, int pos)
+{
+  if (grid->emptyTiles == NULL) {
+    return;
+  }
+  const bool empty = grid->reference[pos] == ROOMTILE
+    && (grid->items == NULL || grid->items[pos] == '\0')
+    && (grid->entities == NULL || grid->entities[pos] == '\0');
+  int index = grid->emptyIndex[pos];
+
+  if (empty && index < 0) {
+    grid->emptyIndex[pos] = grid->numEmpty;
+    grid->emptyTiles[grid->numEmpty++] = pos;
+    if (inMainArea(grid, pos)) {
+      swapEmpty(grid, grid->numEmpty - 1, grid->numEmptyMain++);
+    }
+  } else if ( ! empty && index >= 0) {
+    if (index < grid->numEmptyMain) {
+      swapEmpty(grid, index, --grid->numEmptyMain);
+      index = grid->numEmptyMain;
+    }
+    const int last = grid->emptyTiles[--grid->numEmpty];
+    grid->emptyTiles[index] = last;
+    grid->emptyIndex[last] = index;
+    grid->emptyIndex[pos] = -1;
+  }
+}
+
+/************* inMainArea **************/
+/* true if pos lies in the grid's largest walkable component, or if its
+ * components could not be labelled
+ */
+static bool inMainArea(grid_t* grid, int pos)
+{
+  return grid->components == NULL
+    || components_getComponent(grid->components, pos) == components_getLargest(grid->components);
+}
+
+/************* swapEmpty **************/
+/* swaps the empty tiles at indexes i and j of the set of empty tiles */
+static void swapEmpty(grid_t* grid, int i, int j)
+{
+  const int tile = grid->emptyTiles[i];
+  grid->emptyTiles[i] = grid->emptyTiles[j];
+  grid->emptyTiles[j] = tile;
+  grid->emptyIndex[grid->emptyTiles[i]] = i;
+  grid->emptyIndex[tile] = j;
+}
+
+/************* partitionEmpty **************/
+/* moves the empty tiles of the main area ahead of the rest, after the
+ * set was filled or the components were labelled again. Keeps the order
+ * of a set that lies wholly in the main area
+ */
+static void partitionEmpty(grid_t* grid)
+{
+  if (grid->emptyTiles == NULL) {
+    return;
+  }
+  grid->numEmptyMain = 0;
+  for (int i = 0; i < grid->numEmpty; i++) {
+    if (inMainArea(grid, grid->emptyTiles[i])) {
+      swapEmpty(grid, i, grid->numEmptyMain++);
+    }
+  }
+}
+
+/************* ensurePlane **************/
+/* returns the given plane of the grid, allocating it empty the first time
+ * so that grids nothing is placed on, like players' visions, never hold one
+ * returns NULL on failure to allocate memory
+ */
+static char* ensurePlane(grid_t* grid, char** plane)
+{
+  if (*plane == NULL) {
+    *plane = mem_calloc(grid->mapLen, sizeof(char));
+  }
+  return *plane;
+}
+
+/************* moveMask **************/
+/* returns the move mask of pos as mapcache_getMoves lays it out, from the
+ * grid's flags: a step is open if it lands on a walkable tile of the string
+ */
+static uint8_t moveMask(grid_t* grid, int pos)
+{
+  uint8_t mask = 0;                    // open steps found so far
+
+  if ((grid->flags[pos] & TILE_WALKABLE) == 0) {
+    return 0;
+  }
+  for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+    const int next = pos + grid->stepOffsets[dir];
+    if (next >= 0 && next < grid->mapLen && (grid->flags[next] & TILE_WALKABLE) != 0) {
+      mask |= MOVE_BIT(dir);
+    }
+  }
+  return mask;
+}
+
+/************* writeTerrain **************/
+/* writes tile into the grid's own copy of the terrain at pos, and brings
+ * its flags, padded layout and the move masks of pos and the tiles
+ * around it up to date. Only called once takeTerrain has succeeded
+ */
+static void writeTerrain(grid_t* grid, int pos, char tile)
+{
+  // the grid owns these once it has taken its terrain
+  uint8_t* flags = (uint8_t*)grid->flags;
+  uint8_t* moves = (uint8_t*)grid->moves;
+  char* padded = (char*)grid->padded;
+  const int stride = grid->numColumns + 1;
+  const int y = pos / stride;
+
+  grid->reference[pos] = tile;
+  flags[pos] = tiles_class[(unsigned char)tile];
+  if (y < grid->numRows) {
+    padded[((y + 1) << grid->paddedShift) + pos % stride + 1] = tile;
+  }
+  moves[pos] = moveMask(grid, pos);
+  for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+    const int next = pos + grid->stepOffsets[dir];
+    if (next >= 0 && next < grid->mapLen) {
+      moves[next] = moveMask(grid, next);
+    }
+  }
+}
+
+/************* takeTerrain **************/
+/* gives the grid its own copies of the reference map, flags, move masks and
+ * padded layout, the first time its terrain changes, so that other grids
+ * of the same map keep the terrain as it was read. An index of empty tiles
+ * grows to hold every tile, as any of them could become room floor
+ * returns false on failure to allocate memory, leaving the grid as it was
+ */
+static bool takeTerrain(grid_t* grid)
+{
+  if (grid->ownTerrain) {
+    return true;
+  }
+  const int stride = grid->numColumns + 1;
+  const size_t paddedLen = (size_t)grid->paddedStride * ((grid->mapLen + stride - 1) / stride + 2);
+  char* reference = mem_malloc(grid->mapLen + 1);
+  uint8_t* flags = mem_malloc(grid->mapLen + 1);
+  uint8_t* moves = mem_malloc(grid->mapLen + 1);
+  char* padded = mem_malloc(paddedLen);
+  int* emptyTiles = grid->emptyTiles ? mem_malloc(grid->mapLen * sizeof(int)) : NULL;
+  if (reference == NULL || flags == NULL || moves == NULL || padded == NULL
+      || (grid->emptyTiles != NULL && emptyTiles == NULL)) {
+    void* allocated[] = { reference, flags, moves, padded, emptyTiles };
+    for (int i = 0; i < 5; i++) {
+      if (allocated[i] != NULL) {
+        mem_free(allocated[i]);
+      }
+    }
+    return false;
+  }
+
+  memcpy(reference, grid->reference, grid->mapLen + 1);
+  memcpy(flags, grid->flags, grid->mapLen + 1);
+  memcpy(moves, grid->moves, grid->mapLen + 1);
+  memcpy(padded, grid->padded, paddedLen);
+  grid->reference = reference;
+  grid->flags = flags;
+  grid->moves = moves;
+  grid->padded = padded;
+  if (emptyTiles != NULL) {
+    memcpy(emptyTiles, grid->emptyTiles, grid->numEmpty * sizeof(int));
+    mem_free(grid->emptyTiles);
+    grid->emptyTiles = emptyTiles;
+  }
+  grid->ownTerrain = true;
+  return true;
+}
+
+/************* rebuildRooms **************/
+/* splits the grid's terrain into rooms again after it changed,
+ * giving the grid its own rooms. A new room is dark if any of its tiles
+ * was in a dark room, so darkness carries over however rooms join or split
+ * returns false on failure to allocate memory, leaving the rooms as they were
+ */
+static bool rebuildRooms(grid_t* grid)
+{
+  rooms_t* rebuilt = rooms_new(grid->reference, grid->numColumns, grid->numRows, grid->mapLen);
+  if (rebuilt == NULL) {
+    return false;
+  }
+  for (int pos = 0; pos < grid->mapLen; pos++) {
+    const int room = rooms_getRoom(rebuilt, pos);
+    const int was = rooms_getRoom(grid->rooms, pos);
+    if (room >= 0 && was >= 0 && ! rooms_isLit(grid->rooms, was)) {
+      rooms_setLit(rebuilt, room, false);
+    }
+  }
+  if (grid->ownRooms) {
+    rooms_delete(grid->rooms);
+  }
+  grid->rooms = rebuilt;
+  grid->ownRooms = true;
+  return true;
+}
+
+/************* dropRoomVision **************/
+/* drops the stored vision from every tile of the rooms at or next to pos,
+ * as a viewer's vision depends on the shape and light of the room it is in
+ */
+static void dropRoomVision(grid_t* grid, int pos)
+{
+  int rooms[NUM_DIRECTIONS + 1];       // rooms dropped so far
+  int numRooms = 0;                    // number of rooms in rooms
+  int left, top, right, bottom;        // bounds of a room
+  const int stride = grid->numColumns + 1;
+
+  for (int dir = -1; dir < NUM_DIRECTIONS; dir++) {
+    const int next = dir < 0 ? pos : pos + grid->stepOffsets[dir];
+    const int room = (next >= 0 && next < grid->mapLen) ? rooms_getRoom(grid->rooms, next) : -1;
+    bool seen = room < 0;
+    for (int i = 0; i < numRooms && ! seen; i++) {
+      seen = rooms[i] == room;
+    }
+    if (seen || ! rooms_getBounds(grid->rooms, room, &left, &top, &right, &bottom)) {
+      continue;
+    }
+    rooms[numRooms++] = room;
+    for (int y = top; y <= bottom; y++) {
+      for (int x = left; x <= right; x++) {
+        if (rooms_getRoom(grid->rooms, y * stride + x) == room) {
+          dropVision(grid, y * stride + x);
+        }
+      }
+    }
+  }
+}
+
+/* ************************ VISION ************************** */
+
+/***** local vision functions *********************************/
+
+/***** posToCoordinates ***************************************/
+/* converts the position integer into cartesian coordinates to make mathematic manipulation easier */
+static void
+posToCoordinates(grid_t* grid, int pos, int* tuple)
+{
+  // check arguments
+  if( grid == NULL || pos < 0 ){
+    return;
+  } 
+  
+  // calculate coordinates, assumes pos is zero indexed
+  int x = (pos % (grid->numColumns + 1)); // add one for new line character not counter in numColumns
+  int y = (pos / (grid->numColumns + 1));
+  tuple[0] = x;
+  tuple[1] = y;
+  
+  // test print statement
+  //fprintf(stdout, "pos %d -> coord: (%d,%d)\n", pos, x, y);
+
+  return;
+}
+
+/***** coordinatesToPos ***************************************/
+/* converts cartesian coordinates back into an integer representation
+ * coordinates that fall outside the map string (rows can be shorter than numColumns)
+ * are returned as mapLen, the index of the string's terminating null,
+ * which vision treats as a wall. Vision arrays have mapLen + 1 slots for this reason
+ */
+static int
+coordinatesToPos(grid_t* grid, int x, int y)
+{
+  if( grid == NULL ){
+    return -1;
+  }
+  if( x < 0 || y < 0 ){
+    return grid->mapLen;
+  }
+  
+  // where y in the row and x is the column
+  int pos = (y * (grid->numColumns + 1)) + x; // add one to numColumns to account for the new line character
+  if( pos > grid->mapLen ){
+    pos = grid->mapLen;
+  }
+  
+  // test print statement
+  //fprintf(stdout, "coord (%d,%d) -> pos: %d\n", x, y, pos);
+
+  return pos;
+}
+
+/***** fillVisionEntry ****************************************/
+/* calculates vision from the given position into visible,
+ * then stores it in the grid's table, or its cache if it has no table,
+ * as an array of visible positions
+ * visible holds the vision afterwards whether or not it was stored
+ * Only storing the array takes the grid's vision lock. Two threads may both
+ * calculate the same position, the table and cache keep the first one stored
+ * returns true if the entry was stored, false on failure to allocate memory
+ * or if the cache has no room for it
+ */
+static bool
+fillVisionEntry(grid_t* grid, int pos, bitset_t* visible)
+{
+  int count = 0;                       // number of visible positions
+  int* tiles = NULL;                   // the visible positions, in order
+
+  calculateVisionEngine(grid, pos, visible);
+
+  // unpack the set into the array of positions the table stores,
+  // with plain malloc as any thread may get here (see workpool.h)
+  if ((count = bitset_count(visible)) > 0) {
+    if ((tiles = malloc(count * sizeof(int))) == NULL) {
+      return false;
+    }
+    int i = 0;
+    for (int tile = bitset_next(visible, 0); tile >= 0; tile = bitset_next(visible, tile + 1)) {
+      tiles[i++] = tile;
+    }
+  }
+
+  pthread_mutex_lock(&grid->visionLock);
+  bool stored = (grid->visTable != NULL) ? vistable_insert(grid->visTable, pos, tiles, count)
+                                          : viscache_insert(grid->visCache, pos, tiles, count);
+  // once the terrain can change, vision is only stored along with what it depends on
+  if (stored && grid->visDeps != NULL && ! visdeps_add(grid->visDeps, pos, tiles, count)) {
+    vistable_remove(grid->visTable, pos);
+    viscache_remove(grid->visCache, pos);
+    stored = false;
+  }
+  pthread_mutex_unlock(&grid->visionLock);
+  free(tiles);
+  return stored;
+}
+
+/***** usesMapVision ******************************************/
+/* returns true if the vision compiled with the map is what the grid
+ * would calculate: it was compiled with the grid's vision mode,
+ * and the grid has no light radius to cut it short
+ */
+static bool
+usesMapVision(grid_t* grid)
+{
+  return grid->mapVisIndex != NULL && (int)grid->visionMode == grid->mapVisionMode
+    && grid->lightRadius == 0;
+}
+
+/***** mapVisionHolds *****************************************/
+/* returns true if the vision compiled with the map is what the grid
+ * would calculate from pos: see usesMapVision, and the terrain it depends
+ * on hasn't changed since
+ */
+static bool
+mapVisionHolds(grid_t* grid, int pos)
+{
+  return usesMapVision(grid) && (grid->flags[pos] & TILE_WALKABLE)
+    && (grid->mapVisStale == NULL || ! bitset_test(grid->mapVisStale, pos));
+}
+
+/***** copyVisionEntry ****************************************/
+/* clears visible, then adds the count positions in tiles to it */
+static void
+copyVisionEntry(const int* tiles, int count, bitset_t* visible)
+{
+  bitset_clear(visible);
+  for (int i = 0; i < count; i++) {
+    bitset_set(visible, tiles[i]);
+  }
+}
+
+/***** VISION GLOBAL FUNCTIONS ********************************/
+
+/***** grid_buildVisionTable **********************************/
+/* see header file for details */
+bool
+grid_buildVisionTable(grid_t* grid, bool lazy)
+{
+  // check params, and don't rebuild an existing table
+  if (grid == NULL || grid->reference == NULL) {
+    return false;
+  }
+  if (grid->visTable != NULL) {
+    return true;
+  }
+
+  if ((grid->visTable = vistable_new(grid->mapLen)) == NULL) {
+    return false;
+  }
+  grid->visTableLazy = lazy;
+
+  // lazy tables are filled in grid_calculateVision instead, and a map
+  // compiled with its vision has every entry already, unless its terrain changed
+  if (lazy || (usesMapVision(grid) && grid->mapVisStale == NULL)) {
+    return true;
+  }
+
+  // eager tables calculate every walkable tile up front
+  bitset_t* scratch = bitset_new(grid->mapLen);
+  if (scratch == NULL) {
+    vistable_delete(grid->visTable);
+    grid->visTable = NULL;
+    return false;
+  }
+
+  for (int i = 0; i < grid->mapLen; i++) {
+    if ((grid->flags[i] & TILE_WALKABLE) && ! mapVisionHolds(grid, i)
+        && ! fillVisionEntry(grid, i, scratch)) {
+      // give up on the table rather than keep a partial one around
+      bitset_delete(scratch);
+      vistable_delete(grid->visTable);
+      grid->visTable = NULL;
+      return false;
+    }
+  }
+
+  bitset_delete(scratch);
+  return true;
+}
+
+/***** grid_buildVisionCache **********************************/
+/* see header file for details */
+bool
+grid_buildVisionCache(grid_t* grid, size_t budget)
+{
+  // check params, and don't rebuild an existing cache
+  if (grid == NULL || grid->reference == NULL || budget == 0) {
+    return false;
+  }
+  if (grid->visCache != NULL) {
+    return true;
+  }
+
+  // the cache is filled in grid_calculateVision
+  grid->visCache = viscache_new(grid->mapLen, budget);
+  return grid->visCache != NULL;
+}
+
+/***** grid_getVisionCacheStats *******************************/
+/* see header file for details */
+bool
+grid_getVisionCacheStats(grid_t* grid, viscachestats_t* stats)
+{
+  if (grid == NULL || stats == NULL || grid->visCache == NULL) {
+    return false;
+  }
+
+  // the counters change in grid_calculateVision, under the same lock
+  pthread_mutex_lock(&grid->visionLock);
+  bool found = viscache_getStats(grid->visCache, stats);
+  pthread_mutex_unlock(&grid->visionLock);
+  return found;
+}
+
+/***** grid_calculateVision ***********************************/
+/* see header file for details */
+void
+grid_calculateVision(grid_t* grid, int pos, bitset_t* visible)
+{
+  const int* tiles = NULL;             // visible positions from the table
+  int count = 0;                       // number of positions in tiles
+
+  // check parameters
+  if( grid == NULL || visible == NULL || pos < 0 || pos >= grid->mapLen 
+      || bitset_getSize(visible) < grid->mapLen ){
+    return;
+  }
+
+  // vision compiled with the map never changes, so it needs no lock
+  if (mapVisionHolds(grid, pos)) {
+    const int start = grid->mapVisIndex[pos];
+    copyVisionEntry(grid->mapVisData + start, grid->mapVisIndex[pos + 1] - start, visible);
+    return;
+  }
+
+  // a filled table entry never changes, and the table only shows an entry
+  // once it is filled, so looking positions up in it needs no lock
+  if (grid->visTable != NULL) {
+    tiles = vistable_find(grid->visTable, pos, &count);
+  }
+
+  if (tiles == NULL) {
+    bool lazy = (grid->visTable != NULL && grid->visTableLazy)
+                || (grid->visTable == NULL && grid->visCache != NULL);
+    if (lazy && (grid->flags[pos] & TILE_WALKABLE)) {
+      // finding a cache entry moves it up the LRU order, and the next insert
+      // may evict it, so it is found and copied under the lock
+      if (grid->visTable == NULL) {
+        pthread_mutex_lock(&grid->visionLock);
+        if ((tiles = viscache_find(grid->visCache, pos, &count)) != NULL) {
+          copyVisionEntry(tiles, count, visible);
+        }
+        pthread_mutex_unlock(&grid->visionLock);
+        if (tiles != NULL) {
+          return;
+        }
+      }
+
+      // walkable tiles are calculated and stored the first time they're seen
+      fillVisionEntry(grid, pos, visible);
+      return;
+    }
+
+    // nothing stored for this position, so calculate it directly
+    calculateVisionEngine(grid, pos, visible);
+    return;
+  }
+
+  // copy the stored visible set into the caller's set,
+  // a filled table entry never changes so this needs no lock either
+  copyVisionEntry(tiles, count, visible);
+}
+
+#ifdef VISIONBENCH
+/***** grid_getTilesVisited ***********************************/
+/* see header file for details */
+unsigned long
+grid_getTilesVisited(void)
+{
+  return tilesVisited;
+}
+#endif
+
+/***** grid_setVisionMode *************************************/
+/* see header file for details */
+bool
+grid_setVisionMode(grid_t* grid, visionmode_t mode)
+{
+  // check params
+  if (grid == NULL || (mode != VISION_RAYCAST && mode != VISION_SHADOWCAST
+                       && mode != VISION_RAYCAST_LEGACY)) {
+    return false;
+  }
+  if (grid->visionMode == mode) {
+    return true;
+  }
+
+  grid->visionMode = mode;
+  return resetStoredVision(grid);
+}
+
+/***** grid_setLightRadius ************************************/
+/* see header file for details */
+bool
+grid_setLightRadius(grid_t* grid, int radius)
+{
+  // check params
+  if (grid == NULL || radius < 0) {
+    return false;
+  }
+  if (grid->lightRadius == radius) {
+    return true;
+  }
+
+  grid->lightRadius = radius;
+  return resetStoredVision(grid);
+}
+
+/***** grid_getLightRadius ************************************/
+/* see header file for details */
+int
+grid_getLightRadius(grid_t* grid)
+{
+  return grid ? grid->lightRadius : 0;
+}
+
+/***** grid_setRoomLit ****************************************/
+/* see header file for details */
+bool
+grid_setRoomLit(grid_t* grid, int room, bool lit)
+{
+  // check params
+  if (grid == NULL || room < 0 || room >= rooms_getNumRooms(grid->rooms)) {
+    return false;
+  }
+  if (rooms_isLit(grid->rooms, room) == lit) {
+    return true;
+  }
+
+  // the rooms are shared with every grid of the map until one is changed
+  if (! grid->ownRooms) {
+    rooms_t* copy = rooms_copy(grid->rooms);
+    if (copy == NULL) {
+      return false;
+    }
+    grid->rooms = copy;
+    grid->ownRooms = true;
+  }
+
+  rooms_setLit(grid->rooms, room, lit);
+  // without a light radius every room is seen in full anyway
+  return grid->lightRadius == 0 || resetStoredVision(grid);
+}
+
+/***** resetStoredVision **************************************/
+/* throws away any vision the grid has stored, after something it depends on
+ * has changed. A table is rebuilt the same way, and a cache starts again empty
+ * returns true on success, false on failure to rebuild the table or cache
+ */
+static bool
+resetStoredVision(grid_t* grid)
+{
+  // once the terrain has changed, start tracking again from nothing
+  if (grid->visDeps != NULL) {
+    abandonMapVision(grid);
+    visdeps_delete(grid->visDeps);
+    if ((grid->visDeps = visdeps_new(grid->mapLen, grid->numColumns)) == NULL) {
+      return false;
+    }
+  }
+
+  // a cache filled with the old settings is stale, start it again empty
+  if (grid->visCache != NULL) {
+    viscachestats_t stats;
+    viscache_getStats(grid->visCache, &stats);
+    viscache_delete(grid->visCache);
+    grid->visCache = NULL;
+    if (! grid_buildVisionCache(grid, stats.budget)) {
+      return false;
+    }
+  }
+
+  // a table built with the old settings is stale, rebuild it the same way
+  if (grid->visTable != NULL) {
+    vistable_delete(grid->visTable);
+    grid->visTable = NULL;
+    return grid_buildVisionTable(grid, grid->visTableLazy);
+  }
+  return true;
+}
+
+/***** trackVision ********************************************/
+/* starts tracking which tiles each piece of the grid's stored vision depends
+ * on, the first time its terrain changes, and records every entry stored so
+ * far. Compiled vision is tracked the same way if the grid uses it, else it
+ * is let go, as it could no longer be told apart from vision that changed
+ * returns false on failure to allocate memory, with nothing tracked
+ */
+static bool
+trackVision(grid_t* grid)
+{
+  const int* tiles = NULL;             // a stored entry
+  int count = 0;                       // number of positions in tiles
+
+  if (grid->visDeps != NULL) {
+    return true;
+  }
+  if ((grid->visDeps = visdeps_new(grid->mapLen, grid->numColumns)) == NULL) {
+    return false;
+  }
+  bool tracked = true;
+  if (usesMapVision(grid)) {
+    tracked = (grid->mapVisStale = bitset_new(grid->mapLen)) != NULL;
+    for (int pos = 0; pos < grid->mapLen && tracked; pos++) {
+      if (grid->flags[pos] & TILE_WALKABLE) {
+        const int start = grid->mapVisIndex[pos];
+        tracked = visdeps_add(grid->visDeps, pos, grid->mapVisData + start,
+                              grid->mapVisIndex[pos + 1] - start);
+      }
+    }
+  } else {
+    abandonMapVision(grid);
+  }
+  for (int pos = 0; pos < grid->mapLen && tracked && grid->visTable != NULL; pos++) {
+    if ((tiles = vistable_find(grid->visTable, pos, &count)) != NULL) {
+      tracked = visdeps_add(grid->visDeps, pos, tiles, count);
+    }
+  }
+  if (tracked && grid->visCache != NULL) {
+    trackstate_t state = { grid->visDeps, true };
+    viscache_iterate(grid->visCache, &state, trackCached);
+    tracked = state.tracked;
+  }
+
+  if ( ! tracked) {
+    bitset_delete(grid->mapVisStale);
+    grid->mapVisStale = NULL;
+    visdeps_delete(grid->visDeps);
+    grid->visDeps = NULL;
+  }
+  return tracked;
+}
+
+/***** trackCached ********************************************/
+/* viscache_iterate helper for trackVision, records one cache entry */
+static void
+trackCached(void* arg, int pos, const int* tiles, int count)
+{
+  trackstate_t* state = arg;
+
+  state->tracked = state->tracked && visdeps_add(state->deps, pos, tiles, count);
+}
+
+/***** abandonMapVision ***************************************/
+/* stops the grid using the vision compiled with its map, so that
+ * everything is calculated from its own terrain instead
+ */
+static void
+abandonMapVision(grid_t* grid)
+{
+  grid->mapVisIndex = NULL;
+  grid->mapVisData = NULL;
+  grid->mapVisionMode = -1;
+  bitset_delete(grid->mapVisStale);
+  grid->mapVisStale = NULL;
+}
+
+/***** dropVision *********************************************/
+/* throws away whatever vision the grid has stored from pos, after terrain it
+ * depends on changed, noting it to be filled again if the grid's table is
+ * eager. Takes the grid as a void* so visdeps_invalidate can call it
+ */
+static void
+dropVision(void* arg, int pos)
+{
+  grid_t* grid = arg;
+
+  if (grid->mapVisStale != NULL) {
+    bitset_set(grid->mapVisStale, pos);
+  }
+  vistable_remove(grid->visTable, pos);
+  viscache_remove(grid->visCache, pos);
+  visdeps_remove(grid->visDeps, pos);
+  if (grid->visTable == NULL || grid->visTableLazy) {
+    return;
+  }
+
+  // grow the list of dropped tiles if it is full, an entry that misses
+  // out is calculated directly instead, so a failure here changes nothing
+  if (grid->numDropped == grid->maxDropped) {
+    int maxDropped = grid->maxDropped > 0 ? 2 * grid->maxDropped : FIRSTDROPPED;
+    int* grown = mem_malloc(maxDropped * sizeof(int));
+    if (grown == NULL) {
+      return;
+    }
+    if (grid->dropped != NULL) {
+      memcpy(grown, grid->dropped, grid->numDropped * sizeof(int));
+      mem_free(grid->dropped);
+    }
+    grid->dropped = grown;
+    grid->maxDropped = maxDropped;
+  }
+  grid->dropped[grid->numDropped++] = pos;
+}
+
+/***** refillVision *******************************************/
+/* fills an eager table again from every walkable tile dropped since it was
+ * last filled, so that reading it stays free of locks
+ */
+static void
+refillVision(grid_t* grid)
+{
+  int count = 0;                       // unused, vistable_find needs it
+
+  bitset_t* scratch = grid->numDropped > 0 ? bitset_new(grid->mapLen) : NULL;
+  for (int i = 0; i < grid->numDropped && scratch != NULL; i++) {
+    const int pos = grid->dropped[i];
+    if ((grid->flags[pos] & TILE_WALKABLE) && ! mapVisionHolds(grid, pos)
+        && vistable_find(grid->visTable, pos, &count) == NULL) {
+      fillVisionEntry(grid, pos, scratch);
+    }
+  }
+  bitset_delete(scratch);
+  grid->numDropped = 0;
+}
+
+/***** calculateVisionEngine **********************************/
+/* clears visible, then calculates vision from pos into it
+ * with whichever algorithm the grid is set to use
+ * visible must hold at least mapLen bits, any bit past mapLen is left clear
+ * With a light radius, only the square of tiles within reach is scanned,
+ * stretched to cover the viewer's room if that room is lit
+ */
+static void
+calculateVisionEngine(grid_t* grid, int pos, bitset_t* visible)
+{
+  int reach = grid->lightRadius;       // how far out to scan, 0 for the whole map
+  int room = -1;                       // lit room the viewer is in, -1 if none
+
+  // in a rectangular room shadowcasting sees no more than the room and its
+  // walls, the raycast carries on out from them
+  bitset_clear(visible);
+  if (calculateVisionRoom(grid, pos, visible) && grid->visionMode == VISION_SHADOWCAST) {
+    return;
+  }
+
+  // a lit room is seen in full, however far away its walls are
+  if (grid->lightRadius > 0) {
+    room = rooms_getRoom(grid->rooms, pos);
+    if (rooms_isLit(grid->rooms, room)) {
+      int roomReach = litRoomReach(grid, pos, room);
+      reach = roomReach > reach ? roomReach : reach;
+    } else {
+      room = -1;
+    }
+  }
+
+  if (grid->visionMode == VISION_SHADOWCAST) {
+    calculateVisionShadowcast(grid, pos, visible, reach);
+  } else if (grid->visionMode == VISION_RAYCAST_LEGACY) {
+    // the legacy raycast allocates its blocked set with the mem_* counters,
+    // so threads take turns running it
+    pthread_mutex_lock(&grid->visionLock);
+    calculateVisionRaycastLegacy(grid, pos, visible);
+    pthread_mutex_unlock(&grid->visionLock);
+  } else {
+    calculateVisionRaycast(grid, pos, visible, reach);
+  }
+  // the raycast can mark the spare slot past the end of the map
+  bitset_unset(visible, grid->mapLen);
+
+  if (grid->lightRadius > 0) {
+    clipToLight(grid, pos, room, visible);
+  }
+}
+
+/***** calculateVisionRoom ************************************/
+/* fast path for a viewer standing in a rectangular room (see rooms.h)
+ * marks the room and the ring of walls and doorways around it visible
+ * Under shadowcasting that is all there is to see, as doorways are passage
+ * tiles, which block sight just like walls. The raycast goes on to cast rays
+ * past the ring, and skips the tiles marked here as already visible
+ * The legacy raycast is left alone, see calculateVisionRaycastLegacy
+ * returns true if pos is in such a room and its tiles were marked,
+ * false if vision has to be calculated the long way
+ */
+static bool
+calculateVisionRoom(grid_t* grid, int pos, bitset_t* visible)
 {
-  // check param existence
-  if (grid->active == NULL || grid->reference == NULL) {
+  int left, top, right, bottom;        // bounds of the viewer's room
+
+  if( grid->visionMode == VISION_RAYCAST_LEGACY ){
     return false;
   }
-  // check if pos is out of bounds
-  if (pos < 0 || pos > grid->mapLen - 1) {
+  int room = rooms_getRoom(grid->rooms, pos);
+  if( ! rooms_isRectangular(grid->rooms, room) ){
     return false;
   }
+  rooms_getBounds(grid->rooms, room, &left, &top, &right, &bottom);
+  int minX = left - 1, maxX = right + 1;
+  int minY = top - 1, maxY = bottom + 1;
+
+  // a dark room is only seen as far as the light reaches
+  if( grid->lightRadius > 0 && ! rooms_isLit(grid->rooms, room) ){
+    int posX = pos % (grid->numColumns + 1);
+    int posY = pos / (grid->numColumns + 1);
+    minX = posX - grid->lightRadius > minX ? posX - grid->lightRadius : minX;
+    maxX = posX + grid->lightRadius < maxX ? posX + grid->lightRadius : maxX;
+    minY = posY - grid->lightRadius > minY ? posY - grid->lightRadius : minY;
+    maxY = posY + grid->lightRadius < maxY ? posY + grid->lightRadius : maxY;
+  }
 
-  // set 'active' character at given pos to reference value and return
-  grid->active[pos] = grid->reference[pos];
+  // mark the box and its ring a row at a time
+  for(int y = minY; y <= maxY; y++){
+    int rowStart = y * (grid->numColumns + 1);
+    for(int x = minX; x <= maxX; x++){
+      VISIT();
+      bitset_set(visible, rowStart + x);
+    }
+  }
   return true;
 }
 
-/**************** grid_delete ***************/
-/* see header file for details */
-void grid_delete(grid_t* grid)
+/***** litRoomReach *******************************************/
+/* how far out from pos vision has to be scanned to take in the whole of
+ * the given room and the walls around it
+ */
+static int
+litRoomReach(grid_t* grid, int pos, int room)
 {
-  // free strings if they exist
-  if (grid->active != NULL) {
-    mem_free(grid->active);
-  }
-
-  if (grid->reference != NULL) {
-    mem_free(grid->reference);
+  int left, top, right, bottom;        // bounds of the room
+  int reach = 0;                       // farthest the room's walls get
+
+  rooms_getBounds(grid->rooms, room, &left, &top, &right, &bottom);
+  int posX = pos % (grid->numColumns + 1);
+  int posY = pos / (grid->numColumns + 1);
+  int sides[4] = { posX - left, right - posX, posY - top, bottom - posY };
+  for(int i = 0; i < 4; i++){
+    reach = sides[i] > reach ? sides[i] : reach;
   }
+  return reach + 1;
+}
 
-  if (grid->mapfile != NULL) {
-    mem_free(grid->mapfile);
+/***** clipToLight ********************************************/
+/* takes every tile out of visible that is further than the light radius
+ * from pos, except for those in (or in the walls of) the given lit room,
+ * which is -1 if the viewer isn't in one
+ * distance is counted in moves, diagonals included, so the light is a square
+ */
+static void
+clipToLight(grid_t* grid, int pos, int room, bitset_t* visible)
+{
+  const int stride = grid->numColumns + 1;  // distance between rows
+  const int posX = pos % stride;
+  const int posY = pos / stride;
+
+  for(int tile = bitset_next(visible, 0); tile >= 0; tile = bitset_next(visible, tile + 1)){
+    int dx = abs(tile % stride - posX);
+    int dy = abs(tile / stride - posY);
+    if( (dx > grid->lightRadius || dy > grid->lightRadius) && ! inRoomOrRing(grid, room, tile) ){
+      bitset_unset(visible, tile);
+    }
   }
-
-  // then free the struct itself
-  mem_free(grid);
 }
 
-/************* findLongestRow **************/
-/* Takes a given string
- * which should be the in-memory representation of the in-game map
- * and returns the length of the longest "row" (without the new line character)
+/***** inRoomOrRing *******************************************/
+/* true if pos is floor of the given room, or a wall or doorway next to it
+ * false if room is -1
  */
-static int longestRowLength(char* map)
+static bool
+inRoomOrRing(grid_t* grid, int room, int pos)
 {
-  size_t mapLen = 0;                   // length of the map string
-  int rowLen = 0;                      // length of current "row" in map
-  int rowMax = 0;                      // length of longest "row" in map
-
-  // store len for loop
-  mapLen = strlen(map);
+  const int stride = grid->numColumns + 1;  // distance between rows
 
-  // read the entire map
-  for (int i = 0; i < mapLen; i++) {
-    // when reaching the end of a "row"
-    if (map[i] == '\n') {
-      // update max row length if needed
-      if (rowLen > rowMax) {
-        rowMax = rowLen;
+  if( room < 0 ){
+    return false;
+  }
+  if( rooms_getRoom(grid->rooms, pos) == room ){
+    return true;
+  }
+  if( grid->flags[pos] & TILE_ROOM ){
+    return false;
+  }
+  for(int dy = -1; dy <= 1; dy++){
+    for(int dx = -1; dx <= 1; dx++){
+      int x = pos % stride + dx;
+      int y = pos / stride + dy;
+      if( x >= 0 && x < stride && y >= 0 && rooms_getRoom(grid->rooms, y * stride + x) == room ){
+        return true;
       }
-      // reset length of current row for next iteration
-      rowLen = 0;
-    } else {
-      // increment length of row if not at end
-      rowLen++;
     }
   }
-
-  return rowMax;
+  return false;
 }
 
-/* ************************ VISION ************************** */
-
-/***** local vision functions *********************************/
-
-/***** posToCoordinates ***************************************/
-/* converts the position integer into cartesian coordinates to make mathematic manipulation easier */
+/***** calculateVisionRaycast *********************************/
+/* Calculates a player's current vision, adding every tile visible from pos
+ * to the given set, which must start out empty or hold only the viewer's
+ * room and ring from calculateVisionRoom. Tiles already in it get no ray
+ * The same algorithm as calculateVisionRaycastLegacy, a ray from pos to every
+ * tile not yet visited, but done entirely in integers. Each ray steps one tile
+ * at a time along its longer axis, and where it crosses the other axis is kept
+ * as an exact fraction, so whether it lands on a tile, which two tiles it
+ * passes between, and which of those is nearer are decided exactly,
+ * the same way on every compiler and machine
+ * Rays step through the map string by position offsets, one along the
+ * longer axis each step, and one along the other when the fraction wraps
+ * If reach > 0, rays are only cast to tiles at most reach rows and columns
+ * from pos, so the cost doesn't grow with the size of the map
+ */
 static void
-posToCoordinates(grid_t* grid, int pos, int* tuple)
+calculateVisionRaycast(grid_t* grid, int pos, bitset_t* visible, int reach)
 {
-  // check arguments
-  if( grid == NULL || pos < 0 ){
+  // check parameters
+  if( grid == NULL || visible == NULL || pos < 0 || grid->reference == NULL ){
     return;
-  } 
-  
-  // calculate coordinates, assumes pos is zero indexed
-  int x = (pos % (grid->numColumns + 1)); // add one for new line character not counter in numColumns
-  int y = (pos / (grid->numColumns + 1));
-  tuple[0] = x;
-  tuple[1] = y;
-  
-  // test print statement
-  //fprintf(stdout, "pos %d -> coord: (%d,%d)\n", pos, x, y);
+  }
 
-  return;
-}
+  const char* reference = grid->reference;
+  const uint8_t* flags = grid->flags;
+  const int stride = grid->numColumns + 1;   // distance between rows
+  const int mapLen = grid->mapLen;
+  const int steps = reach > 0 ? reach : mapLen;  // longest straight ray
+  bool wallFound;                            // true once a ray hits a wall
+
+  // tiles found to be hidden behind a wall. A tile is "visited" once it is
+  // either visible or blocked, and visited tiles don't get a ray of their own
+  // plain calloc, as any thread may calculate vision (see workpool.h)
+  const size_t numWords = mapLen / 64 + 1;   // a bit for the spare slot too
+  if( rayBlockedWords < numWords ){
+    uint64_t* grown = calloc(numWords, sizeof(uint64_t));
+    if( grown == NULL ){
+      return;
+    }
+    free(rayBlocked);
+    rayBlocked = grown;
+    rayBlockedWords = numWords;
+  }
+  uint64_t* blocked = rayBlocked;
 
-/***** coordinatesToPos ***************************************/
-/* converts cartesian coordinates back into an integer representation */
-static int
-coordinatesToPos(grid_t* grid, int x, int y)
-{
-  if( grid == NULL || x < 0 || y < 0 ){
-    return -1;
+  bitset_set(visible, pos);
+
+  // straight up, down, right and left first, each stopping at its first wall
+  wallFound = false;
+  for(int up = pos - stride, n = 1; up > 0 && n <= steps; up -= stride, n++){
+    wallFound = raycastStraight(flags, up, wallFound, visible, blocked);
+  }
+  wallFound = false;
+  for(int down = pos + stride, n = 1; down < mapLen && n <= steps; down += stride, n++){
+    wallFound = raycastStraight(flags, down, wallFound, visible, blocked);
+  }
+  wallFound = false;
+  for(int right = pos + 1; right < mapLen && reference[right] != '\n' && right - pos <= steps; right++){
+    wallFound = raycastStraight(flags, right, wallFound, visible, blocked);
+  }
+  wallFound = false;
+  for(int left = pos - 1; left >= 0 && reference[left] != '\n' && pos - left <= steps; left--){
+    wallFound = raycastStraight(flags, left, wallFound, visible, blocked);
   }
-  
-  // where y in the row and x is the column
-  int pos = (y * (grid->numColumns + 1)) + x; // add one to numColumns to account for the new line character
-  
-  // test print statement
-  //fprintf(stdout, "coord (%d,%d) -> pos: %d\n", x, y, pos);
 
-  return pos;
+  // then a ray to every tile not yet visited, in map order
+  const int posX = pos % stride;
+  const int posY = pos / stride;
+  int minX = 0, maxX = stride - 1;
+  int minY = 0, maxY = (mapLen - 1) / stride;
+  if( reach > 0 ){
+    minX = posX - reach > minX ? posX - reach : minX;
+    maxX = posX + reach < maxX ? posX + reach : maxX;
+    minY = posY - reach > minY ? posY - reach : minY;
+    maxY = posY + reach < maxY ? posY + reach : maxY;
+  }
+  const int first = minY * stride + minX;    // first and last tile a ray
+  const int last = maxY * stride + maxX;     // can reach, or pass over
+  for(int i = first; i < mapLen && i <= last; i++){
+    if( i % stride < minX || i % stride > maxX ){
+      continue;
+    }
+    if( bitset_test(visible, i) || BLOCKED(blocked, i) ){
+      continue;
+    }
+    int dx = i % stride - posX;
+    int dy = i / stride - posY;
+
+    // step along x unless the ray is steeper than a diagonal
+    bool alongX = abs(dy) <= abs(dx);
+    int steps = alongX ? abs(dx) : abs(dy);          // tiles along the major axis
+    int majorStep = ((alongX ? dx : dy) > 0 ? 1 : -1) * (alongX ? 1 : stride);
+    int minorStep = alongX ? stride : 1;             // offset of one more minor
+    int minorDelta = alongX ? dy : dx;
+
+    // the minor coordinate is the viewer's plus minorDelta * step / steps,
+    // kept as the tile the ray is on or just past, and a remainder
+    int onTile = pos;
+    int rest = 0;
+    wallFound = false;
+    for(int step = 1; step <= steps; step++){
+      onTile += majorStep;
+      rest += minorDelta;
+      if( rest >= steps ){
+        rest -= steps;
+        onTile += minorStep;
+      } else if( rest < 0 ){
+        rest += steps;
+        onTile -= minorStep;
+      }
+      VISIT();
+
+      // the ray is on one tile, or between two where the nearer decides
+      // past the end of a short last row is the spare slot, a wall
+      int pos1 = onTile;
+      int pos2 = rest == 0 ? onTile : onTile + minorStep;
+      int midPos = 2 * rest >= steps ? onTile + minorStep : onTile;
+      pos1 = pos1 > mapLen ? mapLen : pos1;
+      pos2 = pos2 > mapLen ? mapLen : pos2;
+      midPos = midPos > mapLen ? mapLen : midPos;
+
+      if( ! wallFound ){
+        // both tiles are seen, and a wall in between stops the ray
+        bitset_set(visible, pos1);
+        bitset_set(visible, pos2);
+        wallFound = ! (flags[midPos] & TILE_TRANSPARENT);
+      } else {
+        if( ! bitset_test(visible, pos1) ){
+          SET_BLOCKED(blocked, pos1);
+        }
+        if( ! bitset_test(visible, pos2) ){
+          SET_BLOCKED(blocked, pos2);
+        }
+      }
+    }
+  }
+
+  // every ray stayed between the viewer and a tile from first to last,
+  // or hit the spare slot, so only those words need clearing for next time
+  const int lastBit = last < mapLen ? last : mapLen;
+  memset(blocked + first / 64, 0, (lastBit / 64 - first / 64 + 1) * sizeof(uint64_t));
 }
 
-/***** VISION GLOBAL FUNCTION *********************************/
+/***** raycastStraight ****************************************/
+/* one tile of a straight ray in calculateVisionRaycast: the tile is visible
+ * until the ray has found a wall, and hidden after that
+ * returns whether the ray has found a wall, counting this tile
+ */
+static bool
+raycastStraight(const uint8_t* flags, int pos, bool wallFound,
+                bitset_t* visible, uint64_t* blocked)
+{
+  VISIT();
+  if( wallFound ){
+    SET_BLOCKED(blocked, pos);
+    return true;
+  }
+  bitset_set(visible, pos);
+  return ! (flags[pos] & TILE_ROOM);
+}
 
-/***** calculateVision ****************************************/
-/* Calculates a player's current vision, 
- * modifies a given integer array representing the player's vision
+/***** calculateVisionRaycastLegacy ***************************/
+/* The original raycast, which walks each ray with floating point slopes
+ * kept as VISION_RAYCAST_LEGACY to check calculateVisionRaycast against,
+ * see "make visionregress"
+ * Calculates a player's current vision, 
+ * adding every tile visible from pos to the given set
  * Parameters:  pos - a player's current position
  *              grid - the grid struct for the map
- *              vision - an integer array with values -1 (not visible), 0 (unvisited) or 1 (visible)
+ *              visible - the set of visible tiles, which must start out empty
  *
  * Returns:     void
  */
-void
-grid_calculateVision(grid_t* grid, int pos, int* vision)
+static void
+calculateVisionRaycastLegacy(grid_t* grid, int pos, bitset_t* visible)
 { 
   // check parameters
-  if( grid == NULL || vision == NULL || pos < 0 ){
+  if( grid == NULL || visible == NULL || pos < 0 ){
+    return;
+  }
+
+  // tiles found to be hidden behind a wall. A tile is "visited" once it is
+  // either visible or blocked, and visited tiles don't get a ray of their own
+  bitset_t* blocked = bitset_new(grid->mapLen);
+  if( blocked == NULL ){
     return;
   }
 
   // set player position to visible
-  vision[pos] = 1; 
+  bitset_set(visible, pos); 
   // map we check values with, used reference because we don't care about players or gold at this point, but active would also work
   char* reference = grid_getReference(grid);
 
@@ -324,13 +2285,13 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
 
   while( up > 0 ){ // while we are still within the map
     if(reference[up] == ROOMTILE && !wallFound){ // marks room squares
-      vision[up] = 1;
+      bitset_set(visible, up);
     } 
     else if(reference[up] != ROOMTILE && !wallFound){ // marks first obstruction in this direction
-      vision[up] = 1;
+      bitset_set(visible, up);
       wallFound = true;
     } else {    // marks non-visible 
-      vision[up] = -1;
+      bitset_set(blocked, up);
     }
 
     up -= (grid->numColumns + 1); // parentheses for readability
@@ -341,13 +2302,13 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
   int down = pos + (grid->numColumns + 1);
   while( down < grid->mapLen ){
     if(reference[down] == ROOMTILE && !wallFound){
-      vision[down] = 1;
+      bitset_set(visible, down);
     }
     else if(reference[down] != ROOMTILE && !wallFound){
-      vision[down] = 1;
+      bitset_set(visible, down);
       wallFound = true;
     } else {
-      vision[down] = -1;
+      bitset_set(blocked, down);
     }
 
     down += (grid->numColumns + 1);
@@ -359,15 +2320,15 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
   // LEAVE BE, fixes as bug where reference is unexpectedly not able to be referenced 
   reference = grid_getReference(grid);
 
-  while( reference[right] != '\n' ){ // within the current line
+  while( right < grid->mapLen && reference[right] != '\n' ){ // within the current line
     if(reference[right] == ROOMTILE && !wallFound){
-      vision[right] = 1;
+      bitset_set(visible, right);
     }
     else if(reference[right] != ROOMTILE && !wallFound){
-      vision[right] = 1;
+      bitset_set(visible, right);
       wallFound = true;
     } else {
-      vision[right] = -1;
+      bitset_set(blocked, right);
     }
 
     right++;
@@ -376,15 +2337,15 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
   // left
   wallFound = false;
   int left = pos - 1;
-  while( reference[left] != '\n' && left >= 0 ){
+  while( left >= 0 && reference[left] != '\n' ){
     if(reference[left] == ROOMTILE && !wallFound){
-      vision[left] = 1;
+      bitset_set(visible, left);
     }
     else if(reference[left] != ROOMTILE && !wallFound){
-      vision[left] = 1;
+      bitset_set(visible, left);
       wallFound = true;
     } else {
-      vision[left] = -1;
+      bitset_set(blocked, left);
     }
 
     left--;
@@ -402,7 +2363,7 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
     // grabbing reference grid, fixes issue where we are unexpectedly unable to use the reference grid
     reference = grid_getReference(grid);
     wallFound = false;
-    if( vision[i] == 0 ){ // point hasn't been visited
+    if( ! bitset_test(visible, i) && ! bitset_test(blocked, i) ){ // point hasn't been visited
       posToCoordinates(grid, i, pointCoor);
 
       // slope formula
@@ -450,14 +2411,14 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
             }
 
             if( (reference[currPos] == ROOMTILE || isalpha(reference[currPos]) != 0) && !wallFound ){  // check if room tile or player
-              vision[currPos] = 1;
+              bitset_set(visible, currPos);
             }
             else if( reference[currPos] != ROOMTILE && !wallFound ){ // check if this is the first wall we've seen
-              vision[currPos] = 1;
+              bitset_set(visible, currPos);
               wallFound = true;
             } else { // otherwise we've already seen a wall, so this point is not visible
-              if(vision[currPos] == 0){
-                vision[currPos] = -1;
+              if( ! bitset_test(visible, currPos) && ! bitset_test(blocked, currPos) ){
+                bitset_set(blocked, currPos);
               }
             }
           } else { // the more likely case currVal falls between two points and we need to check both
@@ -475,20 +2436,20 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
             }
             
             if( (reference[midPos] == ROOMTILE || isalpha(reference[mid]) != 0) && !wallFound ){ // haven't hit a wall yet, and current position is between room tiles
-              vision[pos1] = 1;
-              vision[pos2] = 1;
+              bitset_set(visible, pos1);
+              bitset_set(visible, pos2);
             }
             else if(!wallFound){ // haven't found a wall yet, but the current position hits a wall
-              vision[pos1] = 1;
-              vision[pos2] = 1;
+              bitset_set(visible, pos1);
+              bitset_set(visible, pos2);
               wallFound = true;
 
             } else { // we've already see a wall, current position is not visible
-              if(vision[pos1] == 0){
-                vision[pos1] = -1;
+              if( ! bitset_test(visible, pos1) && ! bitset_test(blocked, pos1) ){
+                bitset_set(blocked, pos1);
               }
-              if(vision[pos2] == 0){
-                vision[pos2] = -1;
+              if( ! bitset_test(visible, pos2) && ! bitset_test(blocked, pos2) ){
+                bitset_set(blocked, pos2);
               }
             }
           }
@@ -526,14 +2487,14 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
             }
 
             if( (reference[currPos] == ROOMTILE || isalpha(currPos) != 0 ) && !wallFound ){
-              vision[currPos] = 1;
+              bitset_set(visible, currPos);
             }
             else if( reference[currPos] != ROOMTILE && !wallFound ){
-              vision[currPos] = 1;
+              bitset_set(visible, currPos);
               wallFound = true;
             } else {
-              if(vision[currPos] == 0){
-              vision[currPos] = -1;
+              if( ! bitset_test(visible, currPos) && ! bitset_test(blocked, currPos) ){
+              bitset_set(blocked, currPos);
               }
             }
           } else { // otherwise the point falls between two points in the map and we must check both
@@ -552,19 +2513,19 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
             }
             
             if( (reference[midPos] == ROOMTILE || isalpha(reference[midPos]) != 0 ) && !wallFound){
-              vision[pos1] = 1;
-              vision[pos2] = 1;
+              bitset_set(visible, pos1);
+              bitset_set(visible, pos2);
             }
             else if(!wallFound){
-              vision[pos1] = 1;
-              vision[pos2] = 1;
+              bitset_set(visible, pos1);
+              bitset_set(visible, pos2);
               wallFound = true;
             } else {
-              if(vision[pos1] == 0){
-                vision[pos1] = -1;
+              if( ! bitset_test(visible, pos1) && ! bitset_test(blocked, pos1) ){
+                bitset_set(blocked, pos1);
               }
-              if(vision[pos2] == 0){
-                vision[pos2] = -1;
+              if( ! bitset_test(visible, pos2) && ! bitset_test(blocked, pos2) ){
+                bitset_set(blocked, pos2);
               }
             }
           } 
@@ -574,13 +2535,137 @@ grid_calculateVision(grid_t* grid, int pos, int* vision)
     }
   }
   
+  bitset_delete(blocked);
   return;
 }
 
 
+/***** calculateVisionShadowcast *****************************/
+/* Calculates vision from pos using symmetric recursive shadowcasting
+ * (as described by Albert Ford), and sets every visible tile in vision to 1
+ * The area around pos is split into four quadrants. Each quadrant is scanned
+ * one row at a time moving away from pos, keeping only the range of slopes
+ * that is not yet blocked by a wall, so each visible tile is visited about once
+ * Room tiles are transparent, anything else is a wall that is itself visible
+ * Slopes are kept as exact fractions, so there is no floating point rounding
+ * If reach > 0, only the first reach rows of each quadrant are scanned
+ */
+static void
+calculateVisionShadowcast(grid_t* grid, int pos, bitset_t* visible, int reach)
+{
+  shadowscan_t scan;                   // state shared by one quadrant's scan
+
+  // check parameters
+  if( grid == NULL || visible == NULL || pos < 0 || pos >= grid->mapLen ){
+    return;
+  }
+
+  // the viewer can always see their own tile
+  bitset_set(visible, pos);
+
+  // the padded map has a border of walls one tile thick, and a scan only goes
+  // on past floor, so it never steps further than that border
+  const int stride = grid->numColumns + 1;
+  const int width = grid->paddedStride;
+  scan.padded = grid->padded;
+  scan.paddedShift = grid->paddedShift;
+  scan.stride = stride;
+  scan.visible = visible;
+  scan.origin = (pos / stride + 1) * width + (pos % stride + 1);
+  scan.maxDepth = reach;
+
+  // each quadrant starts one row out, covering slopes -1 to 1
+  // rows step away from the viewer, columns across, north east south west
+  const int depthSteps[4] = { -width, 1, width, -1 };
+  const int colSteps[4] = { 1, width, 1, width };
+  for (int quadrant = 0; quadrant < 4; quadrant++) {
+    scan.depthStep = depthSteps[quadrant];
+    scan.colStep = colSteps[quadrant];
+    shadowcastRow(&scan, 1, -1, 1, 1, 1);
+  }
+}
+
+/***** shadowcastRow ******************************************/
+/* scans the row at the given depth of the current quadrant, between the
+ * slopes startNum/startDen and endNum/endDen (denominators are positive)
+ * recursing into the next row for every unblocked run of transparent tiles
+ */
+static void
+shadowcastRow(shadowscan_t* scan, int depth, int startNum, int startDen, 
+              int endNum, int endDen)
+{
+  const int NONE = 0, WALL = 1, FLOOR = 2;  // kinds of the previous tile
+  int prev = NONE;                     // kind of the previous tile in the row
+
+  // rows past the reach of the scan are left dark
+  if (scan->maxDepth > 0 && depth > scan->maxDepth) {
+    return;
+  }
+
+  // columns covered by the row, rounding ties towards the middle of the row
+  // that is floor(depth * start + 1/2) to ceil(depth * end - 1/2)
+  int minCol = floorDiv(2 * depth * startNum + startDen, 2 * startDen);
+  int maxCol = -floorDiv(endDen - 2 * depth * endNum, 2 * endDen);
+  const int rowIndex = scan->origin + depth * scan->depthStep;
+
+  for (int col = minCol; col <= maxCol; col++) {
+    const int index = rowIndex + col * scan->colStep;
+    const char tile = scan->padded[index];
+    VISIT();
+    // anything off the map blocks vision like a wall, but isn't drawn
+    const bool offMap = tile == MAPCACHE_OFFMAP;
+    const bool wall = ! TILE_IS(tile, TILE_TRANSPARENT);
+
+    // walls are always seen, floors only if the viewer is within their slopes
+    // which keeps vision symmetric: if A sees B, B sees A
+    if (! offMap && (wall || (col * startDen >= depth * startNum 
+                              && col * endDen <= depth * endNum))) {
+      bitset_set(scan->visible, paddedToPos(scan, index));
+    }
+
+    // a run of floor starts after a wall, narrow the start slope
+    if (prev == WALL && ! wall) {
+      startNum = 2 * col - 1;
+      startDen = 2 * depth;
+    }
+    // a run of floor ends at a wall, scan the next row behind that run
+    if (prev == FLOOR && wall) {
+      shadowcastRow(scan, depth + 1, startNum, startDen, 2 * col - 1, 2 * depth);
+    }
+    prev = wall ? WALL : FLOOR;
+  }
+
+  // row ended on floor, so the last run continues into the next row
+  if (prev == FLOOR) {
+    shadowcastRow(scan, depth + 1, startNum, startDen, endNum, endDen);
+  }
+}
+
+/***** paddedToPos ********************************************/
+/* converts an index into the padded map back into a map position
+ * the stride of the padded map is a power of 2, so this takes no division
+ */
+static int
+paddedToPos(shadowscan_t* scan, int index)
+{
+  const int x = (index & ((1 << scan->paddedShift) - 1)) - 1;
+  const int y = (index >> scan->paddedShift) - 1;
+  return y * scan->stride + x;
+}
+
+/***** floorDiv ***********************************************/
+/* integer division rounding down rather than towards zero, den must be > 0 */
+static int
+floorDiv(int num, int den)
+{
+  return (num >= 0) ? (num / den) : -((den - num - 1) / den);
+}
+
 /* ********************************************************** */
 /* a simple unit test of the code above */
 #ifdef GRIDTEST
+static bool componentsMatchFlood(grid_t* grid);
+
 int main(const int argc, char* argv[])
 {
   FILE* fp = NULL;                     // map file to read from
@@ -630,7 +2715,130 @@ int main(const int argc, char* argv[])
   grid_revertTile(grid, 2);
 
   printf("Active map after reversion: \n%s\n", active);
+
+  // test the change log, only real changes should be logged
+  int numChanges = 0;
+  if( grid_trackChanges(grid, 2) ){
+    grid_replace(grid, 5, '!');
+    grid_replace(grid, 5, '!');
+    grid_revertTile(grid, 2);
+    const int* changes = grid_getChanges(grid, &numChanges);
+    printf("Logged %d change(s), first at %d\n", numChanges, changes ? changes[0] : -1);
+    grid_revertTile(grid, 5);
+    grid_replace(grid, 2, '3');
+    changes = grid_getChanges(grid, &numChanges);
+    printf("Change log %s after too many changes\n", changes ? "kept" : "overflowed");
+    grid_clearChanges(grid);
+    grid_revertTile(grid, 2);
+  }
   
+  // test room segmentation
+  rooms_t* rooms = grid_getRooms(grid);
+  int rectangular = 0;
+  for( int i = 0; i < rooms_getNumRooms(rooms); i++ ){
+    if( rooms_isRectangular(rooms, i) ){
+      rectangular++;
+    }
+  }
+  printf("Found %d room(s), %d rectangular\n", rooms_getNumRooms(rooms), rectangular);
+
+  // test the item and entity planes, and that the active map shows them
+  int floorTile = strchr(reference, '.') - reference;
+  grid_placeItem(grid, floorTile, '*');
+  grid_placeEntity(grid, floorTile + 1, 'A');
+  printf("Planes %s\n", (grid_getActive(grid)[floorTile] == '*'
+                         && grid_getActive(grid)[floorTile + 1] == 'A'
+                         && ! grid_isEmptyTile(grid, floorTile)) ? "composed" : "NOT composed");
+
+  // test the index of empty tiles against scanning for them
+  int scanned = grid_countEmptyTiles(grid);
+  bool indexed = grid_indexEmptyTiles(grid) && grid_countEmptyTiles(grid) == scanned;
+  grid_placeEntity(grid, floorTile + 2, 'B');
+  indexed = indexed && grid_countEmptyTiles(grid) == scanned - 1
+    && grid_isEmptyTile(grid, grid_randomEmptyTile(grid));
+  grid_placeEntity(grid, floorTile + 2, '\0');
+  printf("Empty tile index %s scanning\n", indexed ? "matches" : "DIFFERS from");
+
+  // test the run table against walking each run, before and after moves
+  grid_t* walker = grid_new(argv[1]);
+  grid_placeItem(walker, floorTile, '*');
+  grid_placeEntity(walker, floorTile + 1, 'A');
+  bool runsMatch = walker != NULL && grid_buildRunTable(grid);
+  for( int round = 0; round < 3 && runsMatch; round++ ){
+    for( int pos = 0; pos < grid->mapLen; pos++ ){
+      for( int dir = 0; dir < NUM_DIRECTIONS; dir++ ){
+        runsMatch = runsMatch && grid_getRunLength(grid, pos, dir) == grid_getRunLength(walker, pos, dir);
+      }
+    }
+    // move the entity along the row, the second time onto the item
+    int at = floorTile + 1 - round;
+    grid_moveEntity(grid, at, at - 1);
+    grid_moveEntity(walker, at, at - 1);
+  }
+  printf("Run table %s walking\n", runsMatch ? "matches" : "DIFFERS from");
+  grid_delete(walker);
+
+  // test a chunked grid against a whole one, blanked as a player's vision
+  // starts, given the same writes
+  grid_t* chunked = grid_newChunked(argv[1], ' ');
+  grid_t* whole = grid_new(argv[1]);
+  char* wholeActive = grid_getActive(whole);
+  for( int pos = 0; pos < whole->mapLen; pos++ ){
+    if( wholeActive[pos] != '\n' ){
+      wholeActive[pos] = ' ';
+    }
+  }
+  bool chunksMatch = chunked != NULL && chunkmap_getNumChunks(chunked->chunks) == 0
+    && strcmp(grid_getActive(chunked), grid_getActive(whole)) == 0;
+  for( int i = 0; i < 500 && chunksMatch; i++ ){
+    int pos = (i * 7919) % whole->mapLen;
+    if( i % 5 == 0 ){
+      grid_revertTile(chunked, pos);
+      grid_revertTile(whole, pos);
+    } else {
+      grid_replace(chunked, pos, "@.* "[i % 4]);
+      grid_replace(whole, pos, "@.* "[i % 4]);
+    }
+    chunksMatch = grid_getTile(chunked, pos) == grid_getTile(whole, pos);
+  }
+  grid_placeItem(chunked, floorTile, '*');
+  grid_placeItem(whole, floorTile, '*');
+  chunksMatch = chunksMatch && strcmp(grid_getActive(chunked), grid_getActive(whole)) == 0;
+  printf("Chunked grid %s whole grid\n", chunksMatch ? "matches" : "DIFFERS from");
+  grid_delete(chunked);
+  grid_delete(whole);
+  grid_placeEntity(grid, floorTile - 1, '\0');
+  grid_placeItem(grid, floorTile, '\0');
+
+  // test the components against a flood fill, then again after terrain
+  // changes that open and close tiles all over a second grid's map
+  grid_t* dug = grid_new(argv[1]);
+  bool componentsMatch = dug != NULL && grid_indexEmptyTiles(dug) && componentsMatchFlood(grid)
+    && grid_isReachable(grid, floorTile, floorTile) && ! grid_isReachable(grid, floorTile, -1);
+  for( int i = 0; i < 200 && componentsMatch; i++ ){
+    int pos = (i * 7919) % dug->mapLen;
+    if( dug->reference[pos] != '\n' ){
+      componentsMatch = grid_setTerrain(dug, pos, " .#-"[i % 4]);
+    }
+  }
+  componentsMatch = componentsMatch && componentsMatchFlood(dug)
+    && grid_getComponents(grid) != grid_getComponents(dug) && componentsMatchFlood(grid);
+  printf("Components %s flood fill\n", componentsMatch ? "match" : "DIFFER from");
+
+  // test that tiles picked from the main area stay in it, and that the
+  // index counts exactly the empty tiles there, on the map dug up above
+  int mainEmpty = 0;
+  for( int pos = 0; dug != NULL && pos < dug->mapLen; pos++ ){
+    mainEmpty += grid_isEmptyTile(dug, pos) && inMainArea(dug, pos);
+  }
+  bool mainPicks = dug != NULL && dug->numEmptyMain == mainEmpty;
+  for( int i = 0; i < 100 && mainPicks; i++ ){
+    int pick = grid_randomMainEmptyTile(dug);
+    mainPicks = mainEmpty == 0 ? pick == -1 : grid_isEmptyTile(dug, pick) && inMainArea(dug, pick);
+  }
+  printf("Main area picks %s the largest component\n", mainPicks ? "stay in" : "LEAVE");
+  grid_delete(dug);
+
   // test containsEmptyTile function
   if( grid_containsEmptyTile(grid) ){
     printf("Successfully detected empty tile\n");
@@ -642,13 +2850,77 @@ int main(const int argc, char* argv[])
   // exit successfully after test completion
   exit(0);
 }
+
+// floods out from every walkable tile in turn, following the move masks,
+// and checks each tile reached is reachable from the start and nothing
+// else is, which takes time in proportion to the square of the map
+static bool
+componentsMatchFlood(grid_t* grid)
+{
+  int* stack = malloc(grid->mapLen * sizeof(int));
+  bool* reached = malloc(grid->mapLen);
+  bool match = stack != NULL && reached != NULL;
+  for( int start = 0; start < grid->mapLen && match; start++ ){
+    if( (grid->flags[start] & TILE_WALKABLE) == 0 ){
+      match = ! grid_isReachable(grid, start, start);
+      continue;
+    }
+    memset(reached, false, grid->mapLen);
+    int top = 0;
+    stack[top++] = start;
+    reached[start] = true;
+    while( top > 0 ){
+      int pos = stack[--top];
+      for( int dir = 0; dir < NUM_DIRECTIONS; dir++ ){
+        int next = pos + grid->stepOffsets[dir];
+        if( (grid->moves[pos] & MOVE_BIT(dir)) && ! reached[next] ){
+          reached[next] = true;
+          stack[top++] = next;
+        }
+      }
+    }
+    for( int pos = 0; pos < grid->mapLen && match; pos++ ){
+      match = grid_isReachable(grid, start, pos) == reached[pos];
+    }
+  }
+  free(stack);
+  free(reached);
+  return match;
+}
 #endif
 
 #ifdef VISIONTEST
+#include <time.h>
+
+static void conformMap(char* mapFile, visionmode_t modeA, visionmode_t modeB,
+                       double* totalA, double* totalB);
+static void calculateVisionWith(grid_t* grid, visionmode_t mode, int pos, bitset_t* visible);
+static const char* modeName(visionmode_t mode);
+static void changeTerrain(char* mapFile, visionmode_t mode, int radius);
+static bool isWalkable(char tile);
+
 // created a separate vision unit test, because the challenges involved with developing grid_calculateVision meant a lot of testing was required and it made sense for it to have a independent unit test
+// usage: visiontest mapfile
+//    or: visiontest -c mapfile... to compare raycasting and shadowcasting on every walkable tile of each map
+//    or: visiontest -r mapfile... to compare the integer raycast with the original floating point one
 int 
 main(int argc, char* argv[])
 {
+ // conformance and regression modes, diff two algorithms on every given map
+ if( argc > 2 && (strcmp(argv[1], "-c") == 0 || strcmp(argv[1], "-r") == 0) ){
+   visionmode_t modeA = strcmp(argv[1], "-c") == 0 ? VISION_RAYCAST : VISION_RAYCAST_LEGACY;
+   visionmode_t modeB = strcmp(argv[1], "-c") == 0 ? VISION_SHADOWCAST : VISION_RAYCAST;
+   double totalA = 0.0;
+   double totalB = 0.0;
+   for(int i = 2; i < argc; i++){
+     conformMap(argv[i], modeA, modeB, &totalA, &totalB);
+   }
+   fprintf(stdout, "total: %s %.3fs, %s %.3fs, speedup %.1fx\n",
+           modeName(modeA), totalA, modeName(modeB), totalB,
+           totalB > 0 ? totalA / totalB : 0.0);
+   exit(0);
+ }
+
  // check args
  if( argc != 2 ){
    fprintf(stderr, "Invalid num args\n");
@@ -670,15 +2942,15 @@ main(int argc, char* argv[])
    exit(3);
  }
  
- // initialize vision array to correct size
- int vision[grid->mapLen];
+ // initialize vision set to correct size
+ bitset_t* vision = bitset_new(grid->mapLen);
+ if( vision == NULL ){
+   fprintf(stderr, "Vision set creation failure\n");
+   exit(3);
+ }
  // specific location chosen to illustrate features vision behavior with corners
  int pos = 1447;
- // initialize vision to zeros
- for(int i = 0; i < grid->mapLen; i++){
-  vision[i] = 0;
- }
- // populate vision array
+ // populate vision set
  grid_calculateVision(grid, pos, vision); 
  fprintf(stdout, "\n");
  char* reference = grid_getReference(grid);
@@ -691,7 +2963,7 @@ main(int argc, char* argv[])
    else if(i % (grid->numColumns+1)==0 && i != 0){
      fprintf(stdout, "\n");
    }
-   else if(vision[i] == 1 && reference[i] != '\n'){
+   else if(bitset_test(vision, i) && reference[i] != '\n'){
       fprintf(stdout, "%c", reference[i]);
    } else {
       fprintf(stdout, " ");
@@ -702,11 +2974,7 @@ main(int argc, char* argv[])
 
  // testing with a new position this time in a tunnel
  pos = 592;
- // resetting vision
- for(int i = 0; i < grid->mapLen; i++){
-  vision[i] = 0;
- }
- // repopulate vision array
+ // repopulate vision set, which clears it first
  grid_calculateVision(grid, pos, vision);
  fprintf(stdout, "\n----- map boundary ------------------------------------------------------------\n");
  // repeating the test code from above with new position
@@ -717,7 +2985,7 @@ main(int argc, char* argv[])
    else if( i == pos ){
      fprintf(stdout, "@");
    }
-   else if( vision[i] == 1){
+   else if( bitset_test(vision, i) ){
     fprintf(stdout, "%c", reference[i]);
    } else {
      fprintf(stdout, " ");
@@ -727,9 +2995,6 @@ main(int argc, char* argv[])
 
  // testing a third position
  pos = 1055;
- for(int i = 0; i < grid->mapLen; i++){
-   vision[i] = 0;
- }
  grid_calculateVision(grid, pos, vision);
  fprintf(stdout, "\n----- map boundary ------------------------------------------------------------\n");
 
@@ -740,7 +3005,7 @@ main(int argc, char* argv[])
    else if( i == pos ){
      fprintf(stdout, "@");
    }
-   else if( vision[i] == 1 ){
+   else if( bitset_test(vision, i) ){
      fprintf(stdout, "%c", reference[i]);
    } else {
      fprintf(stdout, " ");
@@ -748,8 +3013,354 @@ main(int argc, char* argv[])
  }
  fprintf(stdout, "\n");
 
+ // the vision table should give exactly the same vision as direct calculation
+ grid_t* tableGrid = grid_new(argv[1]);
+ if( tableGrid == NULL || ! grid_buildVisionTable(tableGrid, true) ){
+   fprintf(stderr, "Vision table creation failure\n");
+   exit(4);
+ }
+ bitset_t* direct = bitset_new(grid->mapLen);
+ bitset_t* table = bitset_new(grid->mapLen);
+ if( direct == NULL || table == NULL ){
+   fprintf(stderr, "Vision set creation failure\n");
+   exit(4);
+ }
+ int checked = 0;
+ int mismatches = 0;
+ // check every walkable tile twice, once to fill the table and once to read it
+ for(int round = 0; round < 2; round++){
+   for(int i = 0; i < grid->mapLen; i++){
+     if( ! isWalkable(reference[i]) ){
+       continue;
+     }
+     grid_calculateVision(grid, i, direct);
+     grid_calculateVision(tableGrid, i, table);
+     for(int j = 0; j < grid->mapLen; j++){
+       if( bitset_test(direct, j) != bitset_test(table, j) ){
+         mismatches++;
+         break;
+       }
+     }
+     checked++;
+   }
+ }
+ fprintf(stdout, "\nvision table: checked %d tiles, %d mismatches\n", checked, mismatches);
+
+ // so should a vision cache too small to hold every tile
+ grid_t* cacheGrid = grid_new(argv[1]);
+ if( cacheGrid == NULL || ! grid_buildVisionCache(cacheGrid, 16 * 1024) ){
+   fprintf(stderr, "Vision cache creation failure\n");
+   exit(4);
+ }
+ checked = 0;
+ mismatches = 0;
+ // ask for every walkable tile twice in a row, a miss then a hit
+ for(int i = 0; i < grid->mapLen; i++){
+   if( ! isWalkable(reference[i]) ){
+     continue;
+   }
+   grid_calculateVision(grid, i, direct);
+   for(int round = 0; round < 2; round++){
+     grid_calculateVision(cacheGrid, i, table);
+     for(int j = 0; j < grid->mapLen; j++){
+       if( bitset_test(direct, j) != bitset_test(table, j) ){
+         mismatches++;
+         break;
+       }
+     }
+     checked++;
+   }
+ }
+ viscachestats_t stats;
+ grid_getVisionCacheStats(cacheGrid, &stats);
+ fprintf(stdout, "vision cache: checked %d tiles, %d mismatches, %lu hits, %lu misses, "
+         "%lu evictions, %d entries, %s budget\n",
+         checked, mismatches, stats.hits, stats.misses, stats.evictions,
+         stats.numEntries, stats.bytes <= stats.budget ? "within" : "over");
+ grid_delete(cacheGrid);
+
+ // with a light radius and every room dark, shadowcasting should see exactly
+ // what it sees without one, cut down to the square around the viewer
+ const int radius = 3;
+ grid_t* fullGrid = grid_new(argv[1]);
+ grid_t* darkGrid = grid_new(argv[1]);
+ if( fullGrid == NULL || darkGrid == NULL ){
+   fprintf(stderr, "Grid creation failure\n");
+   exit(4);
+ }
+ grid_setVisionMode(fullGrid, VISION_SHADOWCAST);
+ grid_setVisionMode(darkGrid, VISION_SHADOWCAST);
+ grid_setLightRadius(darkGrid, radius);
+ for(int room = 0; room < rooms_getNumRooms(darkGrid->rooms); room++){
+   grid_setRoomLit(darkGrid, room, false);
+ }
+ checked = 0;
+ mismatches = 0;
+ int stride = grid->numColumns + 1;
+ for(int i = 0; i < grid->mapLen; i++){
+   if( ! isWalkable(reference[i]) ){
+     continue;
+   }
+   grid_calculateVision(fullGrid, i, direct);
+   grid_calculateVision(darkGrid, i, table);
+   for(int j = 0; j < grid->mapLen; j++){
+     bool inLight = abs(j % stride - i % stride) <= radius && abs(j / stride - i / stride) <= radius;
+     if( (bitset_test(direct, j) && inLight) != bitset_test(table, j) ){
+       mismatches++;
+       break;
+     }
+   }
+   checked++;
+ }
+ fprintf(stdout, "light radius: checked %d dark tiles, %d mismatches\n", checked, mismatches);
+
+ // lit rooms are seen in full, and the light reaches no further elsewhere
+ for(int room = 0; room < rooms_getNumRooms(darkGrid->rooms); room++){
+   grid_setRoomLit(darkGrid, room, true);
+ }
+ checked = 0;
+ mismatches = 0;
+ for(int i = 0; i < grid->mapLen; i++){
+   if( ! isWalkable(reference[i]) ){
+     continue;
+   }
+   int room = rooms_getRoom(darkGrid->rooms, i);
+   grid_calculateVision(fullGrid, i, direct);
+   grid_calculateVision(darkGrid, i, table);
+   for(int j = 0; j < grid->mapLen; j++){
+     bool inLight = abs(j % stride - i % stride) <= radius && abs(j / stride - i / stride) <= radius;
+     bool inRoom = room >= 0 && rooms_getRoom(darkGrid->rooms, j) == room;
+     if( (bitset_test(table, j) && ! inLight && ! inRoomOrRing(darkGrid, room, j))
+         || (bitset_test(direct, j) && inRoom && ! bitset_test(table, j)) ){
+       mismatches++;
+       break;
+     }
+   }
+   checked++;
+ }
+ fprintf(stdout, "light radius: checked %d lit tiles, %d mismatches\n", checked, mismatches);
+ grid_delete(fullGrid);
+ grid_delete(darkGrid);
+
+ // stored vision should follow changes to the terrain
+ changeTerrain(argv[1], VISION_RAYCAST, 0);
+ changeTerrain(argv[1], VISION_SHADOWCAST, 0);
+ changeTerrain(argv[1], VISION_SHADOWCAST, radius);
+ bitset_delete(direct);
+ bitset_delete(table);
+ grid_delete(tableGrid);
+
+ bitset_delete(vision);
  grid_delete(grid);
  
  exit(0); 
 }
+
+// makes the same random changes to the terrain of grids that store vision in an
+// eager table, a lazy table and a small cache, and of one that stores none,
+// with every other room dark if radius > 0
+// every so often, checks vision from every walkable tile against the last grid
+static void
+changeTerrain(char* mapFile, visionmode_t mode, int radius)
+{
+ const char* tiles = ".#-| ";         // what a tile can be changed to
+ const int numGrids = 4;
+ grid_t* grids[4] = { grid_new(mapFile), grid_new(mapFile), grid_new(mapFile), grid_new(mapFile) };
+ for(int g = 0; g < numGrids; g++){
+   if( grids[g] == NULL ){
+     fprintf(stderr, "Grid creation failure\n");
+     exit(5);
+   }
+   grid_setVisionMode(grids[g], mode);
+   grid_setLightRadius(grids[g], radius);
+   for(int room = 1; radius > 0 && room < rooms_getNumRooms(grids[g]->rooms); room += 2){
+     grid_setRoomLit(grids[g], room, false);
+   }
+ }
+ grid_t* direct = grids[numGrids - 1];
+ if( ! grid_buildVisionTable(grids[0], false) || ! grid_buildVisionTable(grids[1], true)
+     || ! grid_buildVisionCache(grids[2], 16 * 1024) ){
+   fprintf(stderr, "Stored vision creation failure\n");
+   exit(5);
+ }
+ bitset_t* expected = bitset_new(direct->mapLen);
+ bitset_t* stored = bitset_new(direct->mapLen);
+ if( expected == NULL || stored == NULL ){
+   fprintf(stderr, "Vision set creation failure\n");
+   exit(5);
+ }
+
+ srand(1);
+ int changes = 0;
+ int checked = 0;
+ int mismatches = 0;
+ int filled = 0;
+ int kept = 0;
+ for(int round = 0; round < 6; round++){
+   // change tiles next to where players can stand, where it shows
+   filled += vistable_getNumEntries(grids[1]->visTable);
+   for(int i = 0; i < 10; ){
+     int pos = rand() % direct->mapLen;
+     if( ! (direct->flags[pos] & TILE_WALKABLE) ){
+       continue;
+     }
+     pos += direct->stepOffsets[rand() % NUM_DIRECTIONS];
+     char tile = tiles[rand() % strlen(tiles)];
+     if( pos < 0 || pos >= direct->mapLen || direct->reference[pos] == '\n' ){
+       continue;
+     }
+     for(int g = 0; g < numGrids; g++){
+       if( ! grid_setTerrain(grids[g], pos, tile) ){
+         mismatches++;
+       }
+     }
+     changes++;
+     i++;
+   }
+   // how much of the lazy table, full after each check, survived the changes
+   kept += vistable_getNumEntries(grids[1]->visTable);
+   for(int pos = 0; pos < direct->mapLen; pos++){
+     if( ! (direct->flags[pos] & TILE_WALKABLE) ){
+       continue;
+     }
+     grid_calculateVision(direct, pos, expected);
+     for(int g = 0; g < numGrids - 1; g++){
+       grid_calculateVision(grids[g], pos, stored);
+       for(int j = 0; j < direct->mapLen; j++){
+         if( bitset_test(expected, j) != bitset_test(stored, j) ){
+           mismatches++;
+           break;
+         }
+       }
+     }
+     checked++;
+   }
+ }
+ fprintf(stdout, "dynamic terrain (%s, radius %d): %d changes, checked %d tiles, %d mismatches, "
+         "%d of %d table entries kept\n", modeName(mode), radius, changes, checked, mismatches,
+         kept, filled);
+
+ bitset_delete(expected);
+ bitset_delete(stored);
+ for(int g = 0; g < numGrids; g++){
+   grid_delete(grids[g]);
+ }
+}
+
+// runs both algorithms from every walkable tile of the given map
+// prints how long each took and how many viewpoints and tiles they disagree on
+static void
+conformMap(char* mapFile, visionmode_t modeA, visionmode_t modeB,
+           double* totalA, double* totalB)
+{
+ grid_t* grid = grid_new(mapFile);
+ if( grid == NULL ){
+   fprintf(stdout, "%s: could not load, skipped\n", mapFile);
+   return;
+ }
+
+ bitset_t* setA = bitset_new(grid->mapLen);
+ bitset_t* setB = bitset_new(grid->mapLen);
+ if( setA == NULL || setB == NULL ){
+   fprintf(stderr, "Vision set creation failure\n");
+   exit(4);
+ }
+ int viewpoints = 0;                 // walkable tiles checked
+ int viewsDiffer = 0;                // viewpoints where the algorithms disagree
+ long tilesSeen = 0;                 // tiles seen by the first algorithm, over all viewpoints
+ long tilesDiffer = 0;               // tiles seen by exactly one algorithm
+
+ // time each algorithm over the whole map on its own
+ clock_t start = clock();
+ for(int i = 0; i < grid->mapLen; i++){
+   if( isWalkable(grid->reference[i]) ){
+     calculateVisionWith(grid, modeA, i, setA);
+   }
+ }
+ double timeA = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+ start = clock();
+ for(int i = 0; i < grid->mapLen; i++){
+   if( isWalkable(grid->reference[i]) ){
+     calculateVisionWith(grid, modeB, i, setB);
+   }
+ }
+ double timeB = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+ // then diff them viewpoint by viewpoint
+ for(int i = 0; i < grid->mapLen; i++){
+   if( ! isWalkable(grid->reference[i]) ){
+     continue;
+   }
+   calculateVisionWith(grid, modeA, i, setA);
+   calculateVisionWith(grid, modeB, i, setB);
+
+   int differ = 0;
+   for(int j = 0; j < grid->mapLen; j++){
+     if( grid->reference[j] == '\n' ){
+       continue;
+     }
+     if( bitset_test(setA, j) ){
+       tilesSeen++;
+     }
+     if( bitset_test(setA, j) != bitset_test(setB, j) ){
+       differ++;
+     }
+   }
+   viewpoints++;
+   tilesDiffer += differ;
+   if( differ > 0 ){
+     viewsDiffer++;
+   }
+ }
+
+ fprintf(stdout, "%s: %d viewpoints, %d differ, %ld of %ld seen tiles differ (%.2f%%), "
+         "%s %.1fus, %s %.1fus, speedup %.1fx\n",
+         mapFile, viewpoints, viewsDiffer, tilesDiffer, tilesSeen,
+         tilesSeen > 0 ? 100.0 * tilesDiffer / tilesSeen : 0.0,
+         modeName(modeA), viewpoints > 0 ? 1e6 * timeA / viewpoints : 0.0,
+         modeName(modeB), viewpoints > 0 ? 1e6 * timeB / viewpoints : 0.0,
+         timeB > 0 ? timeA / timeB : 0.0);
+
+ *totalA += timeA;
+ *totalB += timeB;
+ bitset_delete(setA);
+ bitset_delete(setB);
+ grid_delete(grid);
+}
+
+// clears visible, then fills it in with the given algorithm alone,
+// skipping the vision table and the room fast path
+static void
+calculateVisionWith(grid_t* grid, visionmode_t mode, int pos, bitset_t* visible)
+{
+ bitset_clear(visible);
+ if( mode == VISION_SHADOWCAST ){
+   calculateVisionShadowcast(grid, pos, visible, 0);
+ } else if( mode == VISION_RAYCAST_LEGACY ){
+   calculateVisionRaycastLegacy(grid, pos, visible);
+ } else {
+   calculateVisionRaycast(grid, pos, visible, 0);
+ }
+ bitset_unset(visible, grid->mapLen);
+}
+
+// short name of an algorithm, for printing
+static const char*
+modeName(visionmode_t mode)
+{
+ switch( mode ){
+   case VISION_SHADOWCAST:     return "shadowcast";
+   case VISION_RAYCAST_LEGACY: return "legacy raycast";
+   default:                    return "raycast";
+ }
+}
+
+// true if a player can stand on the given reference map tile,
+// these are the only tiles the vision table stores entries for
+static bool
+isWalkable(char tile)
+{
+  return TILE_IS(tile, TILE_WALKABLE);
+}
 #endif
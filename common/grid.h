@@ -12,6 +12,22 @@
  * When, for example, a player moves on the "active map"
  * We use the "reference map" to replace the character previously occupied by the player
  * It also contains the number of columns and rows for the given grid
+ * The "reference map" rarely changes, so every grid of the same map shares
+ * one copy of it, see mapcache.h. Only the "active map" belongs to the grid,
+ * until grid_setTerrain changes a tile, which gives the grid its own copy
+ *
+ * What stands on the map is kept apart from the map itself, in two planes:
+ * an item plane (gold) and an entity plane (players, and later monsters)
+ * Placing, moving or removing something only writes to its plane and notes
+ * the tile as stale. The "active map" is composed from the reference map and
+ * the planes, a tile at a time, when it is next asked for: an entity shows
+ * over an item, which shows over the terrain
+ *
+ * A grid made with grid_newChunked keeps its "active map" in chunks of 64x64
+ * tiles instead (see chunkmap.h), each allocated when one of its tiles is
+ * first written, and shows a blank tile wherever nothing was. It suits a grid
+ * that only ever holds a small part of a large map, such as what a player
+ * remembers of it. Every grid_* function works on either kind of grid
  *
  * Winter 2022, CS50 team 1
  */
@@ -21,24 +37,89 @@
 #define __GRID_H
 
 #include <stdbool.h>
+#include "bitset.h"
+#include "rooms.h"
+#include "components.h"
+#include "viscache.h"
+#include "tiles.h"
 
 /**************** global types ****************/
 typedef struct grid grid_t;  // opaque to users of the module
 
+/* algorithms that grid_calculateVision can use, see grid_setVisionMode */
+typedef enum visionmode {
+  VISION_RAYCAST,            // the original algorithm, one ray to every tile in the map
+  VISION_SHADOWCAST,         // symmetric recursive shadowcasting
+  VISION_RAYCAST_LEGACY      // the raycast as first written, with floating point slopes
+} visionmode_t;
+
+/* algorithm used by new grids, can be changed at compile time
+ * e.g. make FLAGS=-DVISION_DEFAULT=VISION_SHADOWCAST
+ * The default stays VISION_RAYCAST, which is what the game has always shown.
+ * A viewer in a rectangular room sees the whole room and its walls under
+ * either, the raycast only casts rays to tiles outside them
+ */
+#ifndef VISION_DEFAULT
+#define VISION_DEFAULT VISION_RAYCAST
+#endif
+
 /**************** functions **************/
 
 /**************** getters **************/
+/* grid_getActive first composes any tile placed on since it was last asked
+ * for, so call it (or grid_getChanges) from one thread before threads share
+ * the grid, after which it only reads
+ * The active map of a chunked grid is put together in a buffer that belongs
+ * to the calling thread, and is only good until that thread next calls
+ * grid_getActive on a chunked grid. Writing to it changes nothing
+ */
 char* grid_getReference(grid_t* grid);
 char* grid_getActive(grid_t* grid);
 int grid_getNumRows(grid_t* grid);
 int grid_getNumColumns(grid_t* grid);
 size_t grid_getMapLen(grid_t* grid);
 char* grid_getMapfile(grid_t* grid);
+visionmode_t grid_getVisionMode(grid_t* grid);
+rooms_t* grid_getRooms(grid_t* grid);
+/* the walkable components of the grid's terrain (see components.h), shared
+ * with other grids of the same map until grid_setTerrain changes a tile,
+ * NULL if they could not be labelled
+ */
+components_t* grid_getComponents(grid_t* grid);
+
+/* the terrain, item and entity at the given position,
+ * '\0' if there is none or pos is out of bounds
+ */
+char grid_getTerrain(grid_t* grid, int pos);
+char grid_getItem(grid_t* grid, int pos);
+char grid_getEntity(grid_t* grid, int pos);
+/* the character the active map shows at the given position, on either kind
+ * of grid without putting the whole active map together,
+ * '\0' if pos is out of bounds
+ */
+char grid_getTile(grid_t* grid, int pos);
+/* the move mask of the tile at pos (see mapcache_getMoves), which
+ * directions a player there can step in, 0 if pos is out of bounds
+ */
+uint8_t grid_getMoves(grid_t* grid, int pos);
+
+/**************** grid_isReachable ***************/
+/* returns true if a player at from could walk to to, a step at a time over
+ * walkable tiles and whatever stands on them, which is when both lie in the
+ * same component (see grid_getComponents). Constant time, with no search
+ * If the grid's components are unknown, any two walkable tiles count
+ * returns false if either tile can't be walked on, is out of bounds,
+ * or on bad params
+ */
+bool grid_isReachable(grid_t* grid, int from, int to);
 
 /**************** grid_new ***************/
 /* initialize a new "grid"
  * takes a string as a parameter where the string is the path to the map file
- * allocates memory for the map string and struct itself 
+ * the reference map is shared with other grids of the same map, and the file
+ * is only read if no grid holds it yet. grid_getReference must not be modified
+ * the file may be a text map or one compiled by mapc, see mapcache.h
+ * allocates memory for the active map and struct itself 
  * that must then be free'd in grid_delete 
  * also stores the number of rows and columns in the grid within the struct
  * returns the grid if process successful
@@ -46,31 +127,180 @@ char* grid_getMapfile(grid_t* grid);
  */
 grid_t* grid_new(char* mapFile);
 
+/**************** grid_newChunked ***************/
+/* initialize a new "grid" like grid_new, but with its active map kept in
+ * chunks, none of which is allocated until one of its tiles is written
+ * every tile of the active map starts as the given blank character, other
+ * than the newlines that end each row, and is shown as blank again whenever
+ * it is written with it
+ * must be free'd in grid_delete
+ * returns NULL on the same errors as grid_new, or if blank is '\0' or '\n'
+ */
+grid_t* grid_newChunked(char* mapFile, char blank);
+
 /*************** grid_replace *************/
 /* replace the given character at the given index position in the map string
  * modifies the "active map" of the given grid structure 
  * at the given index position, replacing it with the given character
+ * the planes are left alone, so placing something on the tile later
+ * composes over the character, see grid_placeItem and grid_placeEntity
  * returns true if success, false if error
  */
 bool grid_replace(grid_t* grid, int pos, char newChar);
 
 /**************** grid_revertTile **************/
 /* Replaces the character at the given position of the given grid's active map
- * with the character at the same position in the given grid's reference map
- * most often used when players move or when gold is picked up
+ * with what the grid's planes hold there: its entity, else its item,
+ * else the character at the same position in the reference map
+ * undoes a grid_replace, e.g. of a player's vision
  * returns true if success, false if the strings in the given grid don't exist
  */
 bool grid_revertTile(grid_t* grid, int pos);
 
+/**************** grid_placeItem **************/
+/* puts the given item (e.g. a pile of gold) on the item plane at pos,
+ * replacing any item there, or takes the item away if item is '\0'
+ * the active map shows it the next time it is asked for
+ * returns true on success, false on bad params or failure to allocate memory
+ */
+bool grid_placeItem(grid_t* grid, int pos, char item);
+
+/**************** grid_placeEntity **************/
+/* puts the given entity (e.g. a player's letter) on the entity plane at pos,
+ * replacing any entity there, or takes the entity away if entity is '\0'
+ * the active map shows it the next time it is asked for
+ * returns true on success, false on bad params or failure to allocate memory
+ */
+bool grid_placeEntity(grid_t* grid, int pos, char entity);
+
+/**************** grid_moveEntity **************/
+/* moves the entity at from to to, and whatever entity was at to over to from,
+ * so that two entities that bump into each other trade places
+ * returns true on success, false on bad params or if no entity is at from
+ */
+bool grid_moveEntity(grid_t* grid, int from, int to);
+
+/**************** grid_setTerrain **************/
+/* Changes the terrain at pos to the given tile, e.g. to open a door or
+ * knock down a wall. What the tile lets through is whatever tiles.h says
+ * of its character. The first change gives the grid its own copy of the
+ * terrain, which no other grid of the map sees
+ * The grid's rooms, components, run table, empty tiles, active map and stored
+ * vision all follow the change. The components are labelled again when a
+ * tile turns walkable or stops being so, in time in proportion to the map
+ * Only vision that could have been changed by it is thrown away: the grid
+ * keeps track of which tiles each stored visible set depends on, in blocks
+ * of tiles (see visdeps.h), from the first change on. An eager
+ * table is filled again straight away, while a lazy table or a cache fill
+ * again as they are next used, and compiled vision from a tile whose vision
+ * may have changed is calculated from then on
+ * Sets of visible tiles handed out before the change are not updated
+ * Must not be called while other threads share the grid
+ * returns true on success, including if the tile was already the same,
+ * false on bad params, if pos or tile is a newline, or on failure to
+ * allocate memory, in which case the terrain is unchanged
+ */
+bool grid_setTerrain(grid_t* grid, int pos, char tile);
+
+/**************** grid_buildRunTable **************/
+/* Builds a table of how far a run from each tile can go in each of the
+ * eight directions, see grid_getRunLength. Placing or moving items and
+ * entities keeps it up to date, walking back along the eight lines through
+ * the tiles that changed, so a run of any length is found in constant time
+ * The table takes 8 bytes a tile. Does nothing if the grid already has one
+ * returns true on success, false on bad params or failure to allocate memory
+ */
+bool grid_buildRunTable(grid_t* grid);
+
+/**************** grid_getRunLength **************/
+/* returns how many steps a player at pos can take in direction dir over
+ * walkable tiles with nothing on them. The tile after the last step is
+ * a wall, off the map, or holds an item or entity
+ * looks it up in the run table if the grid has one, else walks the line
+ * returns 0 if pos can't be walked on, or on bad params
+ */
+int grid_getRunLength(grid_t* grid, int pos, direction_t dir);
+
+/**************** grid_isEmptyTile **************/
+/* returns true if the tile at pos is a ROOMTILE ('.') with no item
+ * and no entity on it, false if not or on bad params
+ */
+bool grid_isEmptyTile(grid_t* grid, int pos);
+
+/**************** grid_trackChanges **************/
+/* Starts logging which positions of the given grid's active map change
+ * through grid_replace, grid_revertTile or the composing of placed items
+ * and entities, so that a caller can update
+ * its own copies of the map by looking at those positions alone
+ * Room is kept for maxChanges positions between calls to grid_clearChanges
+ * past that the log overflows and the caller has to assume anything changed
+ * Does nothing if the grid already keeps a log
+ * returns true on success, false on bad params or failure to allocate memory
+ */
+bool grid_trackChanges(grid_t* grid, int maxChanges);
+
+/**************** grid_getChanges **************/
+/* returns the positions changed since the last grid_clearChanges
+ * and stores how many there are in count. A position can appear more than once
+ * stale tiles are composed first, so everything placed so far is counted
+ * the returned array belongs to the grid
+ * returns NULL (and leaves count alone) if the grid doesn't keep a log,
+ * if the log overflowed, or on bad params. Treat that as "everything changed"
+ */
+const int* grid_getChanges(grid_t* grid, int* count);
+
+/**************** grid_clearChanges **************/
+/* empties the grid's change log, and clears its overflow */
+void grid_clearChanges(grid_t* grid);
+
 /************ grid_containsEmptyTile *********/
-/* allows a user to determine whether or not a given grid's active map 
+/* allows a user to determine whether or not a given grid
  * contains an empty room tile. Most useful when adding a player
  * because it determines whether a player can be added or not
- * returns true if there is at least one ROOMTILE ('.')
- * false if there is not
+ * returns true if there is at least one ROOMTILE ('.') with nothing on it,
+ * see grid_isEmptyTile, false if there is not
+ * constant time once the grid indexes its empty tiles
  */
 bool grid_containsEmptyTile(grid_t* grid);
 
+/************ grid_indexEmptyTiles *********/
+/* Starts keeping the set of empty room tiles (see grid_isEmptyTile) of the
+ * given grid: a dense array of them, and where each tile is in that array
+ * Placing, moving or removing items and entities keeps it up to date, so
+ * counting, testing and picking empty tiles take constant time
+ * Does nothing if the grid already keeps one
+ * returns true on success, false on bad params or failure to allocate memory
+ */
+bool grid_indexEmptyTiles(grid_t* grid);
+
+/************ grid_countEmptyTiles *********/
+/* returns the number of empty room tiles in the grid, 0 on bad params */
+int grid_countEmptyTiles(grid_t* grid);
+
+/************ grid_randomEmptyTile *********/
+/* returns an empty room tile of the grid, each as likely as any other,
+ * chosen with one call to rand(), so srand makes it repeatable
+ * returns -1 if there is none, or on bad params
+ */
+int grid_randomEmptyTile(grid_t* grid);
+
+/************ grid_randomMainEmptyTile *********/
+/* like grid_randomEmptyTile, but only picks empty room tiles in the grid's
+ * largest walkable component (see grid_getComponents), so that nothing lands
+ * in a pocket the rest of the map can't reach. Any empty tile will do if the
+ * components could not be labelled
+ * constant time once the grid indexes its empty tiles
+ * returns -1 if there is none, or on bad params
+ */
+int grid_randomMainEmptyTile(grid_t* grid);
+
+/*************** grid_getBytes **************/
+/* returns about how many bytes the grid holds of its own: its active map,
+ * planes, indexes and stored vision. The map it shares with other grids
+ * is not counted, see mapcache_getStats. 0 if grid is NULL
+ */
+size_t grid_getBytes(grid_t* grid);
+
 /*************** grid_delete **************/
 /* free's all memory in use by the given grid
  * checks for existence of strings before deleting them
@@ -78,15 +308,103 @@ bool grid_containsEmptyTile(grid_t* grid);
  */
 void grid_delete(grid_t* grid);
 
+/********** grid_buildVisionTable ***********/
+/* Builds a table holding the vision from every walkable tile of the grid
+ * Vision only depends on the reference map, so after this call
+ * grid_calculateVision is a table lookup rather than a full calculation
+ * If lazy is false, every walkable tile is calculated now, which can take
+ * a while on big maps. If lazy is true, the table starts empty and
+ * each tile is calculated the first time its vision is requested
+ * A map compiled with its vision (see mapcache.h) already holds every entry,
+ * so nothing is calculated now, as long as the grid uses the vision mode
+ * it was compiled with and has no light radius
+ * Does nothing if the grid already has a table
+ * returns true on success, false on bad params or failure to allocate memory
+ * (in which case vision is simply calculated on every call, as before)
+ */
+bool grid_buildVisionTable(grid_t* grid, bool lazy);
+
+/********** grid_buildVisionCache ***********/
+/* Gives the grid a cache of the vision from the walkable tiles used most
+ * recently, holding up to budget bytes of visible sets (see viscache.h)
+ * A middle ground for maps too big for a vision table, where the same tiles
+ * still come up again and again. Each tile is calculated the first time its
+ * vision is requested, and again only if it was evicted since
+ * The cache is only used if the grid has no vision table
+ * Does nothing if the grid already has a cache
+ * returns true on success, false on bad params or failure to allocate memory
+ */
+bool grid_buildVisionCache(grid_t* grid, size_t budget);
+
+/********** grid_getVisionCacheStats ***********/
+/* stores a snapshot of the hit, miss and eviction counts of the grid's
+ * vision cache in stats
+ * returns false (and stores nothing) if the grid has no cache, or on bad params
+ */
+bool grid_getVisionCacheStats(grid_t* grid, viscachestats_t* stats);
+
+/********** grid_setVisionMode ***********/
+/* Chooses the algorithm used to calculate vision on the given grid
+ * VISION_RAYCAST casts a ray from the viewer to every tile in the map
+ * VISION_SHADOWCAST scans outwards from the viewer and only visits
+ * tiles that could be visible, which is much faster on big maps
+ * The two agree on almost every tile, run "make visionconform" to compare them
+ * VISION_RAYCAST_LEGACY is the raycast with the floating point rounding it
+ * was first written with, run "make visionregress" to compare it with VISION_RAYCAST
+ * If the grid has a vision table it is rebuilt with the new algorithm,
+ * and a vision cache is emptied
+ * returns true on success, false on bad params or failure to rebuild the table
+ */
+bool grid_setVisionMode(grid_t* grid, visionmode_t mode);
+
+/********** grid_setLightRadius ***********/
+/* Limits how far players can see, like the light of a torch in Rogue
+ * With a radius of R, vision reaches only the tiles at most R rows and
+ * R columns from the viewer, except that a viewer in a lit room (see
+ * grid_setRoomLit) still sees the whole of it. Dark rooms and passages only
+ * show what is within the light. Vision then never scans more than the
+ * (2R+1) by (2R+1) square around the viewer, or the lit room if bigger,
+ * so it costs the same however big the map is
+ * A radius of 0, the default, means unlimited vision
+ * If the grid has stored vision (a table or cache) it is thrown away and rebuilt
+ * returns true on success, false on bad params or failure to rebuild stored vision
+ */
+bool grid_setLightRadius(grid_t* grid, int radius);
+
+/********** grid_getLightRadius ***********/
+/* returns the grid's light radius, 0 if unlimited or grid is NULL */
+int grid_getLightRadius(grid_t* grid);
+
+/********** grid_setRoomLit ***********/
+/* Makes a room of the grid (see grid_getRooms) lit or dark
+ * Every room starts out lit. This only matters with a light radius
+ * returns true on success, false on bad params or failure to rebuild stored vision
+ */
+bool grid_setRoomLit(grid_t* grid, int room, bool lit);
+
 /********** grid_calculateVision ***********/
-/* Calculates a player's current vision, in the form of an integer array the same size as our map
- * indicating which points are visible with a 1 indicating visibility or -1 indicating non-visibility
- * modifies the given array
+/* Calculates a player's current vision, in the form of a set of map positions
+ * the set is cleared, then every position visible from pos is added to it
+ * the set must hold at least grid_getMapLen(grid) bits, see bitset.h
+ * Does nothing on bad params, including a set that is too small
+ * Several threads may call this at once on the same grid, each with its own set,
+ * as long as nothing modifies the grid or its vision settings meanwhile.
+ * Calls calculate vision side by side. They only take turns to store what
+ * they calculated, to look it up in a cache, or under VISION_RAYCAST_LEGACY
  * Parameters:  grid - the grid of the map we are playing the game on 
  *              pos - a players position within the map (int)
- *              vision - the int array which stores corresponding visibility information 
+ *              visible - the set which receives the visible positions
  * Returns:     void
  */
-void grid_calculateVision(grid_t* grid, int pos, int* vision);
+void grid_calculateVision(grid_t* grid, int pos, bitset_t* visible);
+
+#ifdef VISIONBENCH
+/********** grid_getTilesVisited ***********/
+/* only in builds for "make visionbench"
+ * returns how many tiles the vision algorithms have looked at so far,
+ * over every grid, counting a tile once each time it is looked at
+ */
+unsigned long grid_getTilesVisited(void);
+#endif
 
 #endif
@@ -0,0 +1,283 @@
+/*
+ * This file implements the "mapbin" module for my rogue-like
+ * The "mapbin" module is defined in mapbin.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L   // open, fstat, mmap
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "mapbin.h"
+#include "rooms.h"
+#include "tiles.h"
+
+// the int sections are used as they lie, so an int must be what was written
+_Static_assert(sizeof(int) == sizeof(int32_t), "compiled maps hold 32-bit ints");
+
+/**************** file-local constants *******************/
+static const uint32_t BYTEORDER = 0x01020304;  // reads back the same only in the same order
+static const uint64_t ALIGN = 64;              // every section starts on a multiple of this
+
+/**************** local functions ****************/
+static bool sectionFits(const mapbinsection_t* section, size_t size);
+static bool sectionIs(const mapbinheader_t* header, mapsection_t section, uint64_t length);
+static bool rowsFit(const mapbinheader_t* header);
+static bool tilesFit(const mapbinheader_t* header);
+
+/**************** mapbin_open ***************/
+/* see mapbin.h for details */
+const void* mapbin_open(const char* mapFile, size_t* size)
+{
+  char magic[sizeof(MAPBIN_MAGIC)];    // first bytes of the file
+  struct stat info;                    // size and kind of file
+
+  // check params
+  if (mapFile == NULL || size == NULL) {
+    return NULL;
+  }
+
+  int fd = open(mapFile, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  // a text map is told apart by its first few bytes, before mapping anything
+  if (fstat(fd, &info) != 0 || ! S_ISREG(info.st_mode)
+      || info.st_size < (off_t)sizeof(mapbinheader_t)
+      || read(fd, magic, sizeof(magic)) != sizeof(magic)
+      || memcmp(magic, MAPBIN_MAGIC, sizeof(magic)) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  const void* image = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    return NULL;
+  }
+  *size = info.st_size;
+  return image;
+}
+
+/**************** mapbin_check ***************/
+/* see mapbin.h for details */
+const mapbinheader_t* mapbin_check(const void* image, size_t size)
+{
+  const mapbinheader_t* header = image;
+
+  if (image == NULL || size < sizeof(mapbinheader_t)
+      || memcmp(header->magic, MAPBIN_MAGIC, sizeof(header->magic)) != 0
+      || header->version != MAPBIN_VERSION || header->byteOrder != BYTEORDER
+      || header->fileSize != size) {
+    return NULL;
+  }
+  for (int s = 0; s < MAPBIN_NUMSECTIONS; s++) {
+    if (! sectionFits(&header->sections[s], size)) {
+      return NULL;
+    }
+  }
+
+  // the map itself must be there, and every array the size its map needs
+  const uint64_t mapLen = header->mapLen;
+  if (header->mapLen < 1 || header->numRows < 0 || header->numColumns < 0
+      || header->paddedStride < 1 || header->paddedRows < 1 || header->numRooms < 0
+      || ! sectionIs(header, MAPBIN_REFERENCE, mapLen + 1)
+      || ! sectionIs(header, MAPBIN_ROWSTARTS, ((uint64_t)header->numRows + 1) * sizeof(int))
+      || ! sectionIs(header, MAPBIN_TILECOUNTS, 256 * sizeof(int))
+      || ! sectionIs(header, MAPBIN_FLAGS, mapLen + 1)
+      || ! sectionIs(header, MAPBIN_MOVES, mapLen + 1)
+      || ! sectionIs(header, MAPBIN_PADDED,
+                     (uint64_t)header->paddedStride * header->paddedRows)) {
+    return NULL;
+  }
+  const char* reference = mapbin_getSection(header, MAPBIN_REFERENCE, NULL);
+  const uint64_t freeLength = header->sections[MAPBIN_FREETILES].length;
+  if (reference[mapLen] != '\0'
+      || freeLength % sizeof(int) != 0 || freeLength > mapLen * sizeof(int)
+      || ! rowsFit(header)) {
+    return NULL;
+  }
+
+  // rooms and vision are only there if they could be found
+  const uint64_t doorsLength = header->sections[MAPBIN_DOORS].length;
+  if ((header->sections[MAPBIN_ROOMIDS].length != 0
+       && ! sectionIs(header, MAPBIN_ROOMIDS, mapLen * sizeof(int)))
+      || ! sectionIs(header, MAPBIN_ROOMS, (uint64_t)header->numRooms * ROOMS_RECORDLEN * sizeof(int))
+      || doorsLength % sizeof(int) != 0 || ! tilesFit(header)) {
+    return NULL;
+  }
+  const int* visIndex = mapbin_getSection(header, MAPBIN_VISINDEX, NULL);
+  if (visIndex != NULL
+      && (header->visionMode < 0
+          || ! sectionIs(header, MAPBIN_VISINDEX, (mapLen + 1) * sizeof(int))
+          || visIndex[0] != 0 || visIndex[mapLen] < 0
+          || ! sectionIs(header, MAPBIN_VISDATA, (uint64_t)visIndex[mapLen] * sizeof(int)))) {
+    return NULL;
+  }
+  // each tile's vision ends where the next one's starts, within the data
+  for (uint64_t i = 0; visIndex != NULL && i < mapLen; i++) {
+    if (visIndex[i] > visIndex[i + 1]) {
+      return NULL;
+    }
+  }
+  return header;
+}
+
+/**************** mapbin_getSection ***************/
+/* see mapbin.h for details */
+const void* mapbin_getSection(const mapbinheader_t* header, mapsection_t section,
+                              size_t* length)
+{
+  if (header == NULL || section < 0 || section >= MAPBIN_NUMSECTIONS
+      || header->sections[section].length == 0) {
+    if (length != NULL) {
+      *length = 0;
+    }
+    return NULL;
+  }
+  if (length != NULL) {
+    *length = header->sections[section].length;
+  }
+  return (const char*)header + header->sections[section].offset;
+}
+
+/**************** mapbin_close ***************/
+/* see mapbin.h for details */
+void mapbin_close(const void* image, size_t size)
+{
+  if (image != NULL) {
+    munmap((void*)image, size);
+  }
+}
+
+/**************** mapbin_write ***************/
+/* see mapbin.h for details */
+bool mapbin_write(const char* mapFile, mapbinheader_t* header,
+                  const void* const sections[], const size_t lengths[])
+{
+  static const char zeros[64] = { 0 };  // padding up to the next section
+
+  // check params
+  if (mapFile == NULL || header == NULL || sections == NULL || lengths == NULL) {
+    return false;
+  }
+
+  // lay the sections out one after another, each aligned
+  uint64_t offset = sizeof(mapbinheader_t);
+  for (int s = 0; s < MAPBIN_NUMSECTIONS; s++) {
+    if (lengths[s] > 0 && sections[s] == NULL) {
+      return false;
+    }
+    offset = (offset + ALIGN - 1) / ALIGN * ALIGN;
+    header->sections[s].offset = offset;
+    header->sections[s].length = lengths[s];
+    offset += lengths[s];
+  }
+  memcpy(header->magic, MAPBIN_MAGIC, sizeof(header->magic));
+  header->version = MAPBIN_VERSION;
+  header->byteOrder = BYTEORDER;
+  header->unused = 0;
+  header->fileSize = offset;
+
+  FILE* fp = fopen(mapFile, "w");
+  if (fp == NULL) {
+    return false;
+  }
+  bool written = fwrite(header, sizeof(mapbinheader_t), 1, fp) == 1;
+  uint64_t at = sizeof(mapbinheader_t);
+  for (int s = 0; s < MAPBIN_NUMSECTIONS && written; s++) {
+    const uint64_t gap = header->sections[s].offset - at;
+    written = fwrite(zeros, 1, gap, fp) == gap
+      && (lengths[s] == 0 || fwrite(sections[s], 1, lengths[s], fp) == lengths[s]);
+    at = header->sections[s].offset + lengths[s];
+  }
+  // a failed write may only show up once the file is closed
+  written = (fclose(fp) == 0) && written;
+  if (! written) {
+    remove(mapFile);
+  }
+  return written;
+}
+
+/**************** sectionFits ***************/
+/* returns true if the section is aligned and lies within size bytes */
+static bool sectionFits(const mapbinsection_t* section, size_t size)
+{
+  return section->offset % ALIGN == 0 && section->offset >= sizeof(mapbinheader_t)
+    && section->offset <= size && section->length <= size - section->offset;
+}
+
+/**************** sectionIs ***************/
+/* returns true if the given section of the header is length bytes long */
+static bool sectionIs(const mapbinheader_t* header, mapsection_t section, uint64_t length)
+{
+  return header->sections[section].length == length;
+}
+
+/**************** rowsFit ***************/
+/* returns true if the rows of a checked header's map string fit its size:
+ * every row but the last ends in a newline and is at most numColumns + 1
+ * characters, newline included, and the rows make up all mapLen characters
+ * (rows may be shorter than the longest, so mapLen need not be a multiple)
+ * Also that the padded map's stride is a power of 2 with room for a border
+ * on both sides of a row, and its rows the map's plus a border above and below
+ */
+static bool rowsFit(const mapbinheader_t* header)
+{
+  const char* reference = mapbin_getSection(header, MAPBIN_REFERENCE, NULL);
+  const int* rowStarts = mapbin_getSection(header, MAPBIN_ROWSTARTS, NULL);
+  const int64_t mapLen = header->mapLen;
+  const int64_t stride = (int64_t)header->numColumns + 1;
+  const int64_t paddedStride = header->paddedStride;
+
+  if ((paddedStride & (paddedStride - 1)) != 0 || paddedStride < stride + 2
+      || header->paddedRows != (mapLen + stride - 1) / stride + 2
+      || rowStarts[0] != 0 || rowStarts[header->numRows] > mapLen
+      || mapLen - rowStarts[header->numRows] > header->numColumns) {
+    return false;
+  }
+  for (int row = 0; row < header->numRows; row++) {
+    const int64_t length = (int64_t)rowStarts[row + 1] - rowStarts[row];
+    if (length < 1 || length > stride || reference[rowStarts[row + 1] - 1] != '\n') {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**************** tilesFit ***************/
+/* returns true if the tiles a checked header's sections list are on the map:
+ * every free tile is room floor, listed in order, and every tile's room ID
+ * is that of one of the numRooms rooms, or -1
+ */
+static bool tilesFit(const mapbinheader_t* header)
+{
+  size_t freeLength = 0;               // bytes of free tiles
+  const uint8_t* flags = mapbin_getSection(header, MAPBIN_FLAGS, NULL);
+  const int* freeTiles = mapbin_getSection(header, MAPBIN_FREETILES, &freeLength);
+  const int* roomIDs = mapbin_getSection(header, MAPBIN_ROOMIDS, NULL);
+
+  for (size_t i = 0; i < freeLength / sizeof(int); i++) {
+    if (freeTiles[i] < 0 || freeTiles[i] >= header->mapLen
+        || (i > 0 && freeTiles[i] <= freeTiles[i - 1])
+        || (flags[freeTiles[i]] & TILE_ROOM) == 0) {
+      return false;
+    }
+  }
+  for (int i = 0; roomIDs != NULL && i < header->mapLen; i++) {
+    if (roomIDs[i] < -1 || roomIDs[i] >= header->numRooms) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,123 @@
+/*
+ * This file defines the "mapbin" module for my rogue-like
+ * It is the layout of a compiled map: a map file that has already been read,
+ * laid out and split into rooms (see mapcache.h), written by mapc so that
+ * none of that work is left for the server to do when it starts
+ *
+ * A compiled map is a header followed by sections. Each section is one array
+ * exactly as the map cache holds it in memory, starting on a 64-byte
+ * boundary, so a compiled map mapped into memory with mapbin_open is used
+ * where it lies, with nothing parsed or copied. The header says where each
+ * section is, and mapbin_check makes sure that it all fits in the file
+ *
+ * Numbers are written in the byte order of the machine that compiled the map,
+ * and a map compiled on a machine of the other order is refused, as is one
+ * of another version. Compiled maps are cheap to rebuild, so they are not
+ * meant to be kept or shared, just rebuilt along with the program
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __MAPBIN_H
+#define __MAPBIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* the first bytes of every compiled map, null included */
+#define MAPBIN_MAGIC "NUGMAPC"
+/* the version of the layout, bumped whenever any section changes,
+ * or what is calculated into it: 2 since raycast vision marks rectangular
+ * rooms whole
+ */
+#define MAPBIN_VERSION 2
+
+/**************** global types ****************/
+/* the sections of a compiled map, in the order they are written */
+typedef enum mapsection {
+  MAPBIN_REFERENCE,          // the map string, null included (char)
+  MAPBIN_ROWSTARTS,          // where each row starts, numRows + 1 of them (int)
+  MAPBIN_TILECOUNTS,         // how many of each character the map holds, 256 (int)
+  MAPBIN_FLAGS,              // class of every tile, null included (uint8_t)
+  MAPBIN_MOVES,              // move mask of every tile, null included (uint8_t)
+  MAPBIN_PADDED,             // the map laid out with a border (char)
+  MAPBIN_FREETILES,          // every room floor tile, in order (int)
+  MAPBIN_ROOMIDS,            // room ID of every tile, empty if no rooms (int)
+  MAPBIN_ROOMS,              // ROOMS_RECORDLEN ints per room, see rooms.h (int)
+  MAPBIN_DOORS,              // doorways of every room, room by room (int)
+  MAPBIN_VISINDEX,           // where each tile's vision starts in VISDATA,
+                             // mapLen + 1 of them, empty if not compiled (int)
+  MAPBIN_VISDATA,            // positions visible from each walkable tile (int)
+  MAPBIN_NUMSECTIONS
+} mapsection_t;
+
+/* where one section lies in the file, in bytes */
+typedef struct mapbinsection {
+  uint64_t offset;           // from the start of the file, a multiple of 64
+  uint64_t length;           // 0 if the section is empty
+} mapbinsection_t;
+
+/* the header at the start of a compiled map */
+typedef struct mapbinheader {
+  char magic[8];             // MAPBIN_MAGIC
+  uint32_t version;          // MAPBIN_VERSION
+  uint32_t byteOrder;        // 0x01020304, as the compiling machine wrote it
+  uint64_t fileSize;         // bytes in the whole file
+  uint64_t hash;             // FNV-1a hash of the map string
+  int32_t mapLen;            // characters in the map string
+  int32_t numRows;           // rows, see mapload.h
+  int32_t numColumns;        // characters in the longest row
+  int32_t paddedStride;      // distance between rows of the padded map
+  int32_t paddedRows;        // rows of the padded map, borders included
+  int32_t numRooms;          // rooms in the map
+  int32_t visionMode;        // mode vision was compiled with (see grid.h),
+                             // -1 if it wasn't
+  int32_t unused;            // keeps the sections 8-byte aligned
+  mapbinsection_t sections[MAPBIN_NUMSECTIONS];
+} mapbinheader_t;
+
+/**************** functions **************/
+
+/**************** mapbin_open ***************/
+/* maps the given file into memory, read only, if it is a compiled map
+ * stores the size of the file in size
+ * the image must later be unmapped with mapbin_close
+ * returns NULL if the file doesn't start with MAPBIN_MAGIC (a text map),
+ * or on bad params or a file that can't be opened or mapped
+ */
+const void* mapbin_open(const char* mapFile, size_t* size);
+
+/**************** mapbin_check ***************/
+/* returns the header of the compiled map image of size bytes, once it has
+ * checked the magic, version and byte order, that every section lies in the
+ * image, that the sections a map always has are the size the header
+ * says they should be, and that the rows, padded layout, free tiles, room IDs
+ * and vision index all fit the map, so nothing read through them is off it
+ * returns NULL if the image fails any check
+ */
+const mapbinheader_t* mapbin_check(const void* image, size_t size);
+
+/**************** mapbin_getSection ***************/
+/* returns the given section of a checked image, and stores its length
+ * in bytes in length. The section belongs to the image
+ * returns NULL (and stores 0) if the section is empty or on bad params
+ */
+const void* mapbin_getSection(const mapbinheader_t* header, mapsection_t section,
+                              size_t* length);
+
+/**************** mapbin_close ***************/
+/* unmaps an image returned by mapbin_open, does nothing if image is NULL */
+void mapbin_close(const void* image, size_t size);
+
+/**************** mapbin_write ***************/
+/* writes a compiled map to the given file: the header, with its magic,
+ * version, byte order, file size and sections filled in, then
+ * the MAPBIN_NUMSECTIONS sections, lengths[s] bytes of each sections[s]
+ * (which may be NULL if its length is 0)
+ * returns false on bad params or failure to write the file
+ */
+bool mapbin_write(const char* mapFile, mapbinheader_t* header,
+                  const void* const sections[], const size_t lengths[]);
+
+#endif
@@ -0,0 +1,903 @@
+/*
+ * This file implements the "mapcache" module for my rogue-like
+ * The "mapcache" module is defined in mapcache.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "mapcache.h"
+#include "rooms.h"
+#include "components.h"
+#include "mem.h"
+#include "mapload.h"
+#include "mapbin.h"
+#include "tiles.h"
+
+/**************** local types ****************/
+/* a path that leads to a map, several can lead to the same one */
+typedef struct mappath {
+  char* path;                          // path as given to mapcache_acquire
+  struct mapdata* map;                 // map read from it
+  struct mappath* next;                // next path in the cache
+} mappath_t;
+
+/**************** global types ****************/
+/* the arrays of a compiled map point into its image, and are never written */
+typedef struct mapdata {
+  const void* image;                   // compiled map mapped into memory, NULL if text
+  size_t imageSize;                    // bytes in image
+  char* reference;                     // map file read into a string
+  int mapLen;                          // length of reference
+  int numRows;                         // number of rows in the map
+  int numColumns;                      // length of the longest row
+  int* rowStarts;                      // where each row starts, see mapload.h
+  int tileCounts[256];                 // how many of each character the map holds
+  char* padded;                        // the map laid out with a border, see mapcache.h
+  int paddedStride;                    // distance between rows of padded, a power of 2
+  int paddedRows;                      // rows of padded, borders included
+  uint8_t* flags;                      // class of every tile of reference, see tiles.h
+  uint8_t* moves;                      // move mask of every tile, see mapcache.h
+  int* freeTiles;                      // every room floor tile, in order
+  int numFree;                         // number of tiles in freeTiles
+  const int* visIndex;                 // compiled vision, see mapcache_getVision,
+  const int* visData;                  // both NULL if the map has none
+  int visionMode;                      // mode the vision was compiled with, -1 if none
+  char* mapfile;                       // path the map was first read from
+  rooms_t* rooms;                      // rooms of reference, NULL if unknown
+  components_t* components;            // walkable areas of reference, NULL if unknown
+  uint64_t hash;                       // FNV-1a hash of reference
+  int users;                           // acquires not yet released
+  struct mapdata* next;                // next map in the cache
+} mapdata_t;
+
+/**************** file-local global variables ****************/
+static mapdata_t* maps = NULL;         // every map held
+static mappath_t* paths = NULL;        // every path leading to one of them
+static mapcachestats_t counters;       // numMaps and numPaths kept up to date too
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;  // guards all of the above
+
+/**************** local functions ****************/
+static mapdata_t* loadMap(const char* mapFile);
+static bool loadImage(mapdata_t* map);
+static rooms_t* findRooms(mapdata_t* map);
+static bool addPath(const char* mapFile, mapdata_t* map);
+static void deleteMap(mapdata_t* map);
+static uint64_t hashString(const char* string, int length);
+static bool buildLayouts(mapdata_t* map);
+static size_t mapBytes(mapdata_t* map);
+
+/**************** mapcache_acquire ***************/
+/* see mapcache.h for details */
+mapdata_t* mapcache_acquire(const char* mapFile)
+{
+  // check param
+  if (mapFile == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&cacheLock);
+
+  // a path already held needs no disk at all
+  for (mappath_t* p = paths; p != NULL; p = p->next) {
+    if (strcmp(p->path, mapFile) == 0) {
+      p->map->users++;
+      counters.hits++;
+      pthread_mutex_unlock(&cacheLock);
+      return p->map;
+    }
+  }
+
+  // otherwise read it, and share a map with the same contents if there is one
+  mapdata_t* loaded = loadMap(mapFile);
+  if (loaded == NULL) {
+    pthread_mutex_unlock(&cacheLock);
+    return NULL;
+  }
+  counters.reads++;
+  if (loaded->image != NULL) {
+    counters.compiled++;
+  }
+  mapdata_t* map = NULL;
+  for (mapdata_t* m = maps; m != NULL; m = m->next) {
+    if (m->hash == loaded->hash && m->mapLen == loaded->mapLen
+        && memcmp(m->reference, loaded->reference, m->mapLen) == 0) {
+      map = m;
+      break;
+    }
+  }
+  if (map != NULL) {
+    counters.shared++;
+    deleteMap(loaded);
+  } else {
+    // the rooms are only worth finding once the map is known to be new
+    // not critical, vision is calculated the long way without them
+    // a compiled map already holds its layouts, and its rooms
+    // the components are quick to label from the move masks, so every map
+    // has them labelled here rather than saved with it; not critical either
+    map = loaded;
+    if (map->image == NULL && ! buildLayouts(map)) {
+      deleteMap(map);
+      pthread_mutex_unlock(&cacheLock);
+      return NULL;
+    }
+    map->rooms = findRooms(map);
+    map->components = components_new(map->flags, map->moves, map->mapLen, map->numColumns);
+    map->next = maps;
+    maps = map;
+    counters.numMaps++;
+    counters.bytes += mapBytes(map);
+  }
+
+  // remember the path for next time, not critical if that fails
+  addPath(mapFile, map);
+  map->users++;
+  pthread_mutex_unlock(&cacheLock);
+  return map;
+}
+
+/**************** mapcache_retain ***************/
+/* see mapcache.h for details */
+mapdata_t* mapcache_retain(mapdata_t* map)
+{
+  if (map == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock(&cacheLock);
+  map->users++;
+  pthread_mutex_unlock(&cacheLock);
+  return map;
+}
+
+/**************** mapcache_release ***************/
+/* see mapcache.h for details */
+void mapcache_release(mapdata_t* map)
+{
+  if (map == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&cacheLock);
+  if (--map->users > 0) {
+    pthread_mutex_unlock(&cacheLock);
+    return;
+  }
+
+  // forget every path leading to the map, then the map itself
+  mappath_t** pp = &paths;
+  while (*pp != NULL) {
+    mappath_t* p = *pp;
+    if (p->map == map) {
+      *pp = p->next;
+      mem_free(p->path);
+      mem_free(p);
+      counters.numPaths--;
+    } else {
+      pp = &p->next;
+    }
+  }
+  for (mapdata_t** mp = &maps; *mp != NULL; mp = &(*mp)->next) {
+    if (*mp == map) {
+      *mp = map->next;
+      break;
+    }
+  }
+  counters.numMaps--;
+  counters.bytes -= mapBytes(map);
+  pthread_mutex_unlock(&cacheLock);
+
+  deleteMap(map);
+}
+
+/**************** getters ***************/
+/* see mapcache.h for details */
+const char* mapcache_getReference(mapdata_t* map)
+{
+  return map ? map->reference : NULL;
+}
+
+int mapcache_getMapLen(mapdata_t* map)
+{
+  return map ? map->mapLen : 0;
+}
+
+int mapcache_getNumRows(mapdata_t* map)
+{
+  return map ? map->numRows : 0;
+}
+
+int mapcache_getNumColumns(mapdata_t* map)
+{
+  return map ? map->numColumns : 0;
+}
+
+const char* mapcache_getMapfile(mapdata_t* map)
+{
+  return map ? map->mapfile : NULL;
+}
+
+rooms_t* mapcache_getRooms(mapdata_t* map)
+{
+  return map ? map->rooms : NULL;
+}
+
+components_t* mapcache_getComponents(mapdata_t* map)
+{
+  return map ? map->components : NULL;
+}
+
+uint64_t mapcache_getHash(mapdata_t* map)
+{
+  return map ? map->hash : 0;
+}
+
+int mapcache_getRowStart(mapdata_t* map, int row)
+{
+  if (map == NULL || row < 0 || row > map->numRows) {
+    return -1;
+  }
+  return map->rowStarts[row];
+}
+
+int mapcache_getTileCount(mapdata_t* map, char tile)
+{
+  return map ? map->tileCounts[(unsigned char)tile] : 0;
+}
+
+const uint8_t* mapcache_getFlags(mapdata_t* map)
+{
+  return map ? map->flags : NULL;
+}
+
+const uint8_t* mapcache_getMoves(mapdata_t* map)
+{
+  return map ? map->moves : NULL;
+}
+
+const int* mapcache_getFreeTiles(mapdata_t* map, int* count)
+{
+  if (map == NULL || count == NULL) {
+    return NULL;
+  }
+  *count = map->numFree;
+  return map->freeTiles;
+}
+
+int mapcache_getVision(mapdata_t* map, const int** index, const int** data)
+{
+  if (map == NULL || index == NULL || data == NULL || map->visIndex == NULL) {
+    return -1;
+  }
+  *index = map->visIndex;
+  *data = map->visData;
+  return map->visionMode;
+}
+
+const char* mapcache_getPadded(mapdata_t* map, int* stride)
+{
+  if (map == NULL || stride == NULL) {
+    return NULL;
+  }
+  *stride = map->paddedStride;
+  return map->padded;
+}
+
+/**************** mapcache_save ***************/
+/* see mapcache.h for details */
+bool mapcache_save(mapdata_t* map, const char* mapFile,
+                   const int* index, const int* data, int visionMode)
+{
+  mapbinheader_t header;               // filled in the rest of the way by mapbin_write
+  const void* sections[MAPBIN_NUMSECTIONS];
+  size_t lengths[MAPBIN_NUMSECTIONS];
+
+  // check params
+  if (map == NULL || mapFile == NULL
+      || (index != NULL && (visionMode < 0 || (data == NULL && index[map->mapLen] > 0)))) {
+    return false;
+  }
+
+  // the rooms' records and doorways are the only sections not already arrays
+  const int numRooms = rooms_getNumRooms(map->rooms);
+  int* records = NULL;
+  int* doors = NULL;
+  int numDoors = 0;
+  if (numRooms > 0
+      && (records = mem_malloc(numRooms * ROOMS_RECORDLEN * sizeof(int))) == NULL) {
+    return false;
+  }
+  for (int room = 0; room < numRooms; room++) {
+    int count = 0;
+    rooms_getRecord(map->rooms, room, records + room * ROOMS_RECORDLEN);
+    if (rooms_getDoors(map->rooms, room, &count) != NULL) {
+      numDoors += count;
+    }
+  }
+  if (numDoors > 0 && (doors = mem_malloc(numDoors * sizeof(int))) == NULL) {
+    mem_free(records);
+    return false;
+  }
+  for (int room = 0, at = 0; room < numRooms; room++) {
+    int count = 0;
+    const int* roomDoors = rooms_getDoors(map->rooms, room, &count);
+    if (roomDoors != NULL) {
+      memcpy(doors + at, roomDoors, count * sizeof(int));
+      at += count;
+    }
+  }
+
+  memset(&header, 0, sizeof(header));
+  header.hash = map->hash;
+  header.mapLen = map->mapLen;
+  header.numRows = map->numRows;
+  header.numColumns = map->numColumns;
+  header.paddedStride = map->paddedStride;
+  header.paddedRows = map->paddedRows;
+  header.numRooms = numRooms;
+  header.visionMode = index != NULL ? visionMode : -1;
+
+  sections[MAPBIN_REFERENCE] = map->reference;
+  lengths[MAPBIN_REFERENCE] = map->mapLen + 1;
+  sections[MAPBIN_ROWSTARTS] = map->rowStarts;
+  lengths[MAPBIN_ROWSTARTS] = (map->numRows + 1) * sizeof(int);
+  sections[MAPBIN_TILECOUNTS] = map->tileCounts;
+  lengths[MAPBIN_TILECOUNTS] = sizeof(map->tileCounts);
+  sections[MAPBIN_FLAGS] = map->flags;
+  lengths[MAPBIN_FLAGS] = map->mapLen + 1;
+  sections[MAPBIN_MOVES] = map->moves;
+  lengths[MAPBIN_MOVES] = map->mapLen + 1;
+  sections[MAPBIN_PADDED] = map->padded;
+  lengths[MAPBIN_PADDED] = (size_t)map->paddedStride * map->paddedRows;
+  sections[MAPBIN_FREETILES] = map->freeTiles;
+  lengths[MAPBIN_FREETILES] = map->numFree * sizeof(int);
+  sections[MAPBIN_ROOMIDS] = rooms_getIDs(map->rooms);
+  lengths[MAPBIN_ROOMIDS] = map->rooms != NULL ? map->mapLen * sizeof(int) : 0;
+  sections[MAPBIN_ROOMS] = records;
+  lengths[MAPBIN_ROOMS] = numRooms * ROOMS_RECORDLEN * sizeof(int);
+  sections[MAPBIN_DOORS] = doors;
+  lengths[MAPBIN_DOORS] = numDoors * sizeof(int);
+  sections[MAPBIN_VISINDEX] = index;
+  lengths[MAPBIN_VISINDEX] = index != NULL ? (map->mapLen + 1) * sizeof(int) : 0;
+  sections[MAPBIN_VISDATA] = data;
+  lengths[MAPBIN_VISDATA] = index != NULL ? index[map->mapLen] * sizeof(int) : 0;
+
+  bool written = mapbin_write(mapFile, &header, sections, lengths);
+  if (records != NULL) {
+    mem_free(records);
+  }
+  if (doors != NULL) {
+    mem_free(doors);
+  }
+  return written;
+}
+
+/**************** mapcache_getStats ***************/
+/* see mapcache.h for details */
+bool mapcache_getStats(mapcachestats_t* stats)
+{
+  if (stats == NULL) {
+    return false;
+  }
+  pthread_mutex_lock(&cacheLock);
+  *stats = counters;
+  pthread_mutex_unlock(&cacheLock);
+  return true;
+}
+
+/**************** loadMap ***************/
+/* reads the given map file into a new map with no users, not yet in the cache
+ * and without its rooms, which are only found for maps the cache keeps
+ * returns NULL if the file is unreadable or failure to allocate memory
+ */
+static mapdata_t* loadMap(const char* mapFile)
+{
+  mapdata_t* map = NULL;               // map to create
+  maplayout_t layout;                  // rows, columns and tiles of the map
+
+  if ((map = mem_calloc(1, sizeof(mapdata_t))) == NULL) {
+    return NULL;
+  }
+  map->visionMode = -1;
+
+  // a compiled map is used as it lies, and one that fails its checks is refused
+  if ((map->image = mapbin_open(mapFile, &map->imageSize)) != NULL) {
+    if (! loadImage(map)) {
+      deleteMap(map);
+      return NULL;
+    }
+  } else {
+    // one pass over a text file finds everything but the hash
+    if ((map->reference = mapload_read(mapFile, &layout)) == NULL) {
+      deleteMap(map);
+      return NULL;
+    }
+    map->mapLen = layout.mapLen;
+    map->numRows = layout.numRows;
+    map->numColumns = layout.numColumns;
+    map->rowStarts = layout.rowStarts;
+    memcpy(map->tileCounts, layout.tileCounts, sizeof(map->tileCounts));
+    map->hash = hashString(map->reference, map->mapLen);
+  }
+
+  if ((map->mapfile = mem_malloc(strlen(mapFile) + 1)) == NULL) {
+    deleteMap(map);
+    return NULL;
+  }
+  strcpy(map->mapfile, mapFile);
+  return map;
+}
+
+/**************** loadImage ***************/
+/* points the map at the arrays of its compiled image, which are used
+ * as they lie, and fills in its size and hash from the image's header
+ * everything but its rooms, which are only made for maps the cache keeps
+ * returns false if the image fails mapbin_check
+ */
+static bool loadImage(mapdata_t* map)
+{
+  size_t length = 0;                   // bytes in a section
+  const mapbinheader_t* header = mapbin_check(map->image, map->imageSize);
+
+  if (header == NULL) {
+    return false;
+  }
+  map->mapLen = header->mapLen;
+  map->numRows = header->numRows;
+  map->numColumns = header->numColumns;
+  map->hash = header->hash;
+  map->reference = (char*)mapbin_getSection(header, MAPBIN_REFERENCE, NULL);
+  map->rowStarts = (int*)mapbin_getSection(header, MAPBIN_ROWSTARTS, NULL);
+  memcpy(map->tileCounts, mapbin_getSection(header, MAPBIN_TILECOUNTS, NULL),
+         sizeof(map->tileCounts));
+  map->flags = (uint8_t*)mapbin_getSection(header, MAPBIN_FLAGS, NULL);
+  map->moves = (uint8_t*)mapbin_getSection(header, MAPBIN_MOVES, NULL);
+  map->padded = (char*)mapbin_getSection(header, MAPBIN_PADDED, NULL);
+  map->paddedStride = header->paddedStride;
+  map->paddedRows = header->paddedRows;
+  map->freeTiles = (int*)mapbin_getSection(header, MAPBIN_FREETILES, &length);
+  map->numFree = length / sizeof(int);
+  if ((map->visIndex = mapbin_getSection(header, MAPBIN_VISINDEX, NULL)) != NULL) {
+    map->visData = mapbin_getSection(header, MAPBIN_VISDATA, NULL);
+    map->visionMode = header->visionMode;
+  }
+  return true;
+}
+
+/**************** findRooms ***************/
+/* returns the rooms of the map: those saved in its image if it is compiled,
+ * found in its string otherwise
+ * returns NULL if there are none to be had, see rooms_new
+ */
+static rooms_t* findRooms(mapdata_t* map)
+{
+  if (map->image == NULL) {
+    return rooms_new(map->reference, map->numColumns, map->numRows, map->mapLen);
+  }
+  const mapbinheader_t* header = map->image;
+  size_t doorsLength = 0;              // bytes of doorways
+  const int* roomIDs = mapbin_getSection(header, MAPBIN_ROOMIDS, NULL);
+  const int* records = mapbin_getSection(header, MAPBIN_ROOMS, NULL);
+  const int* doors = mapbin_getSection(header, MAPBIN_DOORS, &doorsLength);
+  if (roomIDs == NULL) {
+    return NULL;
+  }
+  return rooms_newShared(roomIDs, records, header->numRooms, doors,
+                         doorsLength / sizeof(int), map->numColumns, map->numRows,
+                         map->mapLen);
+}
+
+/**************** addPath ***************/
+/* remembers that mapFile leads to map
+ * returns false on failure to allocate memory
+ */
+static bool addPath(const char* mapFile, mapdata_t* map)
+{
+  mappath_t* p = mem_malloc(sizeof(mappath_t));
+  if (p == NULL) {
+    return false;
+  }
+  if ((p->path = mem_malloc(strlen(mapFile) + 1)) == NULL) {
+    mem_free(p);
+    return false;
+  }
+  strcpy(p->path, mapFile);
+  p->map = map;
+  p->next = paths;
+  paths = p;
+  counters.numPaths++;
+  return true;
+}
+
+/**************** deleteMap ***************/
+/* free's the map and everything in it, whether or not it was in the cache */
+static void deleteMap(mapdata_t* map)
+{
+  // a compiled map's arrays go with its image
+  if (map->image != NULL) {
+    mapbin_close(map->image, map->imageSize);
+    map->reference = NULL;
+    map->rowStarts = NULL;
+    map->padded = NULL;
+    map->flags = NULL;
+    map->moves = NULL;
+    map->freeTiles = NULL;
+  }
+
+  // free strings if they exist, rooms_delete and components_delete ignore NULL
+  if (map->reference != NULL) {
+    mem_free(map->reference);
+  }
+  if (map->rowStarts != NULL) {
+    mem_free(map->rowStarts);
+  }
+  if (map->padded != NULL) {
+    mem_free(map->padded);
+  }
+  if (map->flags != NULL) {
+    mem_free(map->flags);
+  }
+  if (map->moves != NULL) {
+    mem_free(map->moves);
+  }
+  if (map->freeTiles != NULL) {
+    mem_free(map->freeTiles);
+  }
+  if (map->mapfile != NULL) {
+    mem_free(map->mapfile);
+  }
+  rooms_delete(map->rooms);
+  components_delete(map->components);
+  mem_free(map);
+}
+
+/**************** hashString ***************/
+/* returns the 64-bit FNV-1a hash of the first length characters of string */
+static uint64_t hashString(const char* string, int length)
+{
+  uint64_t hash = 14695981039346656037ULL;   // FNV offset basis
+  for (int i = 0; i < length; i++) {
+    hash ^= (unsigned char)string[i];
+    hash *= 1099511628211ULL;                 // FNV prime
+  }
+  return hash;
+}
+
+/**************** buildLayouts ***************/
+/* builds the flags and move mask of every tile, lists the room floor tiles,
+ * and lays the map out in padded
+ * (see mapcache.h): column x of row y of the map string, where the string
+ * has numColumns + 1 characters to a row, goes to
+ * (y + 1) * paddedStride + (x + 1). Anything past the end of the string or
+ * past numRows rows, and the border all around, is MAPCACHE_OFFMAP
+ * returns false on failure to allocate memory
+ */
+static bool buildLayouts(mapdata_t* map)
+{
+  // the terminating null gets flags too, it is a wall like the edge of the map
+  if ((map->flags = mem_malloc(map->mapLen + 1)) == NULL) {
+    return false;
+  }
+  for (int i = 0; i <= map->mapLen; i++) {
+    map->flags[i] = tiles_class[(unsigned char)map->reference[i]];
+  }
+
+  // a step is open if it lands on a walkable tile of the string
+  if ((map->moves = mem_calloc(map->mapLen + 1, sizeof(uint8_t))) == NULL) {
+    return false;
+  }
+  int offsets[NUM_DIRECTIONS];
+  for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+    offsets[dir] = tiles_stepOffset(dir, map->numColumns);
+  }
+  for (int i = 0; i < map->mapLen; i++) {
+    if ((map->flags[i] & TILE_WALKABLE) == 0) {
+      continue;
+    }
+    for (int dir = 0; dir < NUM_DIRECTIONS; dir++) {
+      int next = i + offsets[dir];
+      if (next >= 0 && next < map->mapLen && (map->flags[next] & TILE_WALKABLE) != 0) {
+        map->moves[i] |= MOVE_BIT(dir);
+      }
+    }
+  }
+
+  // every room floor tile, where grids place gold and players
+  for (int i = 0; i < map->mapLen; i++) {
+    map->numFree += (map->flags[i] & TILE_ROOM) != 0;
+  }
+  if (map->numFree > 0
+      && (map->freeTiles = mem_malloc(map->numFree * sizeof(int))) == NULL) {
+    return false;
+  }
+  for (int i = 0, at = 0; i < map->mapLen; i++) {
+    if ((map->flags[i] & TILE_ROOM) != 0) {
+      map->freeTiles[at++] = i;
+    }
+  }
+
+  const int stride = map->numColumns + 1;            // row length in the string
+  const int stringRows = (map->mapLen + stride - 1) / stride;  // rows the string touches
+
+  // a viewer anywhere in the string has a whole tile of border around it
+  int paddedStride = 1;
+  while (paddedStride < stride + 2) {
+    paddedStride *= 2;
+  }
+  map->paddedStride = paddedStride;
+  map->paddedRows = stringRows + 2;
+  if ((map->padded = mem_malloc((size_t)paddedStride * map->paddedRows)) == NULL) {
+    return false;
+  }
+  memset(map->padded, MAPCACHE_OFFMAP, (size_t)paddedStride * map->paddedRows);
+
+  for (int y = 0; y < map->numRows; y++) {
+    int start = y * stride;
+    int length = start + stride <= map->mapLen ? stride : map->mapLen - start;
+    if (length > 0) {
+      memcpy(map->padded + (y + 1) * paddedStride + 1, map->reference + start, length);
+    }
+  }
+  return true;
+}
+
+/**************** mapBytes ***************/
+/* returns about how many bytes the map holds: its string, flags and
+ * move masks, row starts, free tiles, padded layout, its rooms' index and
+ * its components, or for a compiled map, its image and its components
+ */
+static size_t mapBytes(mapdata_t* map)
+{
+  // the components are worked out at load time even for a compiled map
+  if (map->image != NULL) {
+    return map->imageSize + components_getBytes(map->components);
+  }
+  return components_getBytes(map->components) + 3 * (map->mapLen + 1) + (map->numRows + 1) * sizeof(int)
+    + map->numFree * sizeof(int)
+    + (size_t)map->paddedStride * map->paddedRows
+    + (map->rooms != NULL ? map->mapLen * sizeof(int) : 0);
+}
+
+#ifdef MAPCACHETEST
+#include <stddef.h>
+#include <limits.h>
+#include "unittest.h"
+
+static uint64_t hashLayouts(mapdata_t* map);
+static bool copyStart(const char* from, const char* to, long bytes);
+static bool corruptInt(const char* mapFile, uint64_t offset, int32_t value);
+
+// acquires and releases maps, and checks the cache shares them and frees them
+// usage: mapcachetest mapfile otherpath-to-the-same-mapfile othermapfile
+int
+main(int argc, char* argv[])
+{
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s mapfile samemapfile othermapfile\n", argv[0]);
+    exit(1);
+  }
+  mapcachestats_t stats;
+
+  mapdata_t* first = mapcache_acquire(argv[1]);
+  check(first != NULL, "map loads");
+  check(mapcache_getMapLen(first) == strlen(mapcache_getReference(first)), "map length");
+  check(mapcache_getNumRows(first) > 0 && mapcache_getNumColumns(first) > 0, "map size");
+  const char* reference = mapcache_getReference(first);
+  int floor = 0;
+  for (int i = 0; reference[i] != '\0'; i++) {
+    floor += reference[i] == '.';
+  }
+  check(mapcache_getTileCount(first, '.') == floor, "tile count");
+  check(mapcache_getRowStart(first, 0) == 0
+        && mapcache_getRowStart(first, 1) == strchr(reference, '\n') - reference + 1
+        && mapcache_getRowStart(first, mapcache_getNumRows(first)) == mapcache_getMapLen(first),
+        "row starts");
+  const uint8_t* moves = mapcache_getMoves(first);
+  int right = tiles_stepOffset(DIR_RIGHT, mapcache_getNumColumns(first));
+  bool movesMatch = true;
+  for (int i = 0; reference[i] != '\0'; i++) {
+    bool open = TILE_IS(reference[i], TILE_WALKABLE) && TILE_IS(reference[i + right], TILE_WALKABLE);
+    movesMatch = movesMatch && ((moves[i] & MOVE_BIT(DIR_RIGHT)) != 0) == open;
+  }
+  check(movesMatch, "move masks");
+
+  mapdata_t* again = mapcache_acquire(argv[1]);
+  mapcache_getStats(&stats);
+  check(again == first, "same path shares the map");
+  check(stats.reads == 1 && stats.hits == 1, "same path is not read again");
+
+  mapdata_t* alias = mapcache_acquire(argv[2]);
+  mapcache_getStats(&stats);
+  check(alias == first, "same contents share the map");
+  check(stats.reads == 2 && stats.shared == 1, "other path is read once");
+  check(stats.numMaps == 1 && stats.numPaths == 2, "one map, two paths");
+  check(mapcache_acquire(argv[2]) == first, "other path is remembered");
+  mapcache_getStats(&stats);
+  check(stats.reads == 2 && stats.hits == 2, "other path is not read again");
+
+  mapdata_t* other = mapcache_acquire(argv[3]);
+  mapcache_getStats(&stats);
+  check(other != NULL && other != first, "different map loads on its own");
+  check(stats.numMaps == 2 && stats.numPaths == 3, "two maps, three paths");
+  check(mapcache_getHash(other) != mapcache_getHash(first), "different hashes");
+  check(mapcache_acquire("no/such/map.txt") == NULL, "missing file");
+  check(mapcache_acquire(NULL) == NULL, "NULL path");
+
+  // the first map stays until its fourth release
+  for (int i = 0; i < 3; i++) {
+    mapcache_release(first);
+  }
+  mapcache_getStats(&stats);
+  check(stats.numMaps == 2, "map held while used");
+  mapcache_release(first);
+  mapcache_getStats(&stats);
+  check(stats.numMaps == 1 && stats.numPaths == 1, "map and its paths freed");
+  check(mapcache_retain(other) == other, "retain");
+  mapcache_release(other);
+  mapcache_release(other);
+  mapcache_getStats(&stats);
+  check(stats.numMaps == 0 && stats.numPaths == 0 && stats.bytes == 0, "cache empty");
+
+  // and a path released is read again
+  first = mapcache_acquire(argv[1]);
+  mapcache_getStats(&stats);
+  check(stats.reads == 4, "released path read again");
+
+  // a compiled map loads as the same map, with the same layouts and rooms
+  const char* compiled = "mapcachetest.mapc";
+  const char* truncated = "mapcachetest.part.mapc";
+  const char* withVision = "mapcachetest.vision.mapc";
+  const char* corrupt = "mapcachetest.bad.mapc";
+  const uint64_t layouts = hashLayouts(first);
+  const int index[2] = { 0, 0 };
+  check( ! mapcache_save(first, compiled, index, NULL, -1), "vision with no mode refused");
+  check(mapcache_save(first, compiled, NULL, NULL, 0), "map compiled");
+
+  // vision where each tile sees only itself, for the corrupted maps below
+  const int mapLen = mapcache_getMapLen(first);
+  int* visionIndex = malloc((mapLen + 1) * sizeof(int));
+  int* visionData = malloc(mapLen * sizeof(int));
+  for (int i = 0; visionIndex != NULL && visionData != NULL && i <= mapLen; i++) {
+    visionIndex[i] = i;
+    if (i < mapLen) {
+      visionData[i] = i;
+    }
+  }
+  check(visionIndex != NULL && visionData != NULL
+        && mapcache_save(first, withVision, visionIndex, visionData, 0), "map compiled with vision");
+  free(visionIndex);
+  free(visionData);
+  mapcache_release(first);
+  first = mapcache_acquire(compiled);
+  mapcache_getStats(&stats);
+  check(first != NULL && stats.compiled == 1, "compiled map loads");
+  check(hashLayouts(first) == layouts, "compiled map matches the text map");
+  check(mapcache_acquire(argv[1]) == first, "text map shares the compiled map");
+  const int* visIndex = NULL;
+  const int* visData = NULL;
+  check(mapcache_getVision(first, &visIndex, &visData) == -1, "no vision compiled");
+  mapcache_release(first);
+  mapcache_release(first);
+  check(copyStart(compiled, truncated, 4096) && mapcache_acquire(truncated) == NULL,
+        "truncated compiled map refused");
+
+  // so is one whose sections are all the right size, but lead off the map
+  size_t size = 0;
+  const void* image = mapbin_open(withVision, &size);
+  const mapbinheader_t* header = mapbin_check(image, size);
+  check(header != NULL, "compiled vision checks");
+  if (header != NULL) {
+    const uint8_t* flags = mapbin_getSection(header, MAPBIN_FLAGS, NULL);
+    int wall = 0;                      // first tile that isn't room floor
+    while (wall < mapLen && (flags[wall] & TILE_ROOM) != 0) {
+      wall++;
+    }
+    const uint64_t rowStarts = header->sections[MAPBIN_ROWSTARTS].offset;
+    const uint64_t freeTiles = header->sections[MAPBIN_FREETILES].offset;
+    const uint64_t roomIDs = header->sections[MAPBIN_ROOMIDS].offset;
+    const uint64_t visIndex = header->sections[MAPBIN_VISINDEX].offset;
+    check(copyStart(withVision, corrupt, LONG_MAX)
+          && corruptInt(corrupt, offsetof(mapbinheader_t, paddedStride), header->paddedStride / 2)
+          && corruptInt(corrupt, offsetof(mapbinheader_t, paddedRows), header->paddedRows * 2)
+          && mapcache_acquire(corrupt) == NULL, "padded stride with no room for a border refused");
+    check(copyStart(withVision, corrupt, LONG_MAX)
+          && corruptInt(corrupt, offsetof(mapbinheader_t, numColumns), header->numColumns / 2)
+          && mapcache_acquire(corrupt) == NULL, "rows longer than the columns refused");
+    check(copyStart(withVision, corrupt, LONG_MAX)
+          && corruptInt(corrupt, rowStarts + sizeof(int), mapcache_getRowStart(first, 1) + 1)
+          && mapcache_acquire(corrupt) == NULL, "row with no newline refused");
+    check(copyStart(withVision, corrupt, LONG_MAX)
+          && corruptInt(corrupt, freeTiles, mapLen)
+          && mapcache_acquire(corrupt) == NULL, "free tile off the map refused");
+    check(copyStart(withVision, corrupt, LONG_MAX)
+          && corruptInt(corrupt, freeTiles, wall)
+          && mapcache_acquire(corrupt) == NULL, "free tile off the room floor refused");
+    check(copyStart(withVision, corrupt, LONG_MAX)
+          && corruptInt(corrupt, roomIDs, header->numRooms)
+          && mapcache_acquire(corrupt) == NULL, "room ID past the last room refused");
+    check(copyStart(withVision, corrupt, LONG_MAX)
+          && corruptInt(corrupt, visIndex + sizeof(int), mapLen)
+          && mapcache_acquire(corrupt) == NULL, "vision index going backwards refused");
+    mapbin_close(image, size);
+  }
+  remove(compiled);
+  remove(truncated);
+  remove(withVision);
+  remove(corrupt);
+  mapcache_getStats(&stats);
+  check(stats.numMaps == 0 && stats.bytes == 0, "cache empty again");
+
+  exit(unittest_finish("mapcache"));
+}
+
+
+// returns a hash of everything a map is laid out into, and its rooms
+static uint64_t
+hashLayouts(mapdata_t* map)
+{
+  int stride = 0;
+  int numFree = 0;
+  const char* padded = mapcache_getPadded(map, &stride);
+  const int* freeTiles = mapcache_getFreeTiles(map, &numFree);
+  rooms_t* rooms = mapcache_getRooms(map);
+  const int mapLen = mapcache_getMapLen(map);
+  uint64_t hash = mapcache_getHash(map);
+
+  hash ^= hashString(mapcache_getReference(map), mapLen + 1) * 3;
+  hash ^= hashString((const char*)mapcache_getFlags(map), mapLen + 1) * 5;
+  hash ^= hashString((const char*)mapcache_getMoves(map), mapLen + 1) * 7;
+  hash ^= hashString(padded, stride * (mapcache_getNumRows(map) + 2)) * 11;
+  hash ^= hashString((const char*)freeTiles, numFree * sizeof(int)) * 13;
+  hash ^= hashString((const char*)rooms_getIDs(rooms), mapLen * sizeof(int)) * 17;
+  for (int room = 0; room < rooms_getNumRooms(rooms); room++) {
+    int record[ROOMS_RECORDLEN];
+    int numDoors = 0;
+    rooms_getRecord(rooms, room, record);
+    hash ^= hashString((const char*)record, sizeof(record)) * (19 + room);
+    const int* doors = rooms_getDoors(rooms, room, &numDoors);
+    if (doors != NULL) {
+      hash ^= hashString((const char*)doors, numDoors * sizeof(int)) * (23 + room);
+    }
+  }
+  for (int row = 0; row <= mapcache_getNumRows(map); row++) {
+    hash = hash * 29 + mapcache_getRowStart(map, row);
+  }
+  return hash + mapcache_getNumColumns(map);
+}
+
+// copies the first bytes of one file to another
+static bool
+copyStart(const char* from, const char* to, long bytes)
+{
+  FILE* in = fopen(from, "r");
+  FILE* out = fopen(to, "w");
+  bool copied = in != NULL && out != NULL;
+  for (int c; copied && bytes-- > 0 && (c = fgetc(in)) != EOF; ) {
+    copied = fputc(c, out) != EOF;
+  }
+  if (in != NULL) {
+    fclose(in);
+  }
+  if (out != NULL) {
+    copied = fclose(out) == 0 && copied;
+  }
+  return copied;
+}
+
+// writes value over the int at the given offset of a file
+static bool
+corruptInt(const char* mapFile, uint64_t offset, int32_t value)
+{
+  FILE* fp = fopen(mapFile, "r+");
+  if (fp == NULL) {
+    return false;
+  }
+  bool written = fseek(fp, (long)offset, SEEK_SET) == 0
+    && fwrite(&value, sizeof(value), 1, fp) == 1;
+  return fclose(fp) == 0 && written;
+}
+#endif
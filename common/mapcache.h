@@ -0,0 +1,160 @@
+/*
+ * This file defines the "mapcache" module for my rogue-like
+ * The "mapcache" keeps one copy of each map the process has loaded, shared
+ * by every grid of that map: the reference map string, its size, its rooms
+ * and its walkable components
+ * None of that changes once loaded, so the server's grid and the grid of
+ * every player can point at the same copy, and only keep the active map
+ * (the part that does change) for themselves
+ *
+ * Maps are found by the path they were loaded from, so acquiring a map the
+ * process already holds reads nothing from disk. A path seen for the first time
+ * is read, and if its contents match a map already held (same hash, same
+ * characters) that map is shared and the path remembered for next time
+ *
+ * Each map is also laid out a second way, for code that walks from tile to
+ * tile: every row padded to the same power-of-2 stride, with a border of
+ * MAPCACHE_OFFMAP tiles all around, see mapcache_getPadded. A step to any
+ * neighbour is then a constant offset, and a walk that stops at walls needs
+ * no check for the edges of the map or the newlines between rows
+ *
+ * A map can also be compiled ahead of time, see mapcache_save and mapbin.h
+ * A compiled map is mapped into memory and used where it lies: its string,
+ * layouts, rooms and free tiles are all read from the file as they are, and
+ * vision from every walkable tile can come with it too. mapcache_acquire tells
+ * compiled maps from text ones by their first bytes, so either can be given
+ *
+ * Each map counts its users. mapcache_acquire adds one and mapcache_release
+ * takes one away, and the map is free'd when nobody uses it any more
+ * Every function may be called from several threads at once
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __MAPCACHE_H
+#define __MAPCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "rooms.h"
+#include "components.h"
+
+/* the tile padding the map in mapcache_getPadded, where nothing is */
+#define MAPCACHE_OFFMAP '\0'
+
+/**************** global types ****************/
+typedef struct mapdata mapdata_t;  // opaque to users of the module
+
+/* a snapshot of the cache's counters, see mapcache_getStats */
+typedef struct mapcachestats {
+  int numMaps;               // distinct maps held right now
+  int numPaths;              // paths that lead to those maps
+  unsigned long reads;       // acquires that read a map file
+  unsigned long hits;        // acquires that found the path already held
+  unsigned long shared;      // reads whose contents matched a map already held
+  unsigned long compiled;    // reads that mapped a compiled map
+  size_t bytes;              // bytes of map strings and rooms held
+} mapcachestats_t;
+
+/**************** functions **************/
+
+/**************** mapcache_acquire ***************/
+/* returns the map read from the given file, loading it if no map
+ * of that path or those contents is held yet, and counts one more user of it
+ * every map acquired must be given back with mapcache_release
+ * returns NULL if mapFile is NULL or unreadable, or failure to allocate memory
+ */
+mapdata_t* mapcache_acquire(const char* mapFile);
+
+/**************** mapcache_retain ***************/
+/* counts one more user of a map already acquired, and returns it
+ * returns NULL if map is NULL
+ */
+mapdata_t* mapcache_retain(mapdata_t* map);
+
+/**************** mapcache_release ***************/
+/* counts one less user of the map, and free's it along with every path
+ * leading to it once it has none. Does nothing if map is NULL
+ */
+void mapcache_release(mapdata_t* map);
+
+/**************** getters ***************/
+/* everything returned belongs to the map, must not be modified,
+ * and is only good until the map is released
+ * each returns NULL or 0 if map is NULL
+ */
+
+/* the map string, numRows rows each followed by a newline */
+const char* mapcache_getReference(mapdata_t* map);
+/* length of the map string */
+int mapcache_getMapLen(mapdata_t* map);
+/* number of rows, i.e. lines in the file */
+int mapcache_getNumRows(mapdata_t* map);
+/* length of the longest row, not counting the newline */
+int mapcache_getNumColumns(mapdata_t* map);
+/* the path the map was first loaded from */
+const char* mapcache_getMapfile(mapdata_t* map);
+/* rooms of the map (see rooms.h), NULL if the map could not be split,
+ * all lit. Copy them with rooms_copy to light or darken them
+ */
+rooms_t* mapcache_getRooms(mapdata_t* map);
+/* walkable areas of the map (see components.h), NULL if they could not be
+ * labelled
+ */
+components_t* mapcache_getComponents(mapdata_t* map);
+/* 64-bit FNV-1a hash of the map string */
+uint64_t mapcache_getHash(mapdata_t* map);
+/* position where the given row starts, rows 0 to numRows (see mapload.h),
+ * -1 if the row is out of range
+ */
+int mapcache_getRowStart(mapdata_t* map, int row);
+/* how many times the given character appears in the map string */
+int mapcache_getTileCount(mapdata_t* map, char tile);
+/* the class of every tile of the map string (see tiles.h), mapLen + 1 of them,
+ * the last being the class of the terminating null, which has no flags
+ */
+const uint8_t* mapcache_getFlags(mapdata_t* map);
+/* the move mask of every tile of the map string, mapLen of them: bit
+ * MOVE_BIT(dir) (see tiles.h) is set if a player standing on the tile can
+ * step in direction dir onto a walkable tile. Tiles that can't be walked
+ * on have no bits
+ */
+const uint8_t* mapcache_getMoves(mapdata_t* map);
+/* every room floor tile of the map string, in order, and stores how many in
+ * count. NULL (and count 0) if there are none
+ */
+const int* mapcache_getFreeTiles(mapdata_t* map, int* count);
+/* the vision compiled with the map, if it was: stores where the positions
+ * visible from each tile start in data in index, mapLen + 1 of them, so that
+ * tile pos sees data[index[pos]] up to data[index[pos + 1]]. Only walkable
+ * tiles see anything. Returns the vision mode (see grid.h) it was compiled
+ * with, or -1 (and stores nothing) if the map has no vision or on bad params
+ */
+int mapcache_getVision(mapdata_t* map, const int** index, const int** data);
+/* the map laid out with a border, and stores the distance between its rows,
+ * a power of 2, in stride. Column x of row y (of numColumns + 1 characters,
+ * newline included) is at (y + 1) * stride + (x + 1). Positions past the end
+ * of the map string or past numRows rows, and the border of at least one
+ * tile on every side, hold MAPCACHE_OFFMAP
+ * returns NULL if map or stride is NULL
+ */
+const char* mapcache_getPadded(mapdata_t* map, int* stride);
+
+/**************** mapcache_save ***************/
+/* writes the map, compiled (see mapbin.h), to the given file, along with the
+ * vision given in index and data, laid out as in mapcache_getVision and
+ * calculated with the given mode. Vision is left out if index is NULL
+ * the file can then be given to mapcache_acquire in place of the text map
+ * returns false on bad params or failure to write the file
+ */
+bool mapcache_save(mapdata_t* map, const char* mapFile,
+                   const int* index, const int* data, int visionMode);
+
+/**************** mapcache_getStats ***************/
+/* stores a snapshot of the cache's counters in stats
+ * returns false (and stores nothing) if stats is NULL
+ */
+bool mapcache_getStats(mapcachestats_t* stats);
+
+#endif
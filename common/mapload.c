@@ -0,0 +1,345 @@
+/*
+ * This file implements the "mapload" module for my rogue-like
+ * The "mapload" module is defined in mapload.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L   // open, fstat, mmap
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "mapload.h"
+#include "mem.h"
+
+/**************** file-local constants *******************/
+static const size_t READCHUNK = 65536; // bytes asked of read at once, for files of unknown size
+static const int FIRSTROWS = 64;       // room for row starts before growing
+
+/**************** local functions ****************/
+static char* readMapped(int fd, size_t fileSize, maplayout_t* layout);
+static char* readBuffered(int fd, size_t fileSize, maplayout_t* layout);
+static char* scanMap(const char* bytes, size_t numBytes, char* copy, maplayout_t* layout);
+
+/**************** mapload_read ***************/
+/* see mapload.h for details */
+char* mapload_read(const char* mapFile, maplayout_t* layout)
+{
+  return mapload_readWith(mapFile, layout, MAPLOAD_BEST);
+}
+
+/**************** mapload_readWith ***************/
+/* see mapload.h for details */
+char* mapload_readWith(const char* mapFile, maplayout_t* layout, mapmethod_t method)
+{
+  struct stat info;                    // size and kind of file
+  char* map = NULL;                    // map string to return
+
+  // check params
+  if (mapFile == NULL || layout == NULL) {
+    return NULL;
+  }
+
+  int fd = open(mapFile, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  // only regular files with something in them can be mapped
+  bool mappable = S_ISREG(info.st_mode) && info.st_size > 0;
+  if (method != MAPLOAD_READ && mappable) {
+    map = readMapped(fd, info.st_size, layout);
+  }
+  if (map == NULL && method != MAPLOAD_MMAP) {
+    map = readBuffered(fd, S_ISREG(info.st_mode) ? info.st_size : 0, layout);
+  }
+
+  close(fd);
+  return map;
+}
+
+/**************** mapload_freeLayout ***************/
+/* see mapload.h for details */
+void mapload_freeLayout(maplayout_t* layout)
+{
+  if (layout != NULL && layout->rowStarts != NULL) {
+    mem_free(layout->rowStarts);
+    layout->rowStarts = NULL;
+  }
+}
+
+/**************** readMapped ***************/
+/* maps the file into memory and scans it, copying it into the map string
+ * on the way, so the file is only looked at once
+ * returns the map string, or NULL if the file can't be mapped
+ */
+static char* readMapped(int fd, size_t fileSize, maplayout_t* layout)
+{
+  const char* bytes = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (bytes == MAP_FAILED) {
+    return NULL;
+  }
+  // the whole file is read front to back, once
+  posix_madvise((void*)bytes, fileSize, POSIX_MADV_SEQUENTIAL);
+
+  char* copy = mem_malloc(fileSize + 1);
+  char* map = NULL;
+  if (copy != NULL) {
+    if ((map = scanMap(bytes, fileSize, copy, layout)) == NULL) {
+      mem_free(copy);
+    }
+  }
+  munmap((void*)bytes, fileSize);
+  return map;
+}
+
+/**************** readBuffered ***************/
+/* reads the file into a buffer, which is the map string, and scans it
+ * fileSize is the size of a regular file, so the buffer is allocated once,
+ * or 0 for anything else, in which case the buffer doubles as it fills
+ * returns the map string, or NULL on an empty file, a read error,
+ * or failure to allocate memory
+ */
+static char* readBuffered(int fd, size_t fileSize, maplayout_t* layout)
+{
+  size_t room = fileSize > 0 ? fileSize : READCHUNK;  // bytes the buffer holds
+  size_t numBytes = 0;                                // bytes read so far
+  char* buffer = NULL;                                // the bytes read
+
+  // the file may have been read from already, by a failed mmap attempt
+  if (lseek(fd, 0, SEEK_SET) < 0 && fileSize > 0) {
+    return NULL;
+  }
+  if ((buffer = mem_malloc(room + 1)) == NULL) {
+    return NULL;
+  }
+
+  while (true) {
+    if (numBytes == room) {
+      // only files of unknown size, or ones that grew, end up here
+      char* grown = mem_malloc(2 * room + 1);
+      if (grown == NULL) {
+        mem_free(buffer);
+        return NULL;
+      }
+      memcpy(grown, buffer, numBytes);
+      mem_free(buffer);
+      buffer = grown;
+      room *= 2;
+    }
+    ssize_t got = read(fd, buffer + numBytes, room - numBytes);
+    if (got < 0) {
+      mem_free(buffer);
+      return NULL;
+    }
+    if (got == 0) {
+      break;
+    }
+    numBytes += got;
+  }
+
+  // the scan works in place, the buffer already is the map string
+  char* map = scanMap(buffer, numBytes, buffer, layout);
+  if (map == NULL) {
+    mem_free(buffer);
+  }
+  return map;
+}
+
+/**************** scanMap ***************/
+/* makes the map string from the given bytes in one pass,
+ * stopping at the first '\0' just as strlen would, and fills in the layout
+ * copy must have room for numBytes + 1 characters, and may be bytes itself
+ * returns copy, or NULL if there are no bytes or failure to allocate memory
+ */
+static char* scanMap(const char* bytes, size_t numBytes, char* copy, maplayout_t* layout)
+{
+  int maxRows = FIRSTROWS;             // room in rowStarts
+  int numRows = 0;                     // newlines seen so far
+  int rowStart = 0;                    // where the current row starts
+  int numColumns = 0;                  // longest row so far
+  int counts[256] = { 0 };             // tiles seen so far
+  int* rowStarts = NULL;               // where each row starts
+  size_t i = 0;                        // position in bytes
+
+  if (numBytes == 0) {
+    return NULL;
+  }
+  if ((rowStarts = mem_malloc(maxRows * sizeof(int))) == NULL) {
+    return NULL;
+  }
+  rowStarts[0] = 0;
+
+  for (i = 0; i < numBytes && bytes[i] != '\0'; i++) {
+    const unsigned char c = bytes[i];
+    copy[i] = c;
+    counts[c]++;
+    if (c == '\n') {
+      if (i - rowStart > numColumns) {
+        numColumns = i - rowStart;
+      }
+      rowStart = i + 1;
+      // one more row, and room must be left for the start after it
+      if (++numRows + 1 == maxRows) {
+        int* grown = mem_malloc(2 * maxRows * sizeof(int));
+        if (grown == NULL) {
+          mem_free(rowStarts);
+          return NULL;
+        }
+        memcpy(grown, rowStarts, maxRows * sizeof(int));
+        mem_free(rowStarts);
+        rowStarts = grown;
+        maxRows *= 2;
+      }
+      rowStarts[numRows] = rowStart;
+    }
+  }
+  // a last row with no newline still counts towards the columns
+  if (i - rowStart > numColumns) {
+    numColumns = i - rowStart;
+  }
+  if (i == 0) {
+    mem_free(rowStarts);
+    return NULL;
+  }
+  copy[i] = '\0';
+
+  layout->mapLen = i;
+  layout->numRows = numRows;
+  layout->numColumns = numColumns;
+  layout->rowStarts = rowStarts;
+  memcpy(layout->tileCounts, counts, sizeof(counts));
+  return copy;
+}
+
+#ifdef MAPLOADBENCH
+#include <time.h>
+#include "file.h"
+#include "mapcache.h"
+
+static void writeBigMap(FILE* fp, int numColumns, int numRows);
+static double elapsedMs(struct timespec* start, struct timespec* end);
+
+// times loading a generated 4096x4096 map the old way, with each method
+// of mapload, and through the map cache (which also finds the rooms)
+// usage: loadbench [mapfile], writes the generated map there, by default
+// to a temporary file that is removed afterwards
+int
+main(int argc, char* argv[])
+{
+  const int size = 4096;
+  char path[] = "/tmp/loadbenchXXXXXX";
+  char* mapFile = argc > 1 ? argv[1] : path;
+  struct timespec start, end;
+
+  // generate the map
+  FILE* fp = NULL;
+  if (argc > 1) {
+    fp = fopen(mapFile, "w");
+  } else {
+    int fd = mkstemp(path);
+    fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+  }
+  if (fp == NULL) {
+    fprintf(stderr, "can't write %s\n", mapFile);
+    exit(1);
+  }
+  writeBigMap(fp, size, size);
+  fclose(fp);
+  fprintf(stdout, "map: %s, %dx%d\n", mapFile, size, size);
+
+  // the old way: count lines, read a character at a time, scan for the longest row
+  timespec_get(&start, TIME_UTC);
+  fp = fopen(mapFile, "r");
+  int oldRows = file_numLines(fp);
+  char* oldMap = file_readFile(fp);
+  fclose(fp);
+  int oldLen = strlen(oldMap);
+  int oldColumns = 0;
+  for (int i = 0, rowLen = 0; i < oldLen; i++) {
+    rowLen = oldMap[i] == '\n' ? 0 : rowLen + 1;
+    oldColumns = rowLen > oldColumns ? rowLen : oldColumns;
+  }
+  timespec_get(&end, TIME_UTC);
+  fprintf(stdout, "file_readFile: %.1f ms\n", elapsedMs(&start, &end));
+
+  // each method of mapload, checked against the old way
+  const mapmethod_t methods[] = { MAPLOAD_MMAP, MAPLOAD_READ };
+  const char* names[] = { "mapload mmap", "mapload read" };
+  int failures = 0;
+  for (int m = 0; m < 2; m++) {
+    maplayout_t layout;
+    timespec_get(&start, TIME_UTC);
+    char* map = mapload_readWith(mapFile, &layout, methods[m]);
+    timespec_get(&end, TIME_UTC);
+    bool same = map != NULL && layout.mapLen == oldLen && layout.numRows == oldRows
+      && layout.numColumns == oldColumns && strcmp(map, oldMap) == 0;
+    fprintf(stdout, "%s: %.1f ms, %s\n", names[m], elapsedMs(&start, &end),
+            same ? "same map" : "DIFFERENT map");
+    failures += ! same;
+    if (map != NULL) {
+      mem_free(map);
+      mapload_freeLayout(&layout);
+    }
+  }
+  free(oldMap);
+
+  // and everything a grid waits for at startup
+  timespec_get(&start, TIME_UTC);
+  mapdata_t* map = mapcache_acquire(mapFile);
+  timespec_get(&end, TIME_UTC);
+  fprintf(stdout, "mapcache_acquire: %.1f ms, %d rooms\n", elapsedMs(&start, &end),
+          rooms_getNumRooms(mapcache_getRooms(map)));
+  mapcache_release(map);
+
+  if (argc == 1) {
+    remove(path);
+  }
+  exit(failures == 0 ? 0 : 1);
+}
+
+// writes a map of numRows rows of numColumns characters: a grid of
+// 14x6 rooms, walled and joined by passages, the way most maps look
+static void
+writeBigMap(FILE* fp, int numColumns, int numRows)
+{
+  for (int y = 0; y < numRows; y++) {
+    for (int x = 0; x < numColumns; x++) {
+      int cx = x % 20;                 // column within a block of the grid
+      int cy = y % 10;                 // row within a block of the grid
+      char c = ' ';
+      if (cx >= 1 && cx <= 16 && cy >= 1 && cy <= 8) {
+        if (cy == 1 || cy == 8) {
+          c = (cx == 1 || cx == 16) ? '+' : '-';
+        } else if (cx == 1 || cx == 16) {
+          c = (cy == 4 && cx == 16) ? '#' : '|';
+        } else {
+          c = '.';
+        }
+      } else if (cy == 4 && cx > 16) {
+        c = '#';
+      }
+      fputc(c, fp);
+    }
+    fputc('\n', fp);
+  }
+}
+
+// returns the milliseconds from start to end
+static double
+elapsedMs(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+#endif
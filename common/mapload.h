@@ -0,0 +1,59 @@
+/*
+ * This file defines the "mapload" module for my rogue-like
+ * It reads a map file into a string in one pass, and finds the map's
+ * layout on the way: its rows and columns, where each row starts,
+ * and how many of each tile it holds
+ *
+ * The file is mapped into memory with mmap where the system allows it,
+ * and read into a buffer of the file's size otherwise, so no buffer is
+ * ever grown a character at a time. Either way the result is the same as
+ * file_numLines and file_readFile from libcs50 followed by a scan for the
+ * longest row, which is what grids did before
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __MAPLOAD_H
+#define __MAPLOAD_H
+
+#include <stdbool.h>
+
+/**************** global types ****************/
+/* how mapload_readWith reads the file */
+typedef enum mapmethod {
+  MAPLOAD_BEST,              // mmap, falling back to read if the file can't be mapped
+  MAPLOAD_MMAP,              // mmap only
+  MAPLOAD_READ               // read only
+} mapmethod_t;
+
+/* the layout of a map, filled in by mapload_read */
+typedef struct maplayout {
+  int mapLen;                // characters in the map string
+  int numRows;               // number of newlines, as file_numLines counts them
+  int numColumns;            // characters in the longest row, not counting its newline
+  int* rowStarts;            // position where each row starts, numRows + 1 of them,
+                             // the last being where a row with no newline starts
+                             // (mapLen if the map ends in one)
+  int tileCounts[256];       // how many times each character appears in the map
+} maplayout_t;
+
+/**************** functions **************/
+
+/**************** mapload_read ***************/
+/* reads the given map file, and fills in its layout
+ * returns the map as a string, which the caller must free with mem_free,
+ * along with layout->rowStarts, see mapload_freeLayout
+ * returns NULL (and fills in nothing) if mapFile or layout is NULL,
+ * the file is unreadable or empty, or failure to allocate memory
+ */
+char* mapload_read(const char* mapFile, maplayout_t* layout);
+
+/**************** mapload_readWith ***************/
+/* the same as mapload_read, reading the file the given way */
+char* mapload_readWith(const char* mapFile, maplayout_t* layout, mapmethod_t method);
+
+/**************** mapload_freeLayout ***************/
+/* free's the memory held by the layout, does nothing if layout is NULL */
+void mapload_freeLayout(maplayout_t* layout);
+
+#endif
@@ -11,12 +11,23 @@
 #include <string.h>
 #include "message.h"
 #include "grid.h"
+#include "mapcache.h"
+#include "bitset.h"
+#include "compose.h"
+#include "player.h"
 
 const char DEFAULTCHAR = '?';
+static const char BLANK = ' ';       // a tile the player has never seen
+static const int FIRSTSHOWN = 64;    // room for shown tiles before growing
 
 typedef struct player {
   char* name;           // name provided by client
   grid_t* vision;       // map of user vision
+  bitset_t* visible;    // tiles currently visible to the player
+  int* shown;           // tiles a chunked vision shows as they are, NULL if not chunked
+  int numShown;         // number of positions in shown
+  int maxShown;         // room in shown before it grows
+  bool moved;           // true if pos changed since vision was last updated
   addr_t address;       // address of player
   char charID;          // character representation in game
   int pos;              // index position in the map string
@@ -61,6 +72,12 @@ player_getAddr(player_t* player)
   return player->address;
 }
 
+bool
+player_hasMoved(player_t* player)
+{
+  return player ? player->moved : false;
+}
+
 /***** setter functions **************************************/
 
 grid_t* 
@@ -79,6 +96,9 @@ player_setPos(player_t* player, int pos)
   if ( player == NULL || pos < 0 ) {
     return -1;
   }
+  if ( pos != player->pos ) {
+    player->moved = true;
+  }
   player->pos = pos;
   return player->pos;
 }
@@ -112,6 +132,10 @@ player_setCharID(player_t* player, char newChar)
   return player->charID;
 }
 
+/***** local functions *************************************/
+static bool showVision(player_t* player, grid_t* grid);
+static bool ensureShown(player_t* player, int count);
+
 /***** player_new ********************************************/
 /* see player.h for details */ 
 player_t* 
@@ -137,21 +161,52 @@ player_new(char* name, char* mapfile)
   strcpy(player->name, name);
 
   // the mapfile is verified by the server before ever being passed here
-  grid_t* vision = grid_new(mapfile);
-
-  // initialize values of active vision to be white space
-  char* active = grid_getActive(vision);
-  int mapLen = grid_getMapLen(vision);
+  // its length decides the kind of grid, and the map is already held by the
+  // server's grid, so asking for it reads nothing again
+  mapdata_t* map = mapcache_acquire(mapfile);
+  const int mapLen = mapcache_getMapLen(map);
+  player->shown = NULL;
+  player->numShown = 0;
+  player->maxShown = 0;
+
+  // a large map is kept in chunks, only where the player has seen it
+  grid_t* vision = (mapLen < PLAYER_CHUNKEDLEN) ? grid_new(mapfile)
+                                                : grid_newChunked(mapfile, BLANK);
+  mapcache_release(map);
+  if (vision == NULL) {
+    free(player->name);
+    free(player);
+    return NULL;
+  }
 
-  for(int i = 0; i < mapLen; i++){
-    if(active[i] != '\n'){
-       active[i] = ' ';
+  if (mapLen < PLAYER_CHUNKEDLEN) {
+    // initialize values of active vision to be white space
+    char* active = grid_getActive(vision);
+    for(int i = 0; i < mapLen; i++){
+      if(active[i] != '\n'){
+         active[i] = ' ';
+      }
     }
+  } else if ( ! ensureShown(player, FIRSTSHOWN)) {
+    grid_delete(vision);
+    free(player->name);
+    free(player);
+    return NULL;
+  }
+
+  // the visible set is reused on every move, sized once for the whole map
+  if ((player->visible = bitset_new(mapLen)) == NULL) {
+    grid_delete(vision);
+    free(player->shown);
+    free(player->name);
+    free(player);
+    return NULL;
   }
 
   // initialize all other values address to defaults and return
   player->vision = vision;
   player->pos = -1;
+  player->moved = true;
   player->gold = 0;
   player->charID = DEFAULTCHAR;
   player->address = message_noAddr();
@@ -220,42 +275,92 @@ player_updateVision(player_t* player, grid_t* grid)
     return;
   }
 
-  // initialize the vision array
-  size_t mapLen = grid_getMapLen(grid);
-  int vision[mapLen + 1];
-  //int rowLen = grid_getNumColumns(grid);
+  // populate the visible set, which grid_calculateVision clears first
+  grid_calculateVision(grid, pos, player->visible);
+  player->moved = false;
 
-  for(int i = 0; i < mapLen + 1; i++){
-    vision[i] = 0;
-  }
+  showVision(player, grid);
+  return;
+}
 
-  // populate vision array
-  grid_calculateVision(grid, pos, vision);
-  
-  // grabbing necessary map copies
-  grid_t* currPlayerVision = player_getVision(player);
+/***** player_patchVision ************************************/
+/* see player.h for full details */
+bool
+player_patchVision(player_t* player, grid_t* grid, const int* changes, int count)
+{
+  bool patched = false;                // true once any tile is replaced
+
+  // check parameters
+  if( player == NULL || grid == NULL || changes == NULL || player->pos < 0 ){
+    return false;
+  }
 
   char* globalActive = grid_getActive(grid);
-  char* playerActive = grid_getActive(currPlayerVision);
+  if( globalActive == NULL ){
+    return false;
+  }
 
-  if ( globalActive == NULL ) {
-    return;
+  // the visible set still holds from the player's position, so a changed tile
+  // shows up in the player's vision only if it is in that set
+  for(int i = 0; i < count; i++){
+    int pos = changes[i];
+    if( pos == player->pos || ! bitset_test(player->visible, pos) ){
+      continue;
+    }
+    if( grid_getTile(player->vision, pos) != globalActive[pos] ){
+      grid_replace(player->vision, pos, globalActive[pos]);
+      patched = true;
+    }
   }
 
-  // updating PAST player vision to reference map values
-  // then setting current vision to active map values
-  for(int i = 0; i < mapLen; i++){
-    if( isblank(playerActive[i]) == 0 ){ // is slot is not whitespace, revert it to its reference map tile
-      grid_revertTile(currPlayerVision, i);
-    } 
-    // check if the corresponding value in vision has a value of 1, in which case we use the active map value for this position
-    if( vision[i] == 1 ){
-      char newChar =  globalActive[i];
-      grid_replace(currPlayerVision, i, newChar);
+  return patched;
+}
+
+/***** player_rememberVision *********************************/
+/* see player.h for full details */
+bool
+player_rememberVision(player_t* player, grid_t* grid, int pos)
+{
+  // check parameters
+  if( player == NULL || grid == NULL || pos < 0 || pos >= grid_getMapLen(grid) ){
+    return false;
+  }
+
+  char* playerReference = grid_getReference(player->vision);
+  if( playerReference == NULL ){
+    return false;
+  }
+
+  // a tile seen once is remembered as the reference map shows it, which is
+  // what player_updateVision turns it into once it is out of sight
+  grid_calculateVision(grid, pos, player->visible);
+  for(int tile = bitset_next(player->visible, 0); tile >= 0;
+      tile = bitset_next(player->visible, tile + 1)){
+    if( grid_getTile(player->vision, tile) == BLANK ){
+      grid_replace(player->vision, tile, playerReference[tile]);
     }
   }
+  player->moved = true;
+  return true;
+}
 
-  return;
+/***** player_getBytes ****************************************/
+/* see player.h for full details */
+size_t
+player_getBytes(player_t* player)
+{
+  if( player == NULL ){
+    return 0;
+  }
+  size_t bytes = sizeof(player_t) + grid_getBytes(player->vision)
+    + player->maxShown * sizeof(int);
+  if( player->name != NULL ){
+    bytes += strlen(player->name) + 1;
+  }
+  if( player->visible != NULL ){
+    bytes += (bitset_getSize(player->visible) + 63) / 64 * sizeof(uint64_t);
+  }
+  return bytes;
 }
 
 /***** player_delete *****************************************/
@@ -271,6 +376,10 @@ player_delete(player_t* player)
   if (player->vision != NULL) {
     grid_delete(player->vision);
   }
+  bitset_delete(player->visible);
+  if (player->shown != NULL) {
+    free(player->shown);
+  }
   if (player->name != NULL) {
     free(player->name);
   }
@@ -278,6 +387,83 @@ player_delete(player_t* player)
   free(player);
 }
 
+/***** showVision ********************************************/
+/* shows the player's visible set in their vision: each visible tile as the
+ * grid's active map has it, each tile seen before as the reference map has it,
+ * and each tile never seen as blank
+ * a whole vision is composed in one pass over the map, but a chunked one is
+ * only written where it changes: the tiles it showed as they were go back
+ * to the reference map, then the tiles visible now are shown
+ * returns false if the maps don't match, or on failure to allocate memory
+ */
+static bool
+showVision(player_t* player, grid_t* grid)
+{
+  char* globalActive = grid_getActive(grid);
+  char* playerReference = grid_getReference(player->vision);
+  int mapLen = grid_getMapLen(grid);
+  if( globalActive == NULL || playerReference == NULL
+      || mapLen != grid_getMapLen(player->vision) ){
+    return false;
+  }
+
+  if( player->shown == NULL ){
+    char* playerActive = grid_getActive(player->vision);
+    if( playerActive == NULL ){
+      return false;
+    }
+    // reverting PAST player vision to reference map values
+    // and setting current vision to active map values, in one pass
+    compose_frame(playerActive, playerReference, globalActive,
+                  bitset_getWords(player->visible, NULL), mapLen);
+    return true;
+  }
+
+  // room for every visible tile, and the player's own, which shows them
+  if( ! ensureShown(player, bitset_count(player->visible) + 1) ){
+    return false;
+  }
+  for(int i = 0; i < player->numShown; i++){
+    grid_revertTile(player->vision, player->shown[i]);
+  }
+  player->numShown = 0;
+  for(int tile = bitset_next(player->visible, 0); tile >= 0;
+      tile = bitset_next(player->visible, tile + 1)){
+    grid_replace(player->vision, tile, globalActive[tile]);
+    player->shown[player->numShown++] = tile;
+  }
+  player->shown[player->numShown++] = player->pos;
+  return true;
+}
+
+/***** ensureShown *******************************************/
+/* makes room in the player's shown tiles for count of them, keeping any
+ * already there
+ * returns false on failure to allocate memory
+ */
+static bool
+ensureShown(player_t* player, int count)
+{
+  if( count <= player->maxShown ){
+    return true;
+  }
+  int maxShown = player->maxShown > 0 ? player->maxShown : FIRSTSHOWN;
+  while( maxShown < count ){
+    maxShown *= 2;
+  }
+  int* grown = malloc(maxShown * sizeof(int));
+  if( grown == NULL ){
+    return false;
+  }
+  if( player->shown != NULL ){
+    memcpy(grown, player->shown, player->numShown * sizeof(int));
+    free(player->shown);
+  }
+  player->shown = grown;
+  player->maxShown = maxShown;
+  return true;
+}
+
 /***** unit testing ******************************************/
 /* simple unit test for the player module */
 
@@ -366,3 +552,113 @@ main(const int argc, char* argv[])
 }
 
 #endif
+
+#ifdef VISIONBENCH
+#include <time.h>
+
+static void benchMap(char* mapFile, visionmode_t mode);
+static double elapsedNs(struct timespec* start, struct timespec* end);
+
+// times vision from every walkable tile of each map, with each algorithm
+// usage: visionbench mapfile...
+// prints one CSV row per map and algorithm to stdout
+int
+main(int argc, char* argv[])
+{
+  if( argc < 2 ){
+    fprintf(stderr, "usage: %s mapfile...\n", argv[0]);
+    exit(1);
+  }
+
+  fprintf(stdout, "map,mode,calls,grid_ns_per_call,grid_calls_per_sec,"
+          "player_ns_per_call,player_calls_per_sec,visited_per_call,visible_per_call\n");
+  for(int i = 1; i < argc; i++){
+    benchMap(argv[i], VISION_RAYCAST);
+    benchMap(argv[i], VISION_SHADOWCAST);
+  }
+  exit(0);
+}
+
+// calls grid_calculateVision, then player_updateVision, from every walkable
+// tile of the map with the given algorithm, and prints how they did
+// no vision table is built, so every call runs the algorithm itself
+static void
+benchMap(char* mapFile, visionmode_t mode)
+{
+  struct timespec start, end;          // bounds of each timed loop
+
+  // player_new assumes the map loads, so check that first
+  grid_t* grid = grid_new(mapFile);
+  if( grid == NULL ){
+    fprintf(stderr, "%s: could not load, skipped\n", mapFile);
+    return;
+  }
+  player_t* player = player_new("bench", mapFile);
+  bitset_t* visible = bitset_new(grid_getMapLen(grid));
+  if( player == NULL || visible == NULL ){
+    fprintf(stderr, "%s: out of memory, skipped\n", mapFile);
+    grid_delete(grid);
+    player_delete(player);
+    bitset_delete(visible);
+    return;
+  }
+  grid_setVisionMode(grid, mode);
+
+  char* reference = grid_getReference(grid);
+  int mapLen = grid_getMapLen(grid);
+  long calls = 0;                      // walkable tiles, one call each
+  long seen = 0;                       // visible tiles over all calls
+
+  // the algorithm alone
+  unsigned long visitedBefore = grid_getTilesVisited();
+  timespec_get(&start, TIME_UTC);
+  for(int i = 0; i < mapLen; i++){
+    if( reference[i] == '.' || reference[i] == '#' ){
+      grid_calculateVision(grid, i, visible);
+      calls++;
+    }
+  }
+  timespec_get(&end, TIME_UTC);
+  double gridNs = elapsedNs(&start, &end);
+  unsigned long visited = grid_getTilesVisited() - visitedBefore;
+
+  // and with the player's map brought up to date
+  timespec_get(&start, TIME_UTC);
+  for(int i = 0; i < mapLen; i++){
+    if( reference[i] == '.' || reference[i] == '#' ){
+      player_setPos(player, i);
+      player_updateVision(player, grid);
+    }
+  }
+  timespec_get(&end, TIME_UTC);
+  double playerNs = elapsedNs(&start, &end);
+
+  // count what was seen outside the timed loops
+  for(int i = 0; i < mapLen; i++){
+    if( reference[i] == '.' || reference[i] == '#' ){
+      grid_calculateVision(grid, i, visible);
+      seen += bitset_count(visible);
+    }
+  }
+
+  if( calls > 0 ){
+    fprintf(stdout, "%s,%s,%ld,%.0f,%.0f,%.0f,%.0f,%.1f,%.1f\n",
+            mapFile, mode == VISION_SHADOWCAST ? "shadowcast" : "raycast", calls,
+            gridNs / calls, gridNs > 0 ? 1e9 * calls / gridNs : 0.0,
+            playerNs / calls, playerNs > 0 ? 1e9 * calls / playerNs : 0.0,
+            (double)visited / calls, (double)seen / calls);
+  }
+
+  bitset_delete(visible);
+  player_delete(player);
+  grid_delete(grid);
+}
+
+// nanoseconds from start to end
+static double
+elapsedNs(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+#endif
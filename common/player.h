@@ -20,6 +20,15 @@
 
 typedef struct player player_t; // opaque to users of the module
 
+/* maps of at least this many tiles give each player a chunked vision grid
+ * (see grid_newChunked), which only holds the parts of the map they have
+ * seen; smaller maps keep a whole copy, which composes faster
+ * e.g. make FLAGS=-DPLAYER_CHUNKEDLEN=0 to chunk every player's vision
+ */
+#ifndef PLAYER_CHUNKEDLEN
+#define PLAYER_CHUNKEDLEN 16384
+#endif
+
 /***** functions *********************************************/
 
 /***** getters ***********************************************/
@@ -38,6 +47,10 @@ int player_getGold(player_t* player);
 /* NOTE: This DOES NOT check for NULL within func. Only use on non-null players */
 addr_t player_getAddr(player_t* player);
 
+/* player_hasMoved returns true if the player's position changed since their
+ * vision was last updated (or it never was), false if not or on a NULL argument */
+bool player_hasMoved(player_t* player);
+
 /***** setters ***********************************************/
 /* set the value of various attributes of a player struct and return their value */
 
@@ -77,6 +90,26 @@ int player_addGold(player_t* player, int newGold);
  */
 void player_updateVision(player_t* player, grid_t* grid);
 
+/***** player_patchVision ************************************/
+/* Brings a player's vision up to date after the given positions of the server's
+ * grid changed, without recalculating what the player can see
+ * Only valid if the player has not moved since their last player_updateVision,
+ * see player_hasMoved. Positions outside the player's visible set stay as
+ * the player remembers them, and the player's own position is left alone
+ * Returns true if the player's vision changed, false if not or on bad params
+ */
+bool player_patchVision(player_t* player, grid_t* grid, const int* changes, int count);
+
+/***** player_rememberVision *********************************/
+/* Marks every tile visible from pos as seen in the player's vision,
+ * as if the player had stood there, for a player who passes over pos
+ * without being shown it (a run move, see grid_getRunLength)
+ * The player's visible set is used to hold it, and is only good again
+ * after the next player_updateVision
+ * Returns true on success, false on bad params
+ */
+bool player_rememberVision(player_t* player, grid_t* grid, int pos);
+
 /***** player_summarize **************************************/
 /* creates a summary of the player for printing when the game ends
  * returns the properly formatted summary string on success
@@ -85,6 +118,12 @@ void player_updateVision(player_t* player, grid_t* grid);
  */
 char* player_summarize(player_t* player);
 
+/***** player_getBytes ****************************************/
+/* returns about how many bytes the player holds: their vision grid
+ * (see grid_getBytes), visible set and name, 0 if player is NULL
+ */
+size_t player_getBytes(player_t* player);
+
 /***** player_delete *****************************************/
 /* Deletes a player struct allocated memory. 
  * Takes a pointer to a player struct, to be deleted, as parameter
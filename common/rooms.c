@@ -0,0 +1,454 @@
+/*
+ * This file implements the "rooms" module for my rogue-like
+ * The "rooms" module is defined in rooms.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include "rooms.h"
+#include "mem.h"
+
+/**************** file-local constants *******************/
+static const char ROOMTILE = '.';      // char representation of room floor
+static const char PASSAGETILE = '#';   // char representation of passage tile
+
+/**************** local types ****************/
+typedef struct room {
+  int left, top;                       // column and row of the top left tile
+  int right, bottom;                   // column and row of the bottom right tile
+  int numTiles;                        // number of floor tiles
+  bool rectangular;                    // true if floor fills the box, see rooms.h
+  bool lit;                            // true if the room is lit, see rooms.h
+  int* doors;                          // doorway positions, NULL if none
+  int numDoors;                        // number of positions in doors
+} room_t;
+
+/**************** global types ****************/
+typedef struct rooms {
+  int* roomIDs;                        // room ID of each position, -1 if none
+  room_t* rooms;                       // the rooms, indexed by ID
+  int numRooms;                        // number of rooms
+  int maxRooms;                        // room for rooms before growing
+  int numColumns;                      // characters per row, not counting '\n'
+  int numRows;                         // rows in the map
+  int mapLen;                          // length of the map string
+  bool shared;                         // true if roomIDs and doors belong to someone else
+} rooms_t;
+
+/**************** local functions ****************/
+static int newRoom(rooms_t* rooms);
+static bool fillRoom(rooms_t* rooms, const char* map, int start, int* stack);
+static bool checkRectangular(rooms_t* rooms, const char* map, room_t* room);
+static int ringPos(rooms_t* rooms, int x, int y);
+
+/**************** rooms_new ***************/
+/* see rooms.h for details */
+rooms_t* rooms_new(const char* map, int numColumns, int numRows, int mapLen)
+{
+  rooms_t* rooms = NULL;               // rooms to create
+  int* stack = NULL;                   // positions left to visit in a flood fill
+
+  // check params
+  if (map == NULL || numColumns < 1 || numRows < 1 || mapLen < 1) {
+    return NULL;
+  }
+
+  if ((rooms = mem_calloc(1, sizeof(rooms_t))) == NULL) {
+    return NULL;
+  }
+  rooms->numColumns = numColumns;
+  rooms->numRows = numRows;
+  rooms->mapLen = mapLen;
+
+  // a flood fill never holds more than one of each position
+  if ((rooms->roomIDs = mem_malloc(mapLen * sizeof(int))) == NULL
+      || (stack = mem_malloc(mapLen * sizeof(int))) == NULL) {
+    rooms_delete(rooms);
+    return NULL;
+  }
+  for (int i = 0; i < mapLen; i++) {
+    rooms->roomIDs[i] = -1;
+  }
+
+  // every floor tile not yet in a room starts a new one
+  int onMap = numRows * (numColumns + 1);
+  for (int i = 0; i < mapLen && i < onMap; i++) {
+    if (map[i] == ROOMTILE && rooms->roomIDs[i] < 0) {
+      if (! fillRoom(rooms, map, i, stack)) {
+        mem_free(stack);
+        rooms_delete(rooms);
+        return NULL;
+      }
+    }
+  }
+
+  mem_free(stack);
+  return rooms;
+}
+
+/**************** rooms_newShared ***************/
+/* see rooms.h for details */
+rooms_t* rooms_newShared(const int* roomIDs, const int* records, int numRooms,
+                         const int* doors, int numDoors,
+                         int numColumns, int numRows, int mapLen)
+{
+  rooms_t* rooms = NULL;               // rooms to create
+
+  // check params
+  if (roomIDs == NULL || (records == NULL && numRooms > 0) || numRooms < 0
+      || (doors == NULL && numDoors > 0) || numDoors < 0
+      || numColumns < 1 || numRows < 1 || mapLen < 1) {
+    return NULL;
+  }
+
+  if ((rooms = mem_calloc(1, sizeof(rooms_t))) == NULL) {
+    return NULL;
+  }
+  rooms->numColumns = numColumns;
+  rooms->numRows = numRows;
+  rooms->mapLen = mapLen;
+  rooms->shared = true;
+  rooms->roomIDs = (int*)roomIDs;
+  if (numRooms > 0 && (rooms->rooms = mem_calloc(numRooms, sizeof(room_t))) == NULL) {
+    rooms_delete(rooms);
+    return NULL;
+  }
+  rooms->maxRooms = numRooms;
+
+  // only the rooms themselves are made, the doorways stay where they are
+  int firstDoor = 0;
+  for (int id = 0; id < numRooms; id++) {
+    const int* record = records + id * ROOMS_RECORDLEN;
+    room_t* room = &rooms->rooms[rooms->numRooms++];
+    room->left = record[0];
+    room->top = record[1];
+    room->right = record[2];
+    room->bottom = record[3];
+    room->numTiles = record[4];
+    room->rectangular = record[5] != 0;
+    room->numDoors = record[6];
+    room->lit = true;
+    if (room->numDoors < 0 || room->numDoors > numDoors - firstDoor) {
+      rooms_delete(rooms);
+      return NULL;
+    }
+    room->doors = room->numDoors > 0 ? (int*)doors + firstDoor : NULL;
+    firstDoor += room->numDoors;
+  }
+  if (firstDoor != numDoors) {
+    rooms_delete(rooms);
+    return NULL;
+  }
+  return rooms;
+}
+
+/**************** rooms_copy ***************/
+/* see rooms.h for details */
+rooms_t* rooms_copy(rooms_t* rooms)
+{
+  rooms_t* copy = NULL;                // copy to create
+
+  // check param
+  if (rooms == NULL) {
+    return NULL;
+  }
+
+  if ((copy = mem_calloc(1, sizeof(rooms_t))) == NULL) {
+    return NULL;
+  }
+  *copy = *rooms;
+  copy->shared = false;
+  copy->roomIDs = NULL;
+  copy->rooms = NULL;
+  copy->numRooms = 0;
+
+  // the arrays are copied, along with every room's doorways
+  if ((copy->roomIDs = mem_malloc(rooms->mapLen * sizeof(int))) == NULL
+      || (rooms->maxRooms > 0
+          && (copy->rooms = mem_calloc(rooms->maxRooms, sizeof(room_t))) == NULL)) {
+    rooms_delete(copy);
+    return NULL;
+  }
+  memcpy(copy->roomIDs, rooms->roomIDs, rooms->mapLen * sizeof(int));
+  for (int i = 0; i < rooms->numRooms; i++) {
+    copy->rooms[i] = rooms->rooms[i];
+    copy->rooms[i].doors = NULL;
+    copy->numRooms++;
+    int numDoors = rooms->rooms[i].numDoors;
+    if (rooms->rooms[i].doors != NULL) {
+      if ((copy->rooms[i].doors = mem_malloc(numDoors * sizeof(int))) == NULL) {
+        rooms_delete(copy);
+        return NULL;
+      }
+      memcpy(copy->rooms[i].doors, rooms->rooms[i].doors, numDoors * sizeof(int));
+    }
+  }
+
+  return copy;
+}
+
+/**************** getters ***************/
+/* see rooms.h for details */
+int rooms_getNumRooms(rooms_t* rooms)
+{
+  return rooms ? rooms->numRooms : 0;
+}
+
+int rooms_getRoom(rooms_t* rooms, int pos)
+{
+  if (rooms == NULL || pos < 0 || pos >= rooms->mapLen) {
+    return -1;
+  }
+  return rooms->roomIDs[pos];
+}
+
+bool rooms_getBounds(rooms_t* rooms, int room, int* left, int* top,
+                     int* right, int* bottom)
+{
+  if (rooms == NULL || room < 0 || room >= rooms->numRooms
+      || left == NULL || top == NULL || right == NULL || bottom == NULL) {
+    return false;
+  }
+  *left = rooms->rooms[room].left;
+  *top = rooms->rooms[room].top;
+  *right = rooms->rooms[room].right;
+  *bottom = rooms->rooms[room].bottom;
+  return true;
+}
+
+int rooms_getNumTiles(rooms_t* rooms, int room)
+{
+  if (rooms == NULL || room < 0 || room >= rooms->numRooms) {
+    return 0;
+  }
+  return rooms->rooms[room].numTiles;
+}
+
+bool rooms_isRectangular(rooms_t* rooms, int room)
+{
+  if (rooms == NULL || room < 0 || room >= rooms->numRooms) {
+    return false;
+  }
+  return rooms->rooms[room].rectangular;
+}
+
+bool rooms_isLit(rooms_t* rooms, int room)
+{
+  if (rooms == NULL || room < 0 || room >= rooms->numRooms) {
+    return false;
+  }
+  return rooms->rooms[room].lit;
+}
+
+bool rooms_setLit(rooms_t* rooms, int room, bool lit)
+{
+  if (rooms == NULL || room < 0 || room >= rooms->numRooms) {
+    return false;
+  }
+  rooms->rooms[room].lit = lit;
+  return true;
+}
+
+const int* rooms_getDoors(rooms_t* rooms, int room, int* count)
+{
+  if (rooms == NULL || count == NULL || room < 0 || room >= rooms->numRooms
+      || rooms->rooms[room].doors == NULL) {
+    return NULL;
+  }
+  *count = rooms->rooms[room].numDoors;
+  return rooms->rooms[room].doors;
+}
+
+const int* rooms_getIDs(rooms_t* rooms)
+{
+  return rooms ? rooms->roomIDs : NULL;
+}
+
+bool rooms_getRecord(rooms_t* rooms, int room, int* record)
+{
+  if (rooms == NULL || record == NULL || room < 0 || room >= rooms->numRooms) {
+    return false;
+  }
+  const room_t* r = &rooms->rooms[room];
+  record[0] = r->left;
+  record[1] = r->top;
+  record[2] = r->right;
+  record[3] = r->bottom;
+  record[4] = r->numTiles;
+  record[5] = r->rectangular ? 1 : 0;
+  record[6] = r->numDoors;
+  return true;
+}
+
+/**************** rooms_delete ***************/
+/* see rooms.h for details */
+void rooms_delete(rooms_t* rooms)
+{
+  if (rooms == NULL) {
+    return;
+  }
+
+  // shared rooms only made the rooms themselves
+  for (int i = 0; i < rooms->numRooms && ! rooms->shared; i++) {
+    if (rooms->rooms[i].doors != NULL) {
+      mem_free(rooms->rooms[i].doors);
+    }
+  }
+  if (rooms->rooms != NULL) {
+    mem_free(rooms->rooms);
+  }
+  if (rooms->roomIDs != NULL && ! rooms->shared) {
+    mem_free(rooms->roomIDs);
+  }
+  mem_free(rooms);
+}
+
+/**************** newRoom ***************/
+/* adds an empty room to the end of rooms, doubling the array when it is full
+ * returns the new room's ID, or -1 on failure to allocate memory
+ */
+static int newRoom(rooms_t* rooms)
+{
+  if (rooms->numRooms == rooms->maxRooms) {
+    int maxRooms = rooms->maxRooms > 0 ? rooms->maxRooms * 2 : 16;
+    room_t* grown = mem_malloc(maxRooms * sizeof(room_t));
+    if (grown == NULL) {
+      return -1;
+    }
+    if (rooms->rooms != NULL) {
+      memcpy(grown, rooms->rooms, rooms->numRooms * sizeof(room_t));
+      mem_free(rooms->rooms);
+    }
+    rooms->rooms = grown;
+    rooms->maxRooms = maxRooms;
+  }
+
+  room_t* room = &rooms->rooms[rooms->numRooms];
+  memset(room, 0, sizeof(room_t));
+  room->lit = true;
+  return rooms->numRooms++;
+}
+
+/**************** fillRoom ***************/
+/* flood fills the room containing start, which must be unvisited floor,
+ * giving each of its tiles the new room's ID and recording its bounds
+ * stack must have room for mapLen positions
+ * returns false on failure to allocate memory
+ */
+static bool fillRoom(rooms_t* rooms, const char* map, int start, int* stack)
+{
+  const int stride = rooms->numColumns + 1;  // distance between rows
+  int top = 0;                               // number of positions on the stack
+  int id = newRoom(rooms);                   // ID of the room being filled
+
+  if (id < 0) {
+    return false;
+  }
+  room_t* room = &rooms->rooms[id];
+  room->left = room->right = start % stride;
+  room->top = room->bottom = start / stride;
+
+  rooms->roomIDs[start] = id;
+  stack[top++] = start;
+  while (top > 0) {
+    int pos = stack[--top];
+    int x = pos % stride;
+    int y = pos / stride;
+
+    room->numTiles++;
+    if (x < room->left) room->left = x;
+    if (x > room->right) room->right = x;
+    if (y < room->top) room->top = y;
+    if (y > room->bottom) room->bottom = y;
+
+    // push each unvisited floor tile around this one, diagonals included
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        int nx = x + dx;
+        int ny = y + dy;
+        if (nx < 0 || nx >= rooms->numColumns || ny < 0 || ny >= rooms->numRows) {
+          continue;
+        }
+        int next = ny * stride + nx;
+        if (next < rooms->mapLen && map[next] == ROOMTILE && rooms->roomIDs[next] < 0) {
+          rooms->roomIDs[next] = id;
+          stack[top++] = next;
+        }
+      }
+    }
+  }
+
+  return checkRectangular(rooms, map, room);
+}
+
+/**************** checkRectangular ***************/
+/* decides whether a filled room is rectangular, and if it is records its doorways
+ * returns false on failure to allocate memory
+ */
+static bool checkRectangular(rooms_t* rooms, const char* map, room_t* room)
+{
+  int width = room->right - room->left + 1;
+  int height = room->bottom - room->top + 1;
+  int numDoors = 0;
+
+  room->rectangular = false;
+  if (room->numTiles != width * height) {
+    return true;
+  }
+
+  // the whole ring must be on the map, and every tile of it must block sight
+  for (int y = room->top - 1; y <= room->bottom + 1; y++) {
+    for (int x = room->left - 1; x <= room->right + 1; x++) {
+      int pos = ringPos(rooms, x, y);
+      if (pos == -1) {
+        continue;
+      }
+      if (pos < -1 || map[pos] == '\n' || map[pos] == '\0' || isalpha(map[pos]) != 0) {
+        return true;
+      }
+      if (map[pos] == PASSAGETILE) {
+        numDoors++;
+      }
+    }
+  }
+  room->rectangular = true;
+
+  // then record the doorways
+  if (numDoors == 0) {
+    return true;
+  }
+  if ((room->doors = mem_malloc(numDoors * sizeof(int))) == NULL) {
+    return false;
+  }
+  for (int y = room->top - 1; y <= room->bottom + 1; y++) {
+    for (int x = room->left - 1; x <= room->right + 1; x++) {
+      int pos = ringPos(rooms, x, y);
+      if (pos >= 0 && map[pos] == PASSAGETILE) {
+        room->doors[room->numDoors++] = pos;
+      }
+    }
+  }
+  return true;
+}
+
+/**************** ringPos ***************/
+/* returns the position at column x and row y, -1 if that is inside the
+ * room being checked (it's only called on the room's box and ring),
+ * or -2 if it is off the map
+ */
+static int ringPos(rooms_t* rooms, int x, int y)
+{
+  if (x < 0 || x >= rooms->numColumns || y < 0 || y >= rooms->numRows) {
+    return -2;
+  }
+  int pos = y * (rooms->numColumns + 1) + x;
+  if (pos >= rooms->mapLen) {
+    return -2;
+  }
+  return rooms->roomIDs[pos] >= 0 ? -1 : pos;
+}
@@ -0,0 +1,126 @@
+/*
+ * This file defines the "rooms" module for my rogue-like
+ * A "rooms" structure splits a map into rooms: regions of room floor ('.')
+ * where each floor tile touches the next, including diagonally
+ * Every room gets an ID from 0 up, along with its bounding box,
+ * its number of tiles, and its doorways (the passage tiles ('#')
+ * on the ring of tiles just outside its bounding box)
+ *
+ * A room whose floor fills its bounding box, and whose ring is made up only
+ * of walls and doorways that are all on the map, is "rectangular"
+ * Nothing outside such a room can be seen from inside it, and nothing inside
+ * is hidden, so the vision from any of its tiles is the box plus its ring
+ *
+ * Every room starts out lit. A dark room is only seen as far as the light
+ * around the viewer reaches, see grid_setLightRadius in grid.h
+ *
+ * Positions are indices into the map string, laid out as in grid.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __ROOMS_H
+#define __ROOMS_H
+
+#include <stdbool.h>
+
+/* ints in the record of a room, see rooms_getRecord */
+#define ROOMS_RECORDLEN 7
+
+/**************** global types ****************/
+typedef struct rooms rooms_t;  // opaque to users of the module
+
+/**************** functions **************/
+
+/**************** rooms_new ***************/
+/* finds every room in the given map string, which has numRows rows of
+ * numColumns characters each followed by a newline, and mapLen characters in all
+ * anything past numRows rows is treated as off the map
+ * allocates memory that must be free'd with rooms_delete
+ * returns NULL on bad params or failure to allocate memory
+ */
+rooms_t* rooms_new(const char* map, int numColumns, int numRows, int mapLen);
+
+/**************** rooms_newShared ***************/
+/* creates rooms already found, as saved in a compiled map (see mapbin.h),
+ * without copying the arrays they are given: roomIDs holds the room ID of
+ * each of the mapLen positions, records holds the record (see rooms_getRecord)
+ * of each of the numRooms rooms, and doors every room's doorways, room by room,
+ * numDoors of them in all. The arrays must outlive the rooms
+ * allocates memory that must be free'd with rooms_delete
+ * returns NULL on bad params, doorways that don't add up to numDoors,
+ * or failure to allocate memory
+ */
+rooms_t* rooms_newShared(const int* roomIDs, const int* records, int numRooms,
+                         const int* doors, int numDoors,
+                         int numColumns, int numRows, int mapLen);
+
+/**************** rooms_copy ***************/
+/* creates a copy of rooms, which can be lit and darkened on its own
+ * allocates memory that must be free'd with rooms_delete
+ * returns NULL if rooms is NULL or failure to allocate memory
+ */
+rooms_t* rooms_copy(rooms_t* rooms);
+
+/**************** rooms_getNumRooms ***************/
+/* returns the number of rooms found, 0 if rooms is NULL */
+int rooms_getNumRooms(rooms_t* rooms);
+
+/**************** rooms_getRoom ***************/
+/* returns the ID of the room the given position is in,
+ * or -1 if it is not room floor, out of bounds, or rooms is NULL
+ */
+int rooms_getRoom(rooms_t* rooms, int pos);
+
+/**************** rooms_getBounds ***************/
+/* stores the column and row of the room's top left and bottom right tiles
+ * returns false (and stores nothing) on bad params
+ */
+bool rooms_getBounds(rooms_t* rooms, int room, int* left, int* top,
+                     int* right, int* bottom);
+
+/**************** rooms_getNumTiles ***************/
+/* returns the number of floor tiles in the room, 0 on bad params */
+int rooms_getNumTiles(rooms_t* rooms, int room);
+
+/**************** rooms_isRectangular ***************/
+/* returns true if the room is rectangular (see above), false if not or on bad params */
+bool rooms_isRectangular(rooms_t* rooms, int room);
+
+/**************** rooms_isLit ***************/
+/* returns true if the room is lit, false if it is dark or on bad params */
+bool rooms_isLit(rooms_t* rooms, int room);
+
+/**************** rooms_setLit ***************/
+/* makes the room lit or dark
+ * returns false (and changes nothing) on bad params
+ */
+bool rooms_setLit(rooms_t* rooms, int room, bool lit);
+
+/**************** rooms_getDoors ***************/
+/* returns the positions of the room's doorways and stores how many in count
+ * only rectangular rooms have their doorways recorded
+ * the returned array belongs to rooms, returns NULL (and leaves count alone)
+ * if the room has no doorways or on bad params
+ */
+const int* rooms_getDoors(rooms_t* rooms, int room, int* count);
+
+/**************** rooms_getIDs ***************/
+/* returns the room ID of every position, -1 where there is no room
+ * the array belongs to rooms, returns NULL if rooms is NULL
+ */
+const int* rooms_getIDs(rooms_t* rooms);
+
+/**************** rooms_getRecord ***************/
+/* stores the ROOMS_RECORDLEN ints that rooms_newShared rebuilds the room from
+ * in record: its left, top, right and bottom, its number of tiles,
+ * 1 if it is rectangular (0 if not), and its number of doorways
+ * returns false (and stores nothing) on bad params
+ */
+bool rooms_getRecord(rooms_t* rooms, int room, int* record);
+
+/**************** rooms_delete ***************/
+/* free's all memory held by rooms */
+void rooms_delete(rooms_t* rooms);
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * This file implements the "tiles" module for my rogue-like
+ * The "tiles" module is defined in tiles.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdint.h>
+#include "tiles.h"
+
+/* every letter is transparent, as vision always treated them
+ * the upper case ones are players, who can be stepped onto to swap places
+ */
+#define PLAYER (TILE_TRANSPARENT | TILE_OCCUPIED | TILE_PLAYER)
+#define LETTER (TILE_TRANSPARENT)
+
+/**************** tiles_class ***************/
+/* see tiles.h for details, characters not listed have no flags:
+ * walls ('-', '|', '+'), blanks, newlines and anything else block vision
+ * and can't be walked on
+ */
+const uint8_t tiles_class[256] = {
+  ['.'] = TILE_WALKABLE | TILE_TRANSPARENT | TILE_ROOM,
+  ['#'] = TILE_WALKABLE | TILE_PASSAGE,
+  ['*'] = TILE_OCCUPIED | TILE_GOLD,
+
+  ['A'] = PLAYER, ['B'] = PLAYER, ['C'] = PLAYER, ['D'] = PLAYER, ['E'] = PLAYER,
+  ['F'] = PLAYER, ['G'] = PLAYER, ['H'] = PLAYER, ['I'] = PLAYER, ['J'] = PLAYER,
+  ['K'] = PLAYER, ['L'] = PLAYER, ['M'] = PLAYER, ['N'] = PLAYER, ['O'] = PLAYER,
+  ['P'] = PLAYER, ['Q'] = PLAYER, ['R'] = PLAYER, ['S'] = PLAYER, ['T'] = PLAYER,
+  ['U'] = PLAYER, ['V'] = PLAYER, ['W'] = PLAYER, ['X'] = PLAYER, ['Y'] = PLAYER,
+  ['Z'] = PLAYER,
+
+  ['a'] = LETTER, ['b'] = LETTER, ['c'] = LETTER, ['d'] = LETTER, ['e'] = LETTER,
+  ['f'] = LETTER, ['g'] = LETTER, ['h'] = LETTER, ['i'] = LETTER, ['j'] = LETTER,
+  ['k'] = LETTER, ['l'] = LETTER, ['m'] = LETTER, ['n'] = LETTER, ['o'] = LETTER,
+  ['p'] = LETTER, ['q'] = LETTER, ['r'] = LETTER, ['s'] = LETTER, ['t'] = LETTER,
+  ['u'] = LETTER, ['v'] = LETTER, ['w'] = LETTER, ['x'] = LETTER, ['y'] = LETTER,
+  ['z'] = LETTER,
+};
+
+/**************** tiles_stepOffset ***************/
+/* see tiles.h for details */
+int tiles_stepOffset(direction_t dir, int numColumns)
+{
+  const int stride = numColumns + 1;   // one row down, newline included
+
+  switch (dir) {
+  case DIR_LEFT:      return -1;
+  case DIR_RIGHT:     return 1;
+  case DIR_UP:        return -stride;
+  case DIR_DOWN:      return stride;
+  case DIR_UPLEFT:    return -stride - 1;
+  case DIR_UPRIGHT:   return -stride + 1;
+  case DIR_DOWNLEFT:  return stride - 1;
+  case DIR_DOWNRIGHT: return stride + 1;
+  default:            return 0;
+  }
+}
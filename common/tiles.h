@@ -0,0 +1,64 @@
+/*
+ * This file defines the "tiles" module for my rogue-like
+ * It is the one place that says what each character of a map does:
+ * whether a player can stand on it, whether vision passes through it,
+ * and what kind of tile it is. Each character has a class, a byte of
+ * TILE_ flags, looked up in a table built at compile time, so testing
+ * a tile is one load and a mask rather than a chain of comparisons
+ * New kinds of tile only need a line in tiles.c
+ *
+ * The map cache also keeps the class of every tile of each reference map,
+ * see mapcache_getFlags in mapcache.h, and which of the eight directions
+ * a player can move in from each tile, see mapcache_getMoves
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __TILES_H
+#define __TILES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**************** flags ****************/
+#define TILE_WALKABLE    0x01    // a player can stand here: room floor or passage
+#define TILE_TRANSPARENT 0x02    // vision passes through: room floor, or a letter
+#define TILE_ROOM        0x04    // room floor, '.'
+#define TILE_PASSAGE     0x08    // passage, '#'
+#define TILE_OCCUPIED    0x10    // something a player can step onto: gold or a player
+#define TILE_GOLD        0x20    // a pile of gold, '*'
+#define TILE_PLAYER      0x40    // a player, 'A' to 'Z'
+
+/**************** directions ****************/
+/* the eight directions a player moves in, each with a bit in a move mask */
+typedef enum direction {
+  DIR_LEFT,                  // h
+  DIR_RIGHT,                 // l
+  DIR_UP,                    // k
+  DIR_DOWN,                  // j
+  DIR_UPLEFT,                // y
+  DIR_UPRIGHT,               // u
+  DIR_DOWNLEFT,              // b
+  DIR_DOWNRIGHT,             // n
+  NUM_DIRECTIONS
+} direction_t;
+
+/* the bit of a move mask that says the given direction is open */
+#define MOVE_BIT(dir) (1u << (dir))
+
+/**************** global variables ****************/
+/* the class of every character, indexed by its unsigned value */
+extern const uint8_t tiles_class[256];
+
+/**************** TILE_IS ***************/
+/* true if the character tile has any of the given flags */
+#define TILE_IS(tile, flags) ((tiles_class[(unsigned char)(tile)] & (flags)) != 0)
+
+/**************** tiles_stepOffset ***************/
+/* returns how far one step in the given direction moves a position
+ * in a map string whose rows are numColumns characters and a newline
+ * returns 0 if dir is not a direction
+ */
+int tiles_stepOffset(direction_t dir, int numColumns);
+
+#endif
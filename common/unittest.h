@@ -0,0 +1,36 @@
+/*
+ * This file defines the checks shared by the unit tests of the common library
+ * A unit test is a main at the end of its module, built under that module's
+ * test flag, which includes this file and calls check on each condition,
+ * then exits with the result of unittest_finish
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __UNITTEST_H
+#define __UNITTEST_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+static int unittest_failures = 0;      // checks failed so far
+
+/**************** check ***************/
+/* prints what was checked, and counts it if it failed */
+static void check(bool condition, const char* what)
+{
+  fprintf(stdout, "%s: %s\n", what, condition ? "ok" : "FAILED");
+  unittest_failures += ! condition;
+}
+
+/**************** unittest_finish ***************/
+/* prints whether the named test passed,
+ * returns the status to exit with, 0 if every check passed and 1 if not
+ */
+static int unittest_finish(const char* name)
+{
+  fprintf(stdout, "%s test %s\n", name, unittest_failures == 0 ? "passed" : "FAILED");
+  return unittest_failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * This file implements the "viscache" module for my rogue-like
+ * The "viscache" module is defined in viscache.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "viscache.h"
+#include "mem.h"
+
+/**************** local types ****************/
+/* entries are indexed by position, and also linked into a list
+ * from most recently used (head) to least recently used (tail)
+ */
+typedef struct cacheentry {
+  int* tiles;                          // positions visible from this tile
+  int count;                           // number of positions in tiles
+  bool filled;                         // true while the entry is in the cache
+  int prev;                            // next more recently used position, -1 if head
+  int next;                            // next less recently used position, -1 if tail
+} cacheentry_t;
+
+/**************** global types ****************/
+typedef struct viscache {
+  cacheentry_t* entries;               // one entry per position in the map
+  int numTiles;                        // number of entries
+  int head;                            // most recently used position, -1 if empty
+  int tail;                            // least recently used position, -1 if empty
+  int numFilled;                       // number of filled entries
+  size_t bytes;                        // bytes held by all filled entries
+  size_t budget;                       // most bytes the filled entries may hold
+  unsigned long hits;                  // finds that returned an entry
+  unsigned long misses;                // finds that returned NULL
+  unsigned long evictions;             // entries dropped to make room
+} viscache_t;
+
+/**************** local functions ****************/
+static void unlinkEntry(viscache_t* cache, int pos);
+static void pushFront(viscache_t* cache, int pos);
+static void evict(viscache_t* cache, int pos);
+static void dropEntry(viscache_t* cache, int pos);
+
+/**************** viscache_new ***************/
+/* see viscache.h for details */
+viscache_t* viscache_new(int numTiles, size_t budget)
+{
+  viscache_t* cache = NULL;            // cache to create
+
+  // check params
+  if (numTiles < 1 || budget == 0) {
+    return NULL;
+  }
+
+  if ((cache = mem_calloc(1, sizeof(viscache_t))) == NULL) {
+    return NULL;
+  }
+
+  // calloc leaves every entry empty
+  if ((cache->entries = mem_calloc(numTiles, sizeof(cacheentry_t))) == NULL) {
+    mem_free(cache);
+    return NULL;
+  }
+
+  cache->numTiles = numTiles;
+  cache->head = cache->tail = -1;
+  cache->budget = budget;
+  return cache;
+}
+
+/**************** viscache_find ***************/
+/* see viscache.h for details */
+const int* viscache_find(viscache_t* cache, int pos, int* count)
+{
+  // check params
+  if (cache == NULL || count == NULL || pos < 0 || pos >= cache->numTiles) {
+    return NULL;
+  }
+
+  cacheentry_t* entry = &cache->entries[pos];
+  if (! entry->filled) {
+    cache->misses++;
+    return NULL;
+  }
+
+  // move it to the front, so it is the last to be evicted
+  if (cache->head != pos) {
+    unlinkEntry(cache, pos);
+    pushFront(cache, pos);
+  }
+  cache->hits++;
+  *count = entry->count;
+  return entry->tiles;
+}
+
+/**************** viscache_insert ***************/
+/* see viscache.h for details */
+bool viscache_insert(viscache_t* cache, int pos, const int* tiles, int count)
+{
+  // check params
+  if (cache == NULL || pos < 0 || pos >= cache->numTiles || count < 0
+      || (tiles == NULL && count > 0)) {
+    return false;
+  }
+
+  cacheentry_t* entry = &cache->entries[pos];
+  // never overwrite an existing entry, it is already correct
+  if (entry->filled) {
+    return true;
+  }
+
+  // a set that could never fit isn't worth evicting everything for
+  size_t size = count * sizeof(int);
+  if (size > cache->budget) {
+    return false;
+  }
+  while (cache->bytes + size > cache->budget && cache->tail >= 0) {
+    evict(cache, cache->tail);
+  }
+
+  // copy visible positions into cache memory, empty sets need no array
+  if (count > 0) {
+    if ((entry->tiles = mem_malloc(size)) == NULL) {
+      return false;
+    }
+    memcpy(entry->tiles, tiles, size);
+  }
+
+  entry->count = count;
+  entry->filled = true;
+  pushFront(cache, pos);
+  cache->numFilled++;
+  cache->bytes += size;
+  return true;
+}
+
+/**************** viscache_remove ***************/
+/* see viscache.h for details */
+bool viscache_remove(viscache_t* cache, int pos)
+{
+  // check params
+  if (cache == NULL || pos < 0 || pos >= cache->numTiles || ! cache->entries[pos].filled) {
+    return false;
+  }
+  dropEntry(cache, pos);
+  return true;
+}
+
+/**************** viscache_iterate ***************/
+/* see viscache.h for details */
+void viscache_iterate(viscache_t* cache, void* arg,
+                      void (*itemfunc)(void* arg, int pos, const int* tiles, int count))
+{
+  if (cache == NULL || itemfunc == NULL) {
+    return;
+  }
+  for (int pos = cache->head; pos >= 0; pos = cache->entries[pos].next) {
+    (*itemfunc)(arg, pos, cache->entries[pos].tiles, cache->entries[pos].count);
+  }
+}
+
+/**************** viscache_getStats ***************/
+/* see viscache.h for details */
+bool viscache_getStats(viscache_t* cache, viscachestats_t* stats)
+{
+  if (cache == NULL || stats == NULL) {
+    return false;
+  }
+
+  stats->hits = cache->hits;
+  stats->misses = cache->misses;
+  stats->evictions = cache->evictions;
+  stats->numEntries = cache->numFilled;
+  stats->bytes = cache->bytes;
+  stats->budget = cache->budget;
+  return true;
+}
+
+/**************** viscache_delete ***************/
+/* see viscache.h for details */
+void viscache_delete(viscache_t* cache)
+{
+  if (cache == NULL) {
+    return;
+  }
+
+  // free every filled entry's array, then the index and cache
+  for (int i = 0; i < cache->numTiles; i++) {
+    if (cache->entries[i].tiles != NULL) {
+      mem_free(cache->entries[i].tiles);
+    }
+  }
+  mem_free(cache->entries);
+  mem_free(cache);
+}
+
+/**************** unlinkEntry ***************/
+/* takes the filled entry at pos out of the list */
+static void unlinkEntry(viscache_t* cache, int pos)
+{
+  cacheentry_t* entry = &cache->entries[pos];
+
+  if (entry->prev >= 0) {
+    cache->entries[entry->prev].next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next >= 0) {
+    cache->entries[entry->next].prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+}
+
+/**************** pushFront ***************/
+/* puts the entry at pos at the head of the list, as most recently used */
+static void pushFront(viscache_t* cache, int pos)
+{
+  cacheentry_t* entry = &cache->entries[pos];
+
+  entry->prev = -1;
+  entry->next = cache->head;
+  if (cache->head >= 0) {
+    cache->entries[cache->head].prev = pos;
+  } else {
+    cache->tail = pos;
+  }
+  cache->head = pos;
+}
+
+/**************** evict ***************/
+/* drops the filled entry at pos from the cache to make room, counting it */
+static void evict(viscache_t* cache, int pos)
+{
+  dropEntry(cache, pos);
+  cache->evictions++;
+}
+
+/**************** dropEntry ***************/
+/* drops the filled entry at pos from the cache and frees its array */
+static void dropEntry(viscache_t* cache, int pos)
+{
+  cacheentry_t* entry = &cache->entries[pos];
+
+  unlinkEntry(cache, pos);
+  if (entry->tiles != NULL) {
+    mem_free(entry->tiles);
+    entry->tiles = NULL;
+  }
+  cache->bytes -= entry->count * sizeof(int);
+  cache->numFilled--;
+  entry->count = 0;
+  entry->filled = false;
+}
@@ -0,0 +1,95 @@
+/*
+ * This file defines the "viscache" module for my rogue-like
+ * A "viscache" is a cache of visible sets, keyed by map position
+ * It is the middle ground between calculating vision on every move and
+ * a vistable holding every tile: it keeps the sets of the tiles used most
+ * recently, as long as they fit in a budget of bytes, and evicts the least
+ * recently used set to make room for a new one
+ *
+ * Each entry stores the positions visible from one tile as an array of ints,
+ * just like a vistable entry. Only those arrays count towards the budget,
+ * the fixed per-position index does not
+ * The cache keeps counts of hits, misses and evictions, see viscache_getStats
+ * The cache itself does not calculate vision, see grid.h for that
+ *
+ * Finding an entry updates the cache, so a cache shared between threads
+ * must be used by one thread at a time
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __VISCACHE_H
+#define __VISCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**************** global types ****************/
+typedef struct viscache viscache_t;  // opaque to users of the module
+
+/* a snapshot of a cache's counters, see viscache_getStats */
+typedef struct viscachestats {
+  unsigned long hits;        // finds that returned an entry
+  unsigned long misses;      // finds that returned NULL
+  unsigned long evictions;   // entries dropped to make room for others
+  int numEntries;            // entries held right now
+  size_t bytes;              // bytes held by those entries
+  size_t budget;             // most bytes the entries may hold
+} viscachestats_t;
+
+/**************** functions **************/
+
+/**************** viscache_new ***************/
+/* creates an empty cache with room to index every position in a map string
+ * of the given length, whose entries may hold up to budget bytes in all
+ * allocates memory that must be free'd with viscache_delete
+ * returns NULL if numTiles < 1, budget is 0, or failure to allocate memory
+ */
+viscache_t* viscache_new(int numTiles, size_t budget);
+
+/**************** viscache_find ***************/
+/* returns the array of positions visible from the given position
+ * and stores its length in count, making it the most recently used entry
+ * the returned array belongs to the cache, caller must not free or modify it,
+ * and it is only good until the next call to viscache_insert
+ * returns NULL (and leaves count alone) if the position has no entry,
+ * or if the cache is NULL or pos is out of bounds
+ */
+const int* viscache_find(viscache_t* cache, int pos, int* count);
+
+/**************** viscache_insert ***************/
+/* stores a copy of the given array of visible positions as the entry for
+ * the given position, evicting least recently used entries until it fits
+ * An entry that already exists is left unchanged
+ * returns true if the position has an entry after the call, false on bad params,
+ * failure to allocate memory, or if the array alone is bigger than the budget
+ */
+bool viscache_insert(viscache_t* cache, int pos, const int* tiles, int count);
+
+/**************** viscache_remove ***************/
+/* drops the entry for the given position, after what it was calculated
+ * from has changed. A dropped entry is not counted as an eviction
+ * returns true if the position had an entry, false if not or on bad params
+ */
+bool viscache_remove(viscache_t* cache, int pos);
+
+/**************** viscache_iterate ***************/
+/* calls itemfunc(arg, pos, tiles, count) on every entry in the cache,
+ * from most to least recently used, without making any of them more
+ * recently used. itemfunc must not insert or remove entries
+ * does nothing if cache or itemfunc is NULL
+ */
+void viscache_iterate(viscache_t* cache, void* arg,
+                      void (*itemfunc)(void* arg, int pos, const int* tiles, int count));
+
+/**************** viscache_getStats ***************/
+/* stores a snapshot of the cache's counters in stats
+ * returns false (and stores nothing) on bad params
+ */
+bool viscache_getStats(viscache_t* cache, viscachestats_t* stats);
+
+/**************** viscache_delete ***************/
+/* free's the cache and every entry within it */
+void viscache_delete(viscache_t* cache);
+
+#endif
@@ -0,0 +1,416 @@
+/*
+ * This file implements the "visdeps" module for my rogue-like
+ * The "visdeps" module is defined in visdeps.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "visdeps.h"
+#include "mem.h"
+
+/**************** file-local constants *******************/
+static const int FIRSTEDGES = 64;      // room for edges, and for each block's list, before growing
+
+/**************** local types ****************/
+/* one viewpoint depending on one block, linked from both ends */
+typedef struct depedge {
+  int viewpoint;                       // viewpoint that depends on the block
+  int block;                           // block it depends on
+  int slot;                            // where the edge is in the block's list
+  int next;                            // next edge of the same viewpoint, or next free edge, -1 if none
+} depedge_t;
+
+/* the edges of every viewpoint that depends on a block, in no particular order */
+typedef struct blocklist {
+  int* edges;                          // edge numbers, NULL until the first one
+  int count;                           // number of edges in edges
+  int max;                             // room in edges before it grows
+} blocklist_t;
+
+/**************** global types ****************/
+typedef struct visdeps {
+  depedge_t* edges;                    // every edge, in use or free
+  int maxEdges;                        // room in edges before it grows
+  int numEdges;                        // edges ever used, in use or free
+  int freeEdge;                        // first free edge, -1 if none
+  int* first;                          // first edge of each viewpoint, -1 if none
+  int numViewpoints;                   // viewpoints with any edge
+  blocklist_t* blocks;                 // viewpoints depending on each block
+  int* marks;                          // stamp of the last add to reach each block
+  int stamp;                           // stamp of the add in progress
+  int mapLen;                          // number of positions
+  int stride;                          // distance between rows of the map string
+  int numRows;                         // rows the map string touches
+  int blocksWide;                      // blocks along a row
+  int numBlocks;                       // blocks in all
+} visdeps_t;
+
+/**************** local functions ****************/
+static bool addEdge(visdeps_t* deps, int viewpoint, int block);
+static bool addAround(visdeps_t* deps, int viewpoint, int pos);
+
+/**************** visdeps_new ***************/
+/* see visdeps.h for details */
+visdeps_t* visdeps_new(int mapLen, int numColumns)
+{
+  visdeps_t* deps = NULL;              // index to return
+
+  // check params
+  if (mapLen < 1 || numColumns < 0) {
+    return NULL;
+  }
+  if ((deps = mem_calloc(1, sizeof(visdeps_t))) == NULL) {
+    return NULL;
+  }
+  deps->mapLen = mapLen;
+  deps->stride = numColumns + 1;
+  deps->numRows = (mapLen + deps->stride - 1) / deps->stride;
+  deps->blocksWide = (deps->stride + VISDEPS_BLOCK - 1) >> VISDEPS_SHIFT;
+  deps->numBlocks = deps->blocksWide * ((deps->numRows + VISDEPS_BLOCK - 1) >> VISDEPS_SHIFT);
+  deps->freeEdge = -1;
+
+  deps->edges = mem_malloc(FIRSTEDGES * sizeof(depedge_t));
+  deps->first = mem_malloc(mapLen * sizeof(int));
+  deps->blocks = mem_calloc(deps->numBlocks, sizeof(blocklist_t));
+  deps->marks = mem_calloc(deps->numBlocks, sizeof(int));
+  if (deps->edges == NULL || deps->first == NULL || deps->blocks == NULL
+      || deps->marks == NULL) {
+    visdeps_delete(deps);
+    return NULL;
+  }
+  deps->maxEdges = FIRSTEDGES;
+  for (int pos = 0; pos < mapLen; pos++) {
+    deps->first[pos] = -1;
+  }
+  return deps;
+}
+
+/**************** visdeps_add ***************/
+/* see visdeps.h for details */
+bool visdeps_add(visdeps_t* deps, int viewpoint, const int* tiles, int count)
+{
+  // check params
+  if (deps == NULL || viewpoint < 0 || viewpoint >= deps->mapLen || count < 0
+      || (tiles == NULL && count > 0)) {
+    return false;
+  }
+  visdeps_remove(deps, viewpoint);
+
+  // each block is added once, however many of the viewpoint's tiles it holds
+  deps->stamp++;
+  bool added = addAround(deps, viewpoint, viewpoint);
+  for (int i = 0; i < count && added; i++) {
+    added = addAround(deps, viewpoint, tiles[i]);
+  }
+  if (! added) {
+    visdeps_remove(deps, viewpoint);
+  }
+  return added;
+}
+
+/**************** visdeps_remove ***************/
+/* see visdeps.h for details */
+void visdeps_remove(visdeps_t* deps, int viewpoint)
+{
+  if (deps == NULL || viewpoint < 0 || viewpoint >= deps->mapLen
+      || deps->first[viewpoint] < 0) {
+    return;
+  }
+
+  int edge = deps->first[viewpoint];
+  while (edge >= 0) {
+    depedge_t* removed = &deps->edges[edge];
+    const int next = removed->next;
+
+    // the last edge of the block's list fills the slot, so the list stays dense
+    blocklist_t* list = &deps->blocks[removed->block];
+    const int last = list->edges[--list->count];
+    list->edges[removed->slot] = last;
+    deps->edges[last].slot = removed->slot;
+
+    removed->next = deps->freeEdge;
+    deps->freeEdge = edge;
+    edge = next;
+  }
+  deps->first[viewpoint] = -1;
+  deps->numViewpoints--;
+}
+
+/**************** visdeps_invalidate ***************/
+/* see visdeps.h for details */
+int visdeps_invalidate(visdeps_t* deps, int tile, void* arg,
+                       void (*itemfunc)(void* arg, int viewpoint))
+{
+  int forgotten = 0;                   // viewpoints forgotten so far
+
+  if (deps == NULL || tile < 0 || tile >= deps->mapLen) {
+    return 0;
+  }
+  const int x = tile % deps->stride;
+  const int y = tile / deps->stride;
+  blocklist_t* list = &deps->blocks[(y >> VISDEPS_SHIFT) * deps->blocksWide
+                                    + (x >> VISDEPS_SHIFT)];
+
+  // forgetting a viewpoint takes its edge out of this list too
+  while (list->count > 0) {
+    const int viewpoint = deps->edges[list->edges[0]].viewpoint;
+    visdeps_remove(deps, viewpoint);
+    forgotten++;
+    if (itemfunc != NULL) {
+      (*itemfunc)(arg, viewpoint);
+    }
+  }
+  return forgotten;
+}
+
+/**************** visdeps_getNumViewpoints ***************/
+/* see visdeps.h for details */
+int visdeps_getNumViewpoints(visdeps_t* deps)
+{
+  return deps ? deps->numViewpoints : 0;
+}
+
+/**************** visdeps_getBytes ***************/
+/* see visdeps.h for details */
+size_t visdeps_getBytes(visdeps_t* deps)
+{
+  if (deps == NULL) {
+    return 0;
+  }
+  size_t bytes = sizeof(visdeps_t)
+    + (size_t)deps->maxEdges * sizeof(depedge_t)
+    + (size_t)deps->mapLen * sizeof(int)
+    + (size_t)deps->numBlocks * (sizeof(blocklist_t) + sizeof(int));
+  for (int b = 0; b < deps->numBlocks; b++) {
+    bytes += (size_t)deps->blocks[b].max * sizeof(int);
+  }
+  return bytes;
+}
+
+/**************** visdeps_delete ***************/
+/* see visdeps.h for details */
+void visdeps_delete(visdeps_t* deps)
+{
+  if (deps == NULL) {
+    return;
+  }
+  if (deps->blocks != NULL) {
+    for (int b = 0; b < deps->numBlocks; b++) {
+      if (deps->blocks[b].edges != NULL) {
+        mem_free(deps->blocks[b].edges);
+      }
+    }
+    mem_free(deps->blocks);
+  }
+  if (deps->edges != NULL) {
+    mem_free(deps->edges);
+  }
+  if (deps->first != NULL) {
+    mem_free(deps->first);
+  }
+  if (deps->marks != NULL) {
+    mem_free(deps->marks);
+  }
+  mem_free(deps);
+}
+
+/**************** addAround ***************/
+/* makes viewpoint depend on every block within one step of pos, skipping
+ * blocks already added with the current stamp. A block is wider than
+ * three tiles, so the step either way reaches at most two blocks each way
+ * returns false on failure to allocate memory
+ */
+static bool addAround(visdeps_t* deps, int viewpoint, int pos)
+{
+  const int x = pos % deps->stride;
+  const int y = pos / deps->stride;
+  const int left = (x > 0 ? x - 1 : 0) >> VISDEPS_SHIFT;
+  const int right = (x + 1 < deps->stride ? x + 1 : x) >> VISDEPS_SHIFT;
+  const int top = (y > 0 ? y - 1 : 0) >> VISDEPS_SHIFT;
+  const int bottom = (y + 1 < deps->numRows ? y + 1 : y) >> VISDEPS_SHIFT;
+
+  for (int by = top; by <= bottom; by++) {
+    for (int bx = left; bx <= right; bx++) {
+      const int block = by * deps->blocksWide + bx;
+      if (deps->marks[block] == deps->stamp) {
+        continue;
+      }
+      deps->marks[block] = deps->stamp;
+      if (! addEdge(deps, viewpoint, block)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**************** addEdge ***************/
+/* links a new edge from viewpoint to block, growing the edges
+ * or the block's list if either is full
+ * returns false on failure to allocate memory
+ */
+static bool addEdge(visdeps_t* deps, int viewpoint, int block)
+{
+  // take a free edge, or one never used, growing the edges if there is none
+  if (deps->freeEdge < 0 && deps->numEdges == deps->maxEdges) {
+    depedge_t* grown = mem_malloc(2 * deps->maxEdges * sizeof(depedge_t));
+    if (grown == NULL) {
+      return false;
+    }
+    memcpy(grown, deps->edges, deps->numEdges * sizeof(depedge_t));
+    mem_free(deps->edges);
+    deps->edges = grown;
+    deps->maxEdges *= 2;
+  }
+  blocklist_t* list = &deps->blocks[block];
+  if (list->count == list->max) {
+    const int max = list->max > 0 ? 2 * list->max : FIRSTEDGES;
+    int* grown = mem_malloc(max * sizeof(int));
+    if (grown == NULL) {
+      return false;
+    }
+    if (list->edges != NULL) {
+      memcpy(grown, list->edges, list->count * sizeof(int));
+      mem_free(list->edges);
+    }
+    list->edges = grown;
+    list->max = max;
+  }
+
+  int edge = deps->freeEdge;
+  if (edge >= 0) {
+    deps->freeEdge = deps->edges[edge].next;
+  } else {
+    edge = deps->numEdges++;
+  }
+  if (deps->first[viewpoint] < 0) {
+    deps->numViewpoints++;
+  }
+  deps->edges[edge].viewpoint = viewpoint;
+  deps->edges[edge].block = block;
+  deps->edges[edge].slot = list->count;
+  deps->edges[edge].next = deps->first[viewpoint];
+  deps->first[viewpoint] = edge;
+  list->edges[list->count++] = edge;
+  return true;
+}
+
+#ifdef VISDEPSTEST
+#include "unittest.h"
+
+static void collect(void* arg, int viewpoint);
+
+// adds made-up visible sets, then checks that changing any tile forgets
+// every viewpoint that sees it or sees next to it
+// usage: visdepstest
+int
+main(int argc, char* argv[])
+{
+  const int numColumns = 100;          // rows are 101 characters, newline included
+  const int numRows = 50;
+  const int stride = numColumns + 1;
+  const int mapLen = stride * numRows;
+  const int numViewpoints = 300;
+  int* viewpoints = malloc(numViewpoints * sizeof(int));
+  int* counts = malloc(numViewpoints * sizeof(int));
+  int** sets = malloc(numViewpoints * sizeof(int*));
+  bool* forgotten = calloc(mapLen, sizeof(bool));
+  visdeps_t* deps = visdeps_new(mapLen, numColumns);
+  check(deps != NULL && viewpoints != NULL && counts != NULL && sets != NULL
+        && forgotten != NULL, "index created");
+  check(visdeps_new(0, 5) == NULL && visdeps_new(5, -1) == NULL, "empty map");
+  check( ! visdeps_add(deps, -1, NULL, 0) && ! visdeps_add(deps, mapLen, NULL, 0),
+         "bad viewpoints refused");
+
+  // each viewpoint sees a box of tiles around itself, in order
+  srand(1);
+  for (int v = 0; v < numViewpoints; v++) {
+    int x = rand() % numColumns;
+    int y = rand() % numRows;
+    int reach = rand() % 12;
+    viewpoints[v] = y * stride + x;
+    sets[v] = malloc((2 * reach + 1) * (2 * reach + 1) * sizeof(int));
+    counts[v] = 0;
+    for (int ty = y - reach; ty <= y + reach; ty++) {
+      for (int tx = x - reach; tx <= x + reach; tx++) {
+        if (tx >= 0 && tx < numColumns && ty >= 0 && ty < numRows) {
+          sets[v][counts[v]++] = ty * stride + tx;
+        }
+      }
+    }
+  }
+  // two viewpoints may share a position, the second replaces the first
+  for (int v = 0; v < numViewpoints; v++) {
+    visdeps_add(deps, viewpoints[v], sets[v], counts[v]);
+  }
+  for (int v = 0; v < numViewpoints; v++) {
+    for (int w = v + 1; w < numViewpoints; w++) {
+      if (viewpoints[w] == viewpoints[v]) {
+        viewpoints[v] = -1;
+      }
+    }
+  }
+  int numRecorded = 0;
+  for (int v = 0; v < numViewpoints; v++) {
+    numRecorded += viewpoints[v] >= 0;
+  }
+  check(visdeps_getNumViewpoints(deps) == numRecorded, "one record per viewpoint");
+
+  // change tiles all over the map: every viewpoint seeing next to one must be
+  // forgotten, and added back before the next change
+  bool safe = true;
+  int total = 0;
+  for (int i = 0; i < 200; i++) {
+    int tile = (rand() % numRows) * stride + rand() % numColumns;
+    memset(forgotten, 0, mapLen * sizeof(bool));
+    total += visdeps_invalidate(deps, tile, forgotten, collect);
+    for (int v = 0; v < numViewpoints; v++) {
+      if (viewpoints[v] < 0) {
+        continue;
+      }
+      bool near = false;
+      for (int t = -1; t < counts[v] && ! near; t++) {
+        int pos = t < 0 ? viewpoints[v] : sets[v][t];
+        near = abs(pos % stride - tile % stride) <= 1 && abs(pos / stride - tile / stride) <= 1;
+      }
+      safe = safe && ( ! near || forgotten[viewpoints[v]]);
+      if (forgotten[viewpoints[v]]) {
+        visdeps_add(deps, viewpoints[v], sets[v], counts[v]);
+      }
+    }
+  }
+  check(safe, "every viewpoint near a change forgotten");
+  check(total > 0 && total < 200 * numRecorded, "only some viewpoints forgotten");
+  check(visdeps_getNumViewpoints(deps) == numRecorded, "forgotten viewpoints added back");
+
+  // removing every viewpoint leaves nothing to forget
+  for (int v = 0; v < numViewpoints; v++) {
+    visdeps_remove(deps, viewpoints[v]);
+  }
+  check(visdeps_getNumViewpoints(deps) == 0
+        && visdeps_invalidate(deps, 0, NULL, NULL) == 0, "every viewpoint removed");
+
+  visdeps_delete(deps);
+  for (int v = 0; v < numViewpoints; v++) {
+    free(sets[v]);
+  }
+  free(sets);
+  free(counts);
+  free(viewpoints);
+  free(forgotten);
+  exit(unittest_finish("visdeps"));
+}
+
+
+// marks the viewpoint in the array of forgotten positions in arg
+static void
+collect(void* arg, int viewpoint)
+{
+  bool* forgotten = arg;
+  forgotten[viewpoint] = true;
+}
+#endif
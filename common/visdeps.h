@@ -0,0 +1,86 @@
+/*
+ * This file defines the "visdeps" module for my rogue-like
+ * A "visdeps" is a reverse index from terrain to stored vision: for each tile
+ * of a map, the viewpoints whose stored visible set could change if the
+ * terrain of that tile did. When a tile changes, only those viewpoints'
+ * vision has to be thrown away, rather than all of it
+ *
+ * Vision from a viewpoint can only be changed by a tile that it sees, or that
+ * lies next to a tile it sees: a wall it sees may open, and a tile just past
+ * what it sees may be what stops a ray or a scan. A viewpoint is recorded as
+ * depending on every tile within one step of its visible set or of itself
+ *
+ * Tiles are grouped in blocks of VISDEPS_BLOCK x VISDEPS_BLOCK, and each block
+ * lists the viewpoints that depend on any of its tiles, so the index takes
+ * a small fraction of the memory of the vision it covers. A change to a tile
+ * may then throw away a little vision that the change didn't affect
+ * Adding a viewpoint, or removing one, takes time in proportion to the number
+ * of blocks it depends on
+ *
+ * Positions are indices into the map string, laid out as in grid.h
+ * The index itself does not store or calculate vision, see grid.h for that
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __VISDEPS_H
+#define __VISDEPS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* log2 of the number of tiles along each side of a block */
+#define VISDEPS_SHIFT 3
+/* the number of tiles along each side of a block */
+#define VISDEPS_BLOCK (1 << VISDEPS_SHIFT)
+
+/**************** global types ****************/
+typedef struct visdeps visdeps_t;  // opaque to users of the module
+
+/**************** functions **************/
+
+/**************** visdeps_new ***************/
+/* creates an empty index for a map string of mapLen characters,
+ * with rows of numColumns characters each followed by a newline
+ * allocates memory that must be free'd with visdeps_delete
+ * returns NULL if mapLen < 1, numColumns < 0, or failure to allocate memory
+ */
+visdeps_t* visdeps_new(int mapLen, int numColumns);
+
+/**************** visdeps_add ***************/
+/* records that the vision stored for viewpoint is the count positions in
+ * tiles, so that it depends on every tile within one step of those positions
+ * or of viewpoint. Anything recorded for viewpoint before is replaced
+ * returns true on success, false on bad params or failure to allocate memory,
+ * in which case nothing is recorded for viewpoint
+ */
+bool visdeps_add(visdeps_t* deps, int viewpoint, const int* tiles, int count);
+
+/**************** visdeps_remove ***************/
+/* forgets everything recorded for viewpoint, whose vision is no longer stored
+ * does nothing if nothing was recorded or on bad params
+ */
+void visdeps_remove(visdeps_t* deps, int viewpoint);
+
+/**************** visdeps_invalidate ***************/
+/* forgets every viewpoint that depends on the given tile, after its terrain
+ * changed, and calls itemfunc(arg, viewpoint) on each once it is forgotten
+ * itemfunc may remove viewpoints, but must not add any
+ * returns the number of viewpoints forgotten, 0 on bad params
+ */
+int visdeps_invalidate(visdeps_t* deps, int tile, void* arg,
+                       void (*itemfunc)(void* arg, int viewpoint));
+
+/**************** visdeps_getNumViewpoints ***************/
+/* returns the number of viewpoints recorded, 0 if deps is NULL */
+int visdeps_getNumViewpoints(visdeps_t* deps);
+
+/**************** visdeps_getBytes ***************/
+/* returns the bytes the index holds, 0 if deps is NULL */
+size_t visdeps_getBytes(visdeps_t* deps);
+
+/**************** visdeps_delete ***************/
+/* free's the index, does nothing if deps is NULL */
+void visdeps_delete(visdeps_t* deps);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * This file implements the "vistable" module for my rogue-like
+ * The "vistable" module is defined in vistable.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "vistable.h"
+#include "mem.h"
+
+/**************** local types ****************/
+typedef struct visentry {
+  int* tiles;                          // positions visible from this tile
+  int count;                           // number of positions in tiles
+  atomic_bool filled;                  // true once tiles has been calculated
+} visentry_t;
+
+/**************** global types ****************/
+typedef struct vistable {
+  visentry_t* entries;                 // one entry per position in the map
+  int numTiles;                        // number of entries
+  int numFilled;                       // number of filled entries
+  size_t bytes;                        // bytes held by all filled entries
+} vistable_t;
+
+/**************** vistable_new ***************/
+/* see vistable.h for details */
+vistable_t* vistable_new(int numTiles)
+{
+  vistable_t* table = NULL;            // table to create
+
+  // check param
+  if (numTiles < 1) {
+    return NULL;
+  }
+
+  if ((table = mem_malloc(sizeof(vistable_t))) == NULL) {
+    return NULL;
+  }
+
+  // calloc leaves every entry empty
+  if ((table->entries = mem_calloc(numTiles, sizeof(visentry_t))) == NULL) {
+    mem_free(table);
+    return NULL;
+  }
+
+  table->numTiles = numTiles;
+  table->numFilled = 0;
+  table->bytes = 0;
+  return table;
+}
+
+/**************** vistable_find ***************/
+/* see vistable.h for details */
+const int* vistable_find(vistable_t* table, int pos, int* count)
+{
+  // check params
+  if (table == NULL || count == NULL || pos < 0 || pos >= table->numTiles) {
+    return NULL;
+  }
+
+  // pairs with the release in vistable_insert, so a filled entry's tiles
+  // and count are complete by the time they are read
+  visentry_t* entry = &table->entries[pos];
+  if (! atomic_load_explicit(&entry->filled, memory_order_acquire)) {
+    return NULL;
+  }
+
+  *count = entry->count;
+  return entry->tiles;
+}
+
+/**************** vistable_insert ***************/
+/* see vistable.h for details */
+bool vistable_insert(vistable_t* table, int pos, const int* tiles, int count)
+{
+  // check params
+  if (table == NULL || pos < 0 || pos >= table->numTiles || count < 0
+      || (tiles == NULL && count > 0)) {
+    return false;
+  }
+
+  visentry_t* entry = &table->entries[pos];
+  // never overwrite an existing entry, it is already correct
+  if (entry->filled) {
+    return true;
+  }
+
+  // copy visible positions into table memory, empty sets need no array
+  if (count > 0) {
+    if ((entry->tiles = mem_malloc(count * sizeof(int))) == NULL) {
+      return false;
+    }
+    memcpy(entry->tiles, tiles, count * sizeof(int));
+  }
+
+  entry->count = count;
+  atomic_store_explicit(&entry->filled, true, memory_order_release);
+  table->numFilled++;
+  table->bytes += count * sizeof(int);
+  return true;
+}
+
+/**************** vistable_remove ***************/
+/* see vistable.h for details */
+bool vistable_remove(vistable_t* table, int pos)
+{
+  // check params
+  if (table == NULL || pos < 0 || pos >= table->numTiles) {
+    return false;
+  }
+  visentry_t* entry = &table->entries[pos];
+  if (! entry->filled) {
+    return false;
+  }
+  if (entry->tiles != NULL) {
+    mem_free(entry->tiles);
+    entry->tiles = NULL;
+  }
+  table->numFilled--;
+  table->bytes -= entry->count * sizeof(int);
+  entry->count = 0;
+  entry->filled = false;
+  return true;
+}
+
+/**************** vistable_getNumEntries ***************/
+/* see vistable.h for details */
+int vistable_getNumEntries(vistable_t* table)
+{
+  return table ? table->numFilled : 0;
+}
+
+/**************** vistable_getBytes ***************/
+/* see vistable.h for details */
+size_t vistable_getBytes(vistable_t* table)
+{
+  return table ? table->bytes : 0;
+}
+
+/**************** vistable_delete ***************/
+/* see vistable.h for details */
+void vistable_delete(vistable_t* table)
+{
+  if (table == NULL) {
+    return;
+  }
+
+  // free every filled entry's array, then the index and table
+  for (int i = 0; i < table->numTiles; i++) {
+    if (table->entries[i].tiles != NULL) {
+      mem_free(table->entries[i].tiles);
+    }
+  }
+  mem_free(table->entries);
+  mem_free(table);
+}
@@ -0,0 +1,74 @@
+/*
+ * This file defines the "vistable" module for my rogue-like
+ * A "vistable" is a table of visible sets, indexed by map position
+ * Vision from a given tile only depends on the reference map,
+ * so once a tile's visible set is calculated it never has to be calculated again
+ *
+ * Each entry stores the positions visible from one tile as an array of ints
+ * Entries start out empty and are filled either all at once when a grid is
+ * created (eager) or the first time a tile's vision is requested (lazy)
+ * The table itself does not calculate vision, see grid.h for that
+ * vistable_find may run in several threads while one other thread inserts,
+ * but inserts and removes have to take turns with each other
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __VISTABLE_H
+#define __VISTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**************** global types ****************/
+typedef struct vistable vistable_t;  // opaque to users of the module
+
+/**************** functions **************/
+
+/**************** vistable_new ***************/
+/* creates an empty table with room for an entry at every position
+ * in a map string of the given length
+ * allocates memory that must be free'd with vistable_delete
+ * returns NULL if numTiles < 1 or failure to allocate memory
+ */
+vistable_t* vistable_new(int numTiles);
+
+/**************** vistable_find ***************/
+/* returns the array of positions visible from the given position
+ * and stores its length in count
+ * the returned array belongs to the table, caller must not free or modify it
+ * returns NULL (and leaves count alone) if the entry has not been filled yet,
+ * or if the table is NULL or pos is out of bounds
+ */
+const int* vistable_find(vistable_t* table, int pos, int* count);
+
+/**************** vistable_insert ***************/
+/* fills the entry for the given position with a copy of the given array
+ * of visible positions. An entry that is already filled is left unchanged
+ * returns true if the entry is filled after the call, false on bad params
+ * or failure to allocate memory
+ */
+bool vistable_insert(vistable_t* table, int pos, const int* tiles, int count);
+
+/**************** vistable_remove ***************/
+/* empties the entry for the given position, after what it was
+ * calculated from has changed, so that it can be filled again
+ * returns true if the entry was filled, false if not or on bad params
+ */
+bool vistable_remove(vistable_t* table, int pos);
+
+/**************** vistable_getNumEntries ***************/
+/* returns the number of filled entries in the table, 0 if table is NULL */
+int vistable_getNumEntries(vistable_t* table);
+
+/**************** vistable_getBytes ***************/
+/* returns the number of bytes of visible-set data held in the table,
+ * not counting the fixed per-position index, 0 if table is NULL
+ */
+size_t vistable_getBytes(vistable_t* table);
+
+/**************** vistable_delete ***************/
+/* free's the table and every entry within it */
+void vistable_delete(vistable_t* table);
+
+#endif
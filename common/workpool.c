@@ -0,0 +1,182 @@
+/*
+ * This file implements the "workpool" module for my rogue-like
+ * The "workpool" module is defined in workpool.h
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "workpool.h"
+#include "mem.h"
+
+/**************** global types ****************/
+typedef struct workpool {
+  pthread_t* threads;                  // the worker threads
+  int numThreads;                      // number of worker threads
+  pthread_mutex_t lock;                // guards everything below
+  pthread_cond_t started;              // signalled when a batch starts or on quit
+  pthread_cond_t finished;             // signalled when a batch's last job is done
+  void (*jobfunc)(void* arg, const int job);  // job function of the current batch
+  void* arg;                           // argument to jobfunc
+  int numJobs;                         // number of jobs in the current batch
+  int nextJob;                         // next job no thread has claimed yet
+  int jobsDone;                        // number of jobs that have returned
+  unsigned long batch;                 // counts batches, so workers spot new ones
+  bool quit;                           // true once the pool is being deleted
+} workpool_t;
+
+/**************** local functions ****************/
+static void* worker(void* arg);
+static void runJobs(workpool_t* pool);
+
+/**************** workpool_new ***************/
+/* see workpool.h for details */
+workpool_t* workpool_new(int numThreads)
+{
+  workpool_t* pool = NULL;             // pool to create
+
+  // check param
+  if (numThreads < 0) {
+    return NULL;
+  }
+
+  if ((pool = mem_calloc(1, sizeof(workpool_t))) == NULL) {
+    return NULL;
+  }
+  if (numThreads > 0 && (pool->threads = mem_calloc(numThreads, sizeof(pthread_t))) == NULL) {
+    mem_free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->started, NULL);
+  pthread_cond_init(&pool->finished, NULL);
+
+  // start the workers, stopping the ones already started if one fails
+  for (int i = 0; i < numThreads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0) {
+      workpool_delete(pool);
+      return NULL;
+    }
+    pool->numThreads++;
+  }
+
+  return pool;
+}
+
+/**************** workpool_getNumThreads ***************/
+/* see workpool.h for details */
+int workpool_getNumThreads(workpool_t* pool)
+{
+  return pool ? pool->numThreads : 0;
+}
+
+/**************** workpool_run ***************/
+/* see workpool.h for details */
+void workpool_run(workpool_t* pool, void* arg, int numJobs,
+                  void (*jobfunc)(void* arg, const int job))
+{
+  // check params
+  if (jobfunc == NULL || numJobs < 1) {
+    return;
+  }
+
+  // without a pool, or with nobody to share with, just run the jobs here
+  if (pool == NULL || pool->numThreads == 0 || numJobs == 1) {
+    for (int job = 0; job < numJobs; job++) {
+      (*jobfunc)(arg, job);
+    }
+    return;
+  }
+
+  // hand out the batch, and pitch in until it is all claimed
+  pthread_mutex_lock(&pool->lock);
+  pool->jobfunc = jobfunc;
+  pool->arg = arg;
+  pool->numJobs = numJobs;
+  pool->nextJob = 0;
+  pool->jobsDone = 0;
+  pool->batch++;
+  pthread_cond_broadcast(&pool->started);
+  runJobs(pool);
+
+  // then wait for the jobs still running on the workers
+  while (pool->jobsDone < pool->numJobs) {
+    pthread_cond_wait(&pool->finished, &pool->lock);
+  }
+  pool->jobfunc = NULL;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**************** workpool_delete ***************/
+/* see workpool.h for details */
+void workpool_delete(workpool_t* pool)
+{
+  if (pool == NULL) {
+    return;
+  }
+
+  // wake every worker and wait for it to leave
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->started);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < pool->numThreads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->finished);
+  pthread_cond_destroy(&pool->started);
+  pthread_mutex_destroy(&pool->lock);
+  if (pool->threads != NULL) {
+    mem_free(pool->threads);
+  }
+  mem_free(pool);
+}
+
+/**************** worker ***************/
+/* the body of each worker thread
+ * sleeps until a new batch starts, helps run it, and repeats until quit
+ */
+static void* worker(void* arg)
+{
+  workpool_t* pool = arg;
+  unsigned long seen = 0;              // last batch this worker looked at
+
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    while (! pool->quit && pool->batch == seen) {
+      pthread_cond_wait(&pool->started, &pool->lock);
+    }
+    if (pool->quit) {
+      break;
+    }
+    seen = pool->batch;
+    runJobs(pool);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**************** runJobs ***************/
+/* claims and runs jobs of the current batch until none are left unclaimed
+ * called and returns with the lock held, but runs each job without it
+ */
+static void runJobs(workpool_t* pool)
+{
+  while (pool->jobfunc != NULL && pool->nextJob < pool->numJobs) {
+    int job = pool->nextJob++;
+    void (*jobfunc)(void* arg, const int job) = pool->jobfunc;
+    void* arg = pool->arg;
+
+    pthread_mutex_unlock(&pool->lock);
+    (*jobfunc)(arg, job);
+    pthread_mutex_lock(&pool->lock);
+
+    if (++pool->jobsDone == pool->numJobs) {
+      pthread_cond_signal(&pool->finished);
+    }
+  }
+}
@@ -0,0 +1,50 @@
+/*
+ * This file defines the "workpool" module for my rogue-like
+ * A "workpool" is a fixed set of worker threads that run batches of jobs
+ * Each batch is a function called once for every job index in [0, numJobs),
+ * spread across the workers and the calling thread, and workpool_run
+ * returns only once every job is done, so it doubles as a barrier
+ *
+ * Jobs run at the same time as each other, so a job function must only
+ * write to memory that belongs to its own job. Note that the libcs50
+ * mem_* functions keep unguarded counters, so jobs shouldn't allocate
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#ifndef __WORKPOOL_H
+#define __WORKPOOL_H
+
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct workpool workpool_t;  // opaque to users of the module
+
+/**************** functions **************/
+
+/**************** workpool_new ***************/
+/* creates a pool and starts numThreads worker threads, which wait for work
+ * a pool with 0 threads runs every job on the calling thread
+ * allocates memory that must be free'd with workpool_delete
+ * returns NULL if numThreads < 0, or on failure to allocate memory or start a thread
+ */
+workpool_t* workpool_new(int numThreads);
+
+/**************** workpool_getNumThreads ***************/
+/* returns the number of worker threads in the pool, 0 if pool is NULL */
+int workpool_getNumThreads(workpool_t* pool);
+
+/**************** workpool_run ***************/
+/* calls jobfunc(arg, job) for every job in [0, numJobs), in no particular order
+ * and waits until all of them have returned
+ * if pool is NULL the jobs are simply run in order on the calling thread
+ * must not be called from inside a job, or from two threads at once
+ */
+void workpool_run(workpool_t* pool, void* arg, int numJobs,
+                  void (*jobfunc)(void* arg, const int job));
+
+/**************** workpool_delete ***************/
+/* stops and joins every worker thread, then free's the pool */
+void workpool_delete(workpool_t* pool);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * mapc.c - compiles a map for rogue-like game
+ * reads a text map, lays it out and splits it into rooms as the server would,
+ * and writes all of it to a compiled map (see common/mapbin.h) that the server
+ * can be given in place of the text map, and maps into memory as it is
+ *
+ * Usage: mapc [-v] mapfile compiledfile
+ * -v also compiles vision from every walkable tile, which makes the file
+ * much bigger, but leaves the server nothing to calculate when it starts
+ * e.g. mapc -v maps/main.txt maps/main.mapc
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "mem.h"
+#include "grid.h"
+#include "mapcache.h"
+#include "bitset.h"
+#include "tiles.h"
+
+/**************** local functions ****************/
+static bool compileVision(grid_t* grid, int** index, int** data);
+
+/****************** main ******************/
+int
+main(const int argc, char* argv[])
+{
+  bool withVision = (argc == 4 && strcmp(argv[1], "-v") == 0);
+  if (argc != 3 && ! withVision) {
+    fprintf(stderr, "usage: %s [-v] mapfile compiledfile\n", argv[0]);
+    exit(1);
+  }
+  char* mapFile = argv[argc - 2];
+  char* compiledFile = argv[argc - 1];
+
+  // the grid shares the map it is compiled from
+  grid_t* grid = grid_new(mapFile);
+  mapdata_t* map = mapcache_acquire(mapFile);
+  if (grid == NULL || map == NULL) {
+    fprintf(stderr, "%s: can't read map %s\n", argv[0], mapFile);
+    exit(2);
+  }
+
+  int* index = NULL;                   // where each tile's vision starts in data
+  int* data = NULL;                    // vision from every walkable tile
+  if (withVision && ! compileVision(grid, &index, &data)) {
+    fprintf(stderr, "%s: out of memory compiling vision\n", argv[0]);
+    exit(3);
+  }
+  if ( ! mapcache_save(map, compiledFile, index, data, grid_getVisionMode(grid))) {
+    fprintf(stderr, "%s: can't write %s\n", argv[0], compiledFile);
+    exit(4);
+  }
+  printf("%s: %d rows, %d columns, %d rooms", compiledFile,
+         grid_getNumRows(grid), grid_getNumColumns(grid),
+         rooms_getNumRooms(grid_getRooms(grid)));
+  if (withVision) {
+    printf(", %d visible tiles", index[grid_getMapLen(grid)]);
+  }
+  printf("\n");
+
+  if (index != NULL) {
+    mem_free(index);
+  }
+  if (data != NULL) {
+    mem_free(data);
+  }
+  mapcache_release(map);
+  grid_delete(grid);
+  exit(0);
+}
+
+/****************** compileVision ******************/
+/* calculates vision from every walkable tile of the grid, laid out
+ * as mapcache_save takes it: the tiles visible from pos are
+ * (*data)[(*index)[pos]] up to (*data)[(*index)[pos + 1]]
+ * both arrays must later be free'd with mem_free
+ * returns false on failure to allocate memory
+ */
+static bool
+compileVision(grid_t* grid, int** index, int** data)
+{
+  const int mapLen = grid_getMapLen(grid);
+  int maxData = mapLen;                // room in data before it grows
+  int numData = 0;                     // positions in data so far
+  bitset_t* visible = bitset_new(mapLen);
+
+  *index = mem_malloc((mapLen + 1) * sizeof(int));
+  *data = mem_malloc(maxData * sizeof(int));
+  if (visible == NULL || *index == NULL || *data == NULL) {
+    bitset_delete(visible);
+    return false;
+  }
+
+  for (int pos = 0; pos < mapLen; pos++) {
+    (*index)[pos] = numData;
+    if ( ! TILE_IS(grid_getTerrain(grid, pos), TILE_WALKABLE)) {
+      continue;
+    }
+    grid_calculateVision(grid, pos, visible);
+    int count = bitset_count(visible);
+    // grow by doubling, a tile sees at most the whole map
+    while (numData + count > maxData) {
+      int* grown = mem_malloc(2 * maxData * sizeof(int));
+      if (grown == NULL) {
+        bitset_delete(visible);
+        return false;
+      }
+      memcpy(grown, *data, numData * sizeof(int));
+      mem_free(*data);
+      *data = grown;
+      maxData *= 2;
+    }
+    for (int tile = bitset_next(visible, 0); tile >= 0; tile = bitset_next(visible, tile + 1)) {
+      (*data)[numData++] = tile;
+    }
+  }
+  (*index)[mapLen] = numData;
+
+  bitset_delete(visible);
+  return true;
+}
@@ -0,0 +1,211 @@
+/*
+ * mapstat.c - reports what a map will cost the server of rogue-like game
+ * loads each map as the server would and prints its size, walkable tiles,
+ * rooms and passages, connected areas, how much players see from it,
+ * and what that costs in time per move and memory per player
+ *
+ * Usage: mapstat [-p players] mapfile...
+ * players is how many players to add up the cost for, 26 if not given
+ * e.g. mapstat -p 10 maps/big.txt maps/contrib21s/foco-cookies.txt
+ * Vision is calculated from every walkable tile with the vision mode and
+ * player grids the server is built with, so a big map takes a while
+ *
+ * Miles Harris, Summer 2022
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "grid.h"
+#include "player.h"
+#include "bitset.h"
+#include "mapcache.h"
+#include "components.h"
+#include "tiles.h"
+
+/**************** file-local constants *******************/
+static const int DefaultPlayers = 26;  // one for each letter a player can be
+
+/**************** local functions ****************/
+static bool statMap(char* mapFile, int numPlayers);
+static double timeMoves(player_t* player, grid_t* grid);
+static double elapsedNs(struct timespec* start, struct timespec* end);
+
+/****************** main ******************/
+int
+main(const int argc, char* argv[])
+{
+  int numPlayers = DefaultPlayers;
+  int first = 1;                       // first map file in argv
+
+  if (argc > 2 && strcmp(argv[1], "-p") == 0) {
+    numPlayers = atoi(argv[2]);
+    first = 3;
+  }
+  if (first >= argc || numPlayers < 1) {
+    fprintf(stderr, "usage: %s [-p players] mapfile...\n", argv[0]);
+    exit(1);
+  }
+
+  // carry on past a map that can't be read, but say so in the exit status
+  bool allRead = true;
+  for (int i = first; i < argc; i++) {
+    allRead = statMap(argv[i], numPlayers) && allRead;
+  }
+  exit(allRead ? 0 : 2);
+}
+
+/****************** statMap ******************/
+/* prints the report for one map, for the given number of players
+ * returns false if the map can't be read, or on failure to allocate memory
+ */
+static bool
+statMap(char* mapFile, int numPlayers)
+{
+  char name[] = "mapstat";             // of the players that walk the map
+
+  // player_new assumes the map loads, so check that first
+  grid_t* grid = grid_new(mapFile);
+  if (grid == NULL) {
+    fprintf(stderr, "mapstat: can't read map %s\n", mapFile);
+    return false;
+  }
+  grid_t* tableGrid = grid_new(mapFile);
+  player_t* player = player_new(name, mapFile);
+  player_t* tablePlayer = player_new(name, mapFile);
+  bitset_t* visible = bitset_new(grid_getMapLen(grid));
+  if (tableGrid == NULL || player == NULL || tablePlayer == NULL || visible == NULL
+      || ! grid_buildVisionTable(tableGrid, true)) {
+    fprintf(stderr, "mapstat: out of memory for %s\n", mapFile);
+    if (tableGrid != NULL) {
+      grid_delete(tableGrid);
+    }
+    player_delete(player);
+    player_delete(tablePlayer);
+    bitset_delete(visible);
+    grid_delete(grid);
+    return false;
+  }
+  const int mapLen = grid_getMapLen(grid);
+  rooms_t* rooms = grid_getRooms(grid);
+
+  // what the map is made of
+  int numRoom = 0;                     // room floor tiles
+  int numPassage = 0;                  // passage tiles
+  for (int pos = 0; pos < mapLen; pos++) {
+    numRoom += TILE_IS(grid_getTerrain(grid, pos), TILE_ROOM);
+    numPassage += TILE_IS(grid_getTerrain(grid, pos), TILE_PASSAGE);
+  }
+  int numRectangular = 0;              // rooms vision can take the short way
+  int numDoors = 0;                    // doorways of those rooms
+  for (int room = 0; room < rooms_getNumRooms(rooms); room++) {
+    int count = 0;
+    numRectangular += rooms_isRectangular(rooms, room);
+    if (rooms_getDoors(rooms, room, &count) != NULL) {
+      numDoors += count;
+    }
+  }
+  // the areas a player can walk between, as the grid labelled them
+  components_t* components = grid_getComponents(grid);
+  const int numComponents = components_getNumComponents(components);
+  int smallest = 0;
+  for (int id = 0; id < numComponents; id++) {
+    const int size = components_getSize(components, id);
+    smallest = (id == 0 || size < smallest) ? size : smallest;
+  }
+  const int largest = components_getSize(components, components_getLargest(components));
+
+  // how much is seen from every walkable tile
+  long totalSeen = 0;
+  int maxSeen = 0;
+  int maxPos = -1;                     // tile that sees the most
+  for (int pos = 0; pos < mapLen; pos++) {
+    if (TILE_IS(grid_getTerrain(grid, pos), TILE_WALKABLE)) {
+      grid_calculateVision(grid, pos, visible);
+      int seen = bitset_count(visible);
+      totalSeen += seen;
+      if (seen > maxSeen) {
+        maxSeen = seen;
+        maxPos = pos;
+      }
+    }
+  }
+  const int numWalkable = numRoom + numPassage;
+
+  // a player standing where the most is seen, then walking every tile,
+  // once with vision calculated on every move and once from a vision table
+  size_t joinBytes = 0;
+  if (maxPos >= 0) {
+    player_setPos(player, maxPos);
+    player_updateVision(player, grid);
+    joinBytes = player_getBytes(player);
+  }
+  double calculatedNs = timeMoves(player, grid);
+  size_t exploredBytes = player_getBytes(player);
+  timeMoves(tablePlayer, tableGrid);   // fills the table
+  double storedNs = timeMoves(tablePlayer, tableGrid);
+  size_t tableBytes = grid_getBytes(tableGrid) - grid_getBytes(grid);
+  mapcachestats_t stats;
+  mapcache_getStats(&stats);
+
+  printf("%s: %d rows, %d columns, %d tiles\n", mapFile,
+         grid_getNumRows(grid), grid_getNumColumns(grid), mapLen);
+  printf("  walkable:   %d tiles, %d room floor and %d passage\n",
+         numWalkable, numRoom, numPassage);
+  printf("  rooms:      %d, %d of them rectangular with %d doorways\n",
+         rooms_getNumRooms(rooms), numRectangular, numDoors);
+  printf("  components: %d, the largest %d tiles and the smallest %d\n",
+         numComponents, largest, smallest);
+  printf("  vision:     %.1f tiles seen on average, at most %d (%s)\n",
+         numWalkable > 0 ? (double)totalSeen / numWalkable : 0.0, maxSeen,
+         grid_getVisionMode(grid) == VISION_SHADOWCAST ? "shadowcast" : "raycast");
+  printf("  per move:   %.1f us calculated, %.1f us from a vision table of %.1f KB\n",
+         calculatedNs / 1000, storedNs / 1000, tableBytes / 1024.0);
+  printf("  per player: %.1f KB, up to %.1f KB having seen everything\n",
+         joinBytes / 1024.0, exploredBytes / 1024.0);
+  printf("  %d players: %.1f KB with the map and its table, %.2f ms of vision a round "
+         "of moves, %.2f ms from the table\n", numPlayers,
+         (numPlayers * exploredBytes + stats.bytes + tableBytes) / 1024.0,
+         numPlayers * calculatedNs / 1e6, numPlayers * storedNs / 1e6);
+
+  bitset_delete(visible);
+  player_delete(player);
+  player_delete(tablePlayer);
+  grid_delete(tableGrid);
+  grid_delete(grid);
+  return true;
+}
+
+/****************** timeMoves ******************/
+/* moves the player onto every walkable tile of the grid in turn, updating
+ * their vision as the server does after a move
+ * returns the average nanoseconds a move took, 0 if there is nowhere to move
+ */
+static double
+timeMoves(player_t* player, grid_t* grid)
+{
+  struct timespec start, end;          // bounds of the timed loop
+  const int mapLen = grid_getMapLen(grid);
+  int moves = 0;
+
+  timespec_get(&start, TIME_UTC);
+  for (int pos = 0; pos < mapLen; pos++) {
+    if (TILE_IS(grid_getTerrain(grid, pos), TILE_WALKABLE)) {
+      player_setPos(player, pos);
+      player_updateVision(player, grid);
+      moves++;
+    }
+  }
+  timespec_get(&end, TIME_UTC);
+  return moves > 0 ? elapsedNs(&start, &end) / moves : 0.0;
+}
+
+/****************** elapsedNs ******************/
+/* nanoseconds from start to end */
+static double
+elapsedNs(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
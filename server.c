@@ -10,6 +10,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <time.h>
 #include "file.h"
 #include "grid.h"
 #include "mem.h"
@@ -17,6 +18,9 @@
 #include "player.h"
 #include "message.h"
 #include "log.h"
+#include "workpool.h"
+#include "mapcache.h"
+#include "tiles.h"
 
 /****************** TO-DO LIST *********************/
 /* 1. Make a multi-leveled dungeon, but keep everything else the same so just multi level nuggets
@@ -34,8 +38,6 @@
 // global constants
 static const int goldMaxNumPiles = 30; // maximum number of gold piles
 static const int goldMinNumPiles = 10; // minimum number of gold piles
-static const char ROOMTILE = '.';      // char representation of room floor
-static const char PASSAGETILE = '#';   // char representation of passage tile
 static const char GOLDTILE = '*';      // char representation of gold
 static const char PLAYERCHAR = '@';    // player's view of themself
 static const char ZOMBIECHAR = 'Z';    // representation of zombie on map
@@ -45,15 +47,55 @@ static const char AMULETCHAR = '$';    // representation of amulet on map
 static const int MaxNameLength = 50;   // max number of chars in playerName
 static const int MaxPlayers = 5;       // maximum number of players (and spectator)
 static const int GoldTotal = 250;      // amount of gold per floor
+static const int EagerVisionMaxLen = 4096; // bigger maps fill vision table lazily
+static const int LazyVisionMaxLen = 16384; // bigger maps cache vision instead
+static const int MaxTrackedChanges = 64; // map changes logged between vision updates
+static const int RunTableMaxLen = 1 << 20; // bigger maps walk each run to find its end
+
+/* number of worker threads that recalculate players' vision in parallel
+ * can be changed at compile time, e.g. make FLAGS=-DVISION_THREADS=8
+ * 0 recalculates everything on the main thread
+ */
+#ifndef VISION_THREADS
+#define VISION_THREADS 4
+#endif
+
+/* bytes of visible sets kept by the vision cache on maps too big for a table
+ * can be changed at compile time, e.g. make FLAGS=-DVISION_CACHE_BYTES=1048576
+ */
+#ifndef VISION_CACHE_BYTES
+#define VISION_CACHE_BYTES (4 * 1024 * 1024)
+#endif
+
+/* how far players can see outside lit rooms, 0 for no limit, and the
+ * percent chance of each room being dark, as in Rogue. See grid_setLightRadius
+ * can be changed at compile time, e.g. make FLAGS="-DLIGHT_RADIUS=1 -DDARK_ROOM_PERCENT=30"
+ */
+#ifndef LIGHT_RADIUS
+#define LIGHT_RADIUS 0
+#endif
+#ifndef DARK_ROOM_PERCENT
+#define DARK_ROOM_PERCENT 25
+#endif
+
+// players gathered up for one round of vision updates, see updatePlayersVision
+typedef struct visionbatch {
+  player_t** players;                  // every player in the game, in table order
+  bool* recalculate;                   // true where a player's vision is recalculated
+  int numPlayers;                      // number of players gathered
+  int maxPlayers;                      // room in players and recalculate
+} visionbatch_t;
 
 // global game state
 static game_t* game;
+static workpool_t* visionPool;         // workers for updatePlayersVision, NULL if none
 
 // function prototypes
 // initialization functions and utilities
 static void parseArgs(const int argc, char* argv[], char** filepathname, int* seed);
 static bool initializeGame(char* filepathname, int seed);
-static int generateGold(grid_t* grid, int* piles, int seed);
+static int generateGold(grid_t* grid, goldstore_t* gold, int seed);
+static void logPileHelper(void* arg, int pos, int value);
 static bool strToInt(const char string[], int* number);
 // game state changes
 static bool handlePlayerConnect(char* playerName, const addr_t from);
@@ -61,8 +103,12 @@ static bool pickupGold(player_t* player);
 static void pickupGoldHelper(void* arg, const char* key, void* item);
 static bool movePlayer(player_t* player, char directionChar);
 static bool movePlayerHelper(player_t* player, int directionValue);
+static char nextTile(grid_t* grid, player_t* player, int directionValue);
+static bool repeatMovePlayerHelper(player_t* player, direction_t direction);
+static void slidePlayerHelper(player_t* player, int directionValue, int steps);
 static void updatePlayersVision();
-static void updateHelper(void* arg, const char* key, void* item);
+static void gatherHelper(void* arg, const char* key, void* item);
+static void updateHelper(void* arg, const int job);
 static bool handleSpectator(addr_t from);
 static void handlePlayerQuit(player_t* player);
 static void gameOver(bool normalExit);
@@ -205,46 +251,98 @@ static bool initializeGame(char* filepathname, int seed)
     log_v("err loading grid from file");
     return false;
   }
-  
-  // create and check piles array
-  size_t toAlloc = (goldMaxNumPiles * sizeof(int));
-  int* goldPiles = mem_malloc_assert(toAlloc, "failed to alloc piles");
-  // set all values in the array to -1
-  for(int i = 0; i < goldMaxNumPiles; i++){
-    goldPiles[i] = -1;
+  // keep the set of empty room tiles, for placing gold and players
+  // Not critical, the grid finds them by scanning without it
+  if ( ! grid_indexEmptyTiles(serverGrid)) {
+    log_v("failed to index empty tiles, scanning the map for them");
   }
 
+  // create and check the store of gold piles
+  goldstore_t* gold = mem_assert(goldstore_new(grid_getMapLen(serverGrid)),
+                                 "failed to alloc gold store");
+
   // randomly distribute gold
-  numPiles = generateGold(serverGrid, goldPiles, seed); 
-  log_v("generated gold");
-  log_v("piles array initially:");
-  for (int i = 0; i < goldMaxNumPiles; i++) {
-    log_d("%d", goldPiles[i]);
+  numPiles = generateGold(serverGrid, gold, seed); 
+  if (numPiles < 0) {
+    log_v("failed to place the gold");
+    goldstore_delete(gold);
+    grid_delete(serverGrid);
+    return false;
+  }
+  log_d("generated %d piles of gold", numPiles);
+
+  // light the map before any vision is stored, rooms go dark at random
+  // after generateGold has seeded the generator
+  if (LIGHT_RADIUS > 0 && grid_setLightRadius(serverGrid, LIGHT_RADIUS)) {
+    rooms_t* rooms = grid_getRooms(serverGrid);
+    for (int room = 0; room < rooms_getNumRooms(rooms); room++) {
+      if (rand() % 100 < DARK_ROOM_PERCENT) {
+        grid_setRoomLit(serverGrid, room, false);
+      }
+    }
+    log_d("light radius %d", LIGHT_RADIUS);
+  }
+
+  // precompute vision from every walkable tile, lazily on big maps
+  // so that startup stays fast, and on the biggest keep only recent tiles
+  // so memory stays bounded. Not critical, vision works without either
+  bool lazyVision = (grid_getMapLen(serverGrid) > EagerVisionMaxLen);
+  if (grid_getMapLen(serverGrid) > LazyVisionMaxLen) {
+    if (grid_buildVisionCache(serverGrid, VISION_CACHE_BYTES)) {
+      log_d("built vision cache (%d bytes)", VISION_CACHE_BYTES);
+    } else {
+      log_v("failed to build vision cache, calculating vision on every move");
+    }
+  } else if (grid_buildVisionTable(serverGrid, lazyVision)) {
+    log_d("built vision table (lazy = %d)", lazyVision);
+  } else {
+    log_v("failed to build vision table, calculating vision on every move");
+  }
+  
+  // from here on log changes to the map, so that vision updates only
+  // have to look at what changed. Not critical either
+  if ( ! grid_trackChanges(serverGrid, MaxTrackedChanges)) {
+    log_v("failed to track map changes, recalculating all vision on every move");
   }
+
+  // keep how far a run can go from every tile, so that run moves
+  // slide straight to where they stop. 8 bytes a tile, so not on the biggest maps
+  if (grid_getMapLen(serverGrid) <= RunTableMaxLen && ! grid_buildRunTable(serverGrid)) {
+    log_v("failed to build run table, walking each run to find its end");
+  }
+  log_v("piles initially:");
+  goldstore_iterate(gold, NULL, logPileHelper);
   
   // create global game state
-  game = game_new(goldPiles, serverGrid);
-  game_setNumPiles(game, numPiles);
+  game = game_new(gold, serverGrid);
   log_v("created game");
 
+  // start the vision workers. Not critical, vision is updated on this thread without them
+  if ((visionPool = workpool_new(VISION_THREADS)) != NULL) {
+    log_d("started %d vision threads", workpool_getNumThreads(visionPool));
+  } else {
+    log_v("failed to start vision threads, updating vision on one thread");
+  }
+
   return true;
 }
 
 /************* generateGold **************/
-/* randomly generates piles of gold and adds them to the map
- * returns the number of piles generated 
+/* randomly generates piles of gold and adds them to the map,
+ * and to the given store, each at the tile it lies on
+ * returns the number of piles placed, -1 if the gold could not all be placed
  * helper for initializeGame
  */
-static int generateGold(grid_t* grid, int* piles, int seed)
+static int generateGold(grid_t* grid, goldstore_t* gold, int seed)
 {
   int totalGold = GoldTotal;                 // max gold
+  int piles[goldMaxNumPiles];                // value (gold) of each pile
   int currPile = 0;                          // value (gold) of current pile
   int currIndex = 0;                         // index into array
   int tmp = 0;                               // temp int
-  char* active = grid_getActive(grid);       // server active map
-  int gridLen = grid_getMapLen(grid);        // length of map string
   int pilesInserted = 0;
-  int slot = 0;
+  int lastSlot = -1;                         // tile of the last pile placed
+  int numPlaced = 0;                         // piles on the map
 
   // seed random gen
   srand(seed);
@@ -280,19 +378,46 @@ static int generateGold(grid_t* grid, int* piles, int seed)
   // loop over all piles of gold
   while ( pilesInserted < currIndex ) {   // we don't want to insert more piles than we have
     
-    tmp = rand();
-    slot = (tmp % gridLen);
-
-    if ( active[slot] == ROOMTILE ) { // we only insert into valid spaces in the map
-      if (grid_replace(grid, slot, GOLDTILE)) {  
-        log_d("added gold at index %d", slot);
-        pilesInserted++;
-      } else {
-        log_v("initializeGame: err inserting pile in map");
+    // we only insert into valid spaces in the map, picked from the empty ones
+    // in its main area, the largest component a player can walk around
+    // on a map with fewer free tiles than piles, the last pile placed
+    // takes the gold of those left over, so all of it can still be found
+    const int slot = grid_randomMainEmptyTile(grid);
+    if (slot < 0) {
+      if (lastSlot < 0) {
+        log_v("generateGold: no room in map for any gold");
+        return -1;
+      }
+      log_v("generateGold: no room left in map, last pile takes the rest");
+      for (; pilesInserted < currIndex; pilesInserted++) {
+        if ( ! goldstore_add(gold, lastSlot, piles[pilesInserted])) {
+          log_v("generateGold: err adding gold to last pile");
+          return -1;
+        }
       }
-    } 
+      return numPlaced;
+    }
+    if ( ! grid_placeItem(grid, slot, GOLDTILE)
+        || ! goldstore_add(gold, slot, piles[pilesInserted])) {
+      log_v("generateGold: err inserting pile in map");
+      return -1;
+    }
+    log_d("added gold at index %d", slot);
+    lastSlot = slot;
+    numPlaced++;
+    pilesInserted++;
   }
-  return currIndex;
+  return numPlaced;
+}
+
+/************* logPileHelper **************/
+/* logs one pile of gold, passed to goldstore_iterate
+ * helper for initializeGame
+ */
+static void logPileHelper(void* arg, int pos, int value)
+{
+  log_d("pile at index %d", pos);
+  log_d("  holds %d gold", value);
 }
 
 /************* GAME FUNCTIONS ****************/
@@ -318,11 +443,8 @@ static bool handlePlayerConnect(char* playerName, addr_t from)
   player_t* player;                      // stores information for given player
   int nameLen;                           // length of playerName
   int randPos;                           // random position to drop player
-  int mapLen;                            // length of in game map
   grid_t* grid;                          // game grid
-  char* activeMap;                       // active map of current game
   int lastCharID;                        // most recently assigned player 'character'
-  bool emptySpace = false;               // true iff there is > 1 ROOMTILE in map
   char* mapfile = game_getMapfile(game); // game map used to initialize player vision
 
   // check params (non-critical)
@@ -389,34 +511,23 @@ static bool handlePlayerConnect(char* playerName, addr_t from)
   player_setCharID(player, (char)(lastCharID));
   
   // randomize initial position
-  // get length of map and map itself
+  // get the game's grid
   grid = game_getGrid(game);
-  mapLen = grid_getMapLen(grid);
-  activeMap = grid_getActive(grid);
 
-  // check for existence of empty spaces, true if there is at least 1
-  emptySpace = grid_containsEmptyTile(grid);
+  // pick one of the empty room tiles, in the area the gold was placed in
+  randPos = grid_randomMainEmptyTile(grid);
 
   // clean up and return if no space to add player
-  if (! emptySpace) {
+  if (randPos < 0) {
     log_s("no room in map to add player: %s", playerName);
     player_delete(player);
     message_send(from, "QUIT no room in map to add you");
     // non-critical error
     return true;
   }
-  // loop until valid pos found
-  while (true) {
-    // constrain rand to the length of the map string
-    randPos = (rand() % mapLen);
-    // if empty room tile
-    if (activeMap[randPos] == ROOMTILE) {
-      // set player pos and update server active map
-      player_setPos(player, randPos);
-      grid_replace(grid, randPos, player_getCharID(player));
-      break;
-    }
-  }
+  // set player pos and place them on the server's map
+  player_setPos(player, randPos);
+  grid_placeEntity(grid, randPos, player_getCharID(player));
   
   // update client with their ID and the state of the game
   sendOK(player);
@@ -510,7 +621,7 @@ static void handlePlayerQuit(player_t* player)
   }
 
   // remove player from the game map and send message
-  grid_revertTile(gameGrid, player_getPos(player));
+  grid_placeEntity(gameGrid, player_getPos(player), '\0');
   message_send(player_getAddr(player), "QUIT Thanks for playing!\n");
   // remove player from all other's screens
   updatePlayersVision();
@@ -529,6 +640,19 @@ static void gameOver(bool normalExit)
   hashtable_t* playerTable;            // table of players in game
   playerTable = game_getPlayers(game);
   char* gameSummary;                   // game over summary table
+  viscachestats_t stats;               // how well the vision cache did, if any
+  mapcachestats_t mapStats;            // how often joining players shared the map
+
+  if (grid_getVisionCacheStats(game_getGrid(game), &stats)) {
+    log_d("vision cache: %d hits", (int)stats.hits);
+    log_d("vision cache: %d misses", (int)stats.misses);
+    log_d("vision cache: %d evictions", (int)stats.evictions);
+  }
+  if (mapcache_getStats(&mapStats)) {
+    log_d("map cache: %d map file reads", (int)mapStats.reads);
+    log_d("map cache: %d loads shared without reading", (int)mapStats.hits);
+    log_d("map cache: %d compiled maps mapped", (int)mapStats.compiled);
+  }
 
   // exit procedure if error
   if ( ! normalExit) {
@@ -536,6 +660,7 @@ static void gameOver(bool normalExit)
     log_v("calling gameOver(error)");
     hashtable_iterate(playerTable, &normalExit, gameOverHelper);
     game_delete(game);
+    workpool_delete(visionPool);
     return;
   }
 
@@ -551,6 +676,7 @@ static void gameOver(bool normalExit)
   hashtable_iterate(playerTable, container, gameOverHelper);
   // clean up
   game_delete(game);
+  workpool_delete(visionPool);
   free(gameSummary);
 }
 
@@ -589,6 +715,7 @@ static void gameOverHelper(void* arg, const char* key, void* item)
 /***************** pickupGold *************/
 /* handles case where client picks up gold
  * passed a player, who is the one picking up the gold
+ * they take the pile on the tile they are standing on
  * returns true if last pile picked up (no more gold left after player gets it)
  * so that it can be returned up the chain all the way to handleMessage
  * so that handleMessage can exit properly and the game can end
@@ -596,34 +723,28 @@ static void gameOverHelper(void* arg, const char* key, void* item)
  */
 static bool pickupGold(player_t* player)
 {
-  int* piles = game_getPiles(game);   // array of gold piles in game
+  goldstore_t* gold = game_getGold(game);  // piles of gold in game
 
   // check params and values
-  if (player == NULL || piles == NULL) {
+  if (player == NULL || gold == NULL) {
     log_v("bad params in pickupGold");
     return false;
   }
 
-  // update player gold total
-  for (int i = 0; i < game_getNumPiles(game); i++) {
-    const int currPile = piles[i];
-    // skip empty piles
-    if (currPile == -1) {
-      log_d("skipping empty pile of gold, value is: %d", piles[i]);
-      continue;
-    }
+  // update player gold total with the pile under them
+  const int currPile = goldstore_take(gold, player_getPos(player));
+  if (currPile == 0) {
+    log_v("pickupGold: no pile of gold at player's position");
+  } else {
     // modify player and game state
     player_addGold(player, currPile);
     game_subtractGold(game, currPile);
-    piles[i] = -1;
     
     // notify player
     sendGold(player, currPile);
 
     // notify all players of new gold state using GOLD message w/ 0 picked up
     hashtable_iterate(game_getPlayers(game), player, pickupGoldHelper);
-    // exit loop once gold picked up
-    break;
   }
 
   // return up the chain to trigger gameOver if all gold collected
@@ -675,34 +796,75 @@ moveIterateHelper(void* arg, const char* key, void* item)
   }
 }
 
+/************** nextTile *********/
+/* returns the terrain a player would move onto when shifted by
+ * directionValue, or '\0' if that is off the map
+ * so that moves off the edge of the map are simply invalid
+ * whatever stands on the tile is on the grid's item and entity planes
+ */
+static char nextTile(grid_t* grid, player_t* player, int directionValue)
+{
+  return grid_getTerrain(grid, player_getPos(player) + directionValue);
+}
+
 /************* repeatMovePlayerHelper **********/
-/* repeatedly moves a player by a given integer value
- * where the integer represents the distance moved in the in-game map
+/* repeatedly moves a player in the given direction until they hit a wall
+ * the empty tiles on the way are crossed in one slide (see slidePlayerHelper),
+ * looked up in the grid's run table, and the gold or player that stops
+ * a slide is stepped onto with movePlayerHelper before the run carries on
  * returns true if, at any point in the "big move", the last gold is collected
  * false if otherwise
  */
-static bool repeatMovePlayerHelper(player_t* player, int directionValue)
+static bool repeatMovePlayerHelper(player_t* player, direction_t direction)
 {
   bool gameOverFlag = false;           // set to true if last gold picked up
   grid_t* grid = game_getGrid(game);   // in-game grid
+  // distance moved in the in-game map by one step
+  int directionValue = tiles_stepOffset(direction, grid_getNumColumns(grid));
   // character player is trying to move to
-  char next = grid_getActive(grid)[player_getPos(player) + directionValue];
+  char next = nextTile(grid, player, directionValue);
   
-  // as long as we encounter a roomtile/passagetile/goldtile/player, move
-  while (next == ROOMTILE || next == PASSAGETILE || next == GOLDTILE 
-         || isupper(next) != 0) {
-    // move player and update next char
-    gameOverFlag = movePlayerHelper(player, directionValue);
-    // return early if game ends before move ends
-    if (gameOverFlag) {
-      return gameOverFlag;
+  // as long as we encounter a roomtile/passagetile, whatever is on it, move
+  while (TILE_IS(next, TILE_WALKABLE)) {
+    // cross the empty tiles, then step onto whatever stopped the slide
+    int run = grid_getRunLength(grid, player_getPos(player), direction);
+    if (run > 0) {
+      slidePlayerHelper(player, directionValue, run);
     }
-    next = grid_getActive(grid)[player_getPos(player) + directionValue];
+    if (TILE_IS(nextTile(grid, player, directionValue), TILE_WALKABLE)) {
+      int from = player_getPos(player);
+      gameOverFlag = movePlayerHelper(player, directionValue);
+      // return early if game ends before move ends, or the way is blocked
+      if (gameOverFlag || player_getPos(player) == from) {
+        return gameOverFlag;
+      }
+    }
+    next = nextTile(grid, player, directionValue);
   }
   // returns false if game continues, true if it ends
   return gameOverFlag;
 }
 
+/************* slidePlayerHelper **********/
+/* moves a player the given number of steps of directionValue at once,
+ * over tiles that must be walkable and empty (see grid_getRunLength)
+ * the player remembers the tiles seen from each tile passed over, as if they
+ * had stopped there, and everyone's vision is updated once at the end
+ */
+static void slidePlayerHelper(player_t* player, int directionValue, int steps)
+{
+  grid_t* grid = game_getGrid(game);   // in-game grid
+  int from = player_getPos(player);    // where the slide starts
+  int to = from + steps * directionValue; // where it ends
+
+  for (int pos = from + directionValue; pos != to; pos += directionValue) {
+    player_rememberVision(player, grid, pos);
+  }
+  player_setPos(player, to);
+  grid_moveEntity(grid, from, to);
+  updatePlayersVision();
+}
+
 /************** movePlayerHelper ********/
 /* handles the actual in-game process of moving players
  * takes the player to move, and an integer representing the distance
@@ -714,66 +876,62 @@ static bool repeatMovePlayerHelper(player_t* player, int directionValue)
 static bool movePlayerHelper(player_t* player, int directionValue)
 {
   player_t* bumpedPlayer = NULL; // player that current "mover" "collides" with
-  char bumpedPlayerCharID;       // that player's char representation on the map
   hashtable_t* playerTable = game_getPlayers(game); // table of players
   grid_t* grid = game_getGrid(game); // in-game grid      
   int playerPos;                 // in game position of current player
-  int bumpedPos;                 // position of bumped player, if they exist
+  int nextPos;                   // position the player is moving to
   bool gameOverFlag = false;     // becomes true if pickupGold returns true
 
-  // grid tile that client is trying to move to 
-  char next = grid_getActive(grid)[player_getPos(player) + directionValue];
+  // terrain of the grid tile that client is trying to move to 
+  char next = nextTile(grid, player, directionValue);
   log_c("in move, nextChar = %c", next);
-  // char representation of moving player on map
-  const char playerCharID = player_getCharID(player); 
   playerPos = player_getPos(player);
+  nextPos = playerPos + directionValue;
+  // entity standing on that tile, '\0' if none
+  char bumpedCharID = grid_getEntity(grid, nextPos);
 
   // if the move is valid (does not hit a wall or similar)
-  if (next == ROOMTILE || next == PASSAGETILE || next == GOLDTILE 
-      || isupper(next) != 0) {
-
-    // if we land on a pile of gold
-    if (next == GOLDTILE) {
-      log_v("nextchar is a goldtile");
-      // update map with removed gold pile and new player position
-      grid_revertTile(grid, player_getPos(player));
-      player_setPos(player, player_getPos(player) + directionValue);
-      grid_replace(grid, player_getPos(player), playerCharID);
-
-      // update player gold and the game's piles
-      gameOverFlag = pickupGold(player);
+  if (TILE_IS(next, TILE_WALKABLE)) {
 
     // if we hit another player, handle collision
-    } else if (isupper(next) != 0) {
+    if (bumpedCharID != '\0') {
       log_v("handling a collision");
       // holds two items to pass into iterator
       void* voidPlayer = NULL;
-      void* container[2] = {voidPlayer, &next}; 
+      void* container[2] = {voidPlayer, &bumpedCharID}; 
       
       // iterate over the hashtable to find the player bumped into
       // assigns bumpedPlayer
       hashtable_iterate(playerTable, container, moveIterateHelper);
       bumpedPlayer = container[0];
+      // only players trade places, anything else blocks the way
+      if (bumpedPlayer == NULL) {
+        log_s("%s is blocked", player_getName(player));
+        return gameOverFlag;
+      }
 
-      // switch the positions of the colliding players
-      bumpedPos = player_getPos(bumpedPlayer);
-      player_setPos(player, bumpedPos);
+      // switch the positions of the colliding players, on the map too
+      player_setPos(player, nextPos);
       player_setPos(bumpedPlayer, playerPos);
+      grid_moveEntity(grid, playerPos, nextPos);
       
-      // update map with the new positions of both players
-      bumpedPlayerCharID = player_getCharID(bumpedPlayer);
-      grid_replace(grid, player_getPos(bumpedPlayer), bumpedPlayerCharID);
-      grid_replace(grid, player_getPos(player), playerCharID);
-      
+    // if we land on a pile of gold
+    } else if (grid_getItem(grid, nextPos) == GOLDTILE) {
+      log_v("nextchar is a goldtile");
+      // update map with removed gold pile and new player position
+      grid_placeItem(grid, nextPos, '\0');
+      player_setPos(player, nextPos);
+      grid_moveEntity(grid, playerPos, nextPos);
+
+      // update player gold and the game's piles
+      gameOverFlag = pickupGold(player);
+
     // if normal move, no gold or collision
     } else {
       log_v("making a normal move");
-      // revert player's old position to reference
-      grid_revertTile(grid, player_getPos(player));
-      
-      // then set their new position and update map accordingly
-      player_setPos(player, player_getPos(player) + directionValue);
-      grid_replace(grid, player_getPos(player), playerCharID);
+      // set their new position and move them on the map
+      player_setPos(player, nextPos);
+      grid_moveEntity(grid, playerPos, nextPos);
     }
   // if move is invalid log and do nothing
   } else {
@@ -842,35 +1000,35 @@ static bool movePlayer(player_t* player, char directionChar)
       break;
     // repeat move right case
     case 'L' :
-      gameOverFlag = repeatMovePlayerHelper(player, 1);
+      gameOverFlag = repeatMovePlayerHelper(player, DIR_RIGHT);
       break;
     // repeat move left case
     case 'H' :
-      gameOverFlag = repeatMovePlayerHelper(player, -1);
+      gameOverFlag = repeatMovePlayerHelper(player, DIR_LEFT);
       break;
     // repeat move up case 
     case 'K' :
-      gameOverFlag = repeatMovePlayerHelper(player, 0 - grid_getNumColumns(grid) - 1);
+      gameOverFlag = repeatMovePlayerHelper(player, DIR_UP);
       break;
     // repeat move down case
     case 'J' :
-      gameOverFlag = repeatMovePlayerHelper(player, grid_getNumColumns(grid) + 1);
+      gameOverFlag = repeatMovePlayerHelper(player, DIR_DOWN);
       break;
     // repeat move down left case
     case 'B' :
-      gameOverFlag = repeatMovePlayerHelper(player, grid_getNumColumns(grid));
+      gameOverFlag = repeatMovePlayerHelper(player, DIR_DOWNLEFT);
       break;
     // repeat move down right case
     case 'N' :
-      gameOverFlag = repeatMovePlayerHelper(player, grid_getNumColumns(grid) + 2);
+      gameOverFlag = repeatMovePlayerHelper(player, DIR_DOWNRIGHT);
       break;
     // repeat move up left case
     case 'Y' :
-      gameOverFlag = repeatMovePlayerHelper(player, 0 - grid_getNumColumns(grid) - 2);
+      gameOverFlag = repeatMovePlayerHelper(player, DIR_UPLEFT);
       break;
     // repeat move up right case
     case 'U' :
-      gameOverFlag = repeatMovePlayerHelper(player, 0 - grid_getNumColumns(grid));
+      gameOverFlag = repeatMovePlayerHelper(player, DIR_UPRIGHT);
       break;
     // default to log and ignore
     default:
@@ -881,56 +1039,119 @@ static bool movePlayer(player_t* player, char directionChar)
   return gameOverFlag;
 }
 
+/****************** gatherHelper ******************/
+/* helper function for updatePlayersVision
+ * passed into hashtable_iterate, adds each player to the visionbatch in arg
+ */
+static void gatherHelper(void* arg, const char* key, void* item)
+{
+  visionbatch_t* batch = arg;
+
+  if (batch->numPlayers < batch->maxPlayers) {
+    batch->players[batch->numPlayers++] = item;
+  }
+}
+
 /****************** updateHelper ******************/
 /* helper function for updatePlayersVision
- * passed into hashtable_iterate
- * does all the work of updating vision and sending display messages
+ * passed into workpool_run, so it runs on several threads at once
+ * recalculates the vision of one player in the visionbatch in arg, if needed
+ * touches nothing but that player, and only reads the game grid
  */
-static void updateHelper(void* arg, const char* key, void* item)
+static void updateHelper(void* arg, const int job)
 {
-  player_t* currPlayer = item;         // current player struct in hashtable
-  grid_t* playerVisionGrid;            // current player's vision
-  int playerPos;                       // current player's position
-  
-  // handle spectator differently
-  if (strcmp(player_getName(currPlayer), "spectator") == 0) {
-    log_v("updating spectator vision");
-    // send them the active map, don't bother changing their vision
-    sendDisplay(currPlayer, grid_getActive(game_getGrid(game)));
+  visionbatch_t* batch = arg;
+  player_t* currPlayer = batch->players[job]; // player this job updates
+
+  if ( ! batch->recalculate[job]) {
     return;
   }
 
-  // handle normal players
-  log_s("updating %s's vision", player_getName(currPlayer));
-  playerVisionGrid = player_getVision(currPlayer);
-  playerPos = player_getPos(currPlayer);
-
   // calculate and update a player's vision grid
   player_updateVision(currPlayer, game_getGrid(game));
   // replace the character at the player's position with the '@' symbol
   // in the player's local vision string
-  grid_replace(playerVisionGrid, playerPos, PLAYERCHAR);
-
-  // message player with updated vision
-  sendDisplay(currPlayer, grid_getActive(player_getVision(currPlayer)));
+  grid_replace(player_getVision(currPlayer), player_getPos(currPlayer), PLAYERCHAR);
 }
 
 /******************* updatePlayersVision *************/
 /* updates vision for all players currently in the game
+ * players who moved get their vision recalculated, in parallel on the
+ * vision workers. Everyone else only has the changed tiles patched in
  * handles spectator seperately as vision functions don't work on them
  * then sends the DISPLAY message with appropriate vision string
+ * to every player whose view changed since the last update
  * takes no parameters and returns void
  */
 static void updatePlayersVision()
 {
   hashtable_t* playerTable;            // table of players in game
+  grid_t* grid = game_getGrid(game);   // in-game grid
+  int numChanges = 0;                  // number of map positions changed
+  visionbatch_t batch;                 // players to update
+  int numRecalculated = 0;             // players whose vision is recalculated
+  struct timespec start, end;          // bounds of the parallel phase
 
   // assign and check playerTable
   playerTable = mem_assert(game_getPlayers(game), 
                            "players NULL in updateVision"); 
 
-  // iterate over all players and update their vision
-  hashtable_iterate(playerTable, NULL, updateHelper);
+  // map positions changed since the last update, NULL means assume all did
+  const int* changes = grid_getChanges(grid, &numChanges);
+
+  // gather every player, with room for the spectator too
+  batch.maxPlayers = game_getNumPlayers(game) + 1;
+  batch.numPlayers = 0;
+  batch.players = mem_malloc_assert(batch.maxPlayers * sizeof(player_t*),
+                                    "failed to alloc players in updateVision");
+  batch.recalculate = mem_malloc_assert(batch.maxPlayers * sizeof(bool),
+                                        "failed to alloc players in updateVision");
+  hashtable_iterate(playerTable, &batch, gatherHelper);
+
+  // players who stayed put see from the same place, so only moved players
+  // need their vision recalculated
+  for (int i = 0; i < batch.numPlayers; i++) {
+    bool spectator = (strcmp(player_getName(batch.players[i]), "spectator") == 0);
+    batch.recalculate[i] = ! spectator
+                           && (changes == NULL || player_hasMoved(batch.players[i]));
+    if (batch.recalculate[i]) {
+      numRecalculated++;
+    }
+  }
+
+  // recalculate in parallel. The game grid is only read until the barrier
+  if (numRecalculated > 0) {
+    timespec_get(&start, TIME_UTC);
+    workpool_run(visionPool, &batch, batch.numPlayers, updateHelper);
+    timespec_get(&end, TIME_UTC);
+    log_d("recalculated vision for %d players", numRecalculated);
+    log_d("parallel vision phase took %d us",
+          (int)((end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000));
+  }
+
+  // then send the displays from this thread, in table order
+  for (int i = 0; i < batch.numPlayers; i++) {
+    player_t* currPlayer = batch.players[i];
+
+    if (strcmp(player_getName(currPlayer), "spectator") == 0) {
+      // spectator sees the whole map, so only a change-free update can be skipped
+      if (changes == NULL || numChanges > 0) {
+        log_v("updating spectator vision");
+        // send them the active map, don't bother changing their vision
+        sendDisplay(currPlayer, grid_getActive(grid));
+      }
+    } else if (batch.recalculate[i]) {
+      log_s("updated %s's vision", player_getName(currPlayer));
+      sendDisplay(currPlayer, grid_getActive(player_getVision(currPlayer)));
+    } else if (player_patchVision(currPlayer, grid, changes, numChanges)) {
+      log_s("patched %s's vision", player_getName(currPlayer));
+      sendDisplay(currPlayer, grid_getActive(player_getVision(currPlayer)));
+    }
+  }
+
+  mem_free(batch.players);
+  mem_free(batch.recalculate);
+  grid_clearChanges(grid);
 }
 
 /************** MESSAGING FUNCTIONS ***************/